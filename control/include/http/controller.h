@@ -81,6 +81,10 @@ class Controller {
     // The LRU cache size for service config.
     // If not set or is 0 default value, the cache size is 1000.
     int service_config_cache_size{};
+
+    // The maximum number of request contexts kept to be reused by the
+    // request handlers. 0 disables the reuse.
+    int request_context_pool_size{100};
   };
 
   // The factory function to create a new instance of the controller.
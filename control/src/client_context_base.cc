@@ -16,6 +16,7 @@
 #include "client_context_base.h"
 
 using ::google::protobuf::util::Status;
+using ::istio::mixer::v1::Attributes;
 using ::istio::mixer::v1::config::client::TransportConfig;
 using ::istio::mixer_client::CancelFunc;
 using ::istio::mixer_client::CheckOptions;
@@ -24,6 +25,7 @@ using ::istio::mixer_client::Environment;
 using ::istio::mixer_client::MixerClientOptions;
 using ::istio::mixer_client::QuotaOptions;
 using ::istio::mixer_client::ReportOptions;
+using ::istio::mixer_client::StaticAttributes;
 using ::istio::mixer_client::Statistics;
 using ::istio::mixer_client::TransportCheckFunc;
 
@@ -72,7 +74,8 @@ ClientContextBase::ClientContextBase(const TransportConfig& config,
 
 CancelFunc ClientContextBase::SendCheck(TransportCheckFunc transport,
                                         DoneFunc on_done,
-                                        RequestContext* request) {
+                                        RequestContext* request,
+                                        bool release_attributes) {
   // Intercept the callback to save check status in request_context
   auto local_on_done = [request, on_done](const Status& status) {
     // save the check status code
@@ -83,8 +86,18 @@ CancelFunc ClientContextBase::SendCheck(TransportCheckFunc transport,
   // TODO: add debug message
   // GOOGLE_LOG(INFO) << "Check attributes: " <<
   // request->attributes.DebugString();
-  return mixer_client_->Check(request->attributes, request->quotas, transport,
-                              local_on_done);
+  if (release_attributes) {
+    return mixer_client_->Check(request->static_attributes,
+                                std::move(request->attributes),
+                                request->quotas, transport, local_on_done);
+  }
+  return mixer_client_->Check(request->static_attributes, request->attributes,
+                              request->quotas, transport, local_on_done);
+}
+
+std::shared_ptr<const StaticAttributes>
+ClientContextBase::CreateStaticAttributes(const Attributes& attributes) {
+  return mixer_client_->CreateStaticAttributes(attributes);
 }
 
 void ClientContextBase::SendReport(const RequestContext& request) {
@@ -94,6 +107,10 @@ void ClientContextBase::SendReport(const RequestContext& request) {
   mixer_client_->Report(request.attributes);
 }
 
+void ClientContextBase::SendReport(RequestContext&& request) {
+  mixer_client_->Report(std::move(request.attributes));
+}
+
 void ClientContextBase::GetStatistics(Statistics* stat) const {
   mixer_client_->GetStatistics(stat);
 }
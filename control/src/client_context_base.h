@@ -39,13 +39,25 @@ class ClientContextBase {
   virtual ~ClientContextBase() {}
 
   // Use mixer client object to make a Check call.
+  // If release_attributes is true, the request attributes are moved into
+  // the call; only use it if they are not needed for a Report call.
   ::istio::mixer_client::CancelFunc SendCheck(
       ::istio::mixer_client::TransportCheckFunc transport,
-      ::istio::mixer_client::DoneFunc on_done, RequestContext* request);
+      ::istio::mixer_client::DoneFunc on_done, RequestContext* request,
+      bool release_attributes = false);
+
+  // Compresses the static attributes added to the requests, see
+  // RequestContext::static_attributes. Returns null if not supported.
+  std::shared_ptr<const ::istio::mixer_client::StaticAttributes>
+  CreateStaticAttributes(const ::istio::mixer::v1::Attributes& attributes);
 
   // Use mixer client object to make a Report call.
   void SendReport(const RequestContext& request);
 
+  // Make a Report call for the last time of a request, its attributes
+  // are moved into the call.
+  void SendReport(RequestContext&& request);
+
   // Get statistics.
   void GetStatistics(::istio::mixer_client::Statistics* stat) const;
 
@@ -20,11 +20,17 @@ using ::istio::mixer::v1::config::client::ServiceConfig;
 namespace istio {
 namespace mixer_control {
 namespace http {
+namespace {
+// The maximum number of request contexts kept for reuse, if not set by
+// Controller::Options.
+const int kRequestContextPoolSize = 100;
+}  // namespace
 
 ClientContext::ClientContext(const Controller::Options& data)
     : ClientContextBase(data.config.transport(), data.env),
       config_(data.config),
-      service_config_cache_size_(data.service_config_cache_size) {}
+      service_config_cache_size_(data.service_config_cache_size),
+      request_context_pool_(data.request_context_pool_size) {}
 
 ClientContext::ClientContext(
     std::unique_ptr<::istio::mixer_client::MixerClient> mixer_client,
@@ -32,7 +38,8 @@ ClientContext::ClientContext(
     int service_config_cache_size)
     : ClientContextBase(std::move(mixer_client)),
       config_(config),
-      service_config_cache_size_(service_config_cache_size) {}
+      service_config_cache_size_(service_config_cache_size),
+      request_context_pool_(kRequestContextPoolSize) {}
 
 const std::string& ClientContext::GetServiceName(
     const std::string& service_name) const {
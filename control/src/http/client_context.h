@@ -18,6 +18,7 @@
 
 #include "control/include/http/controller.h"
 #include "control/src/client_context_base.h"
+#include "control/src/request_context_pool.h"
 
 namespace istio {
 namespace mixer_control {
@@ -52,12 +53,18 @@ class ClientContext : public ClientContextBase {
   // Get the service config cache size
   int service_config_cache_size() const { return service_config_cache_size_; }
 
+  // The request contexts reused by the request handlers.
+  RequestContextPool& request_context_pool() { return request_context_pool_; }
+
  private:
   // The http client config.
   const ::istio::mixer::v1::config::client::HttpClientConfig& config_;
 
   // The service config cache size
   int service_config_cache_size_;
+
+  // The request contexts of finished requests, to be reused.
+  RequestContextPool request_context_pool_;
 };
 
 }  // namespace http
@@ -0,0 +1,215 @@
+/* Copyright 2018 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the allocations and the time per HTTP request of the request
+// handlers, with and without reused request contexts. It replaces the
+// global operator new to count allocations.
+// Usage: bazel run -c opt //control/src/http:request_handler_benchmark
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <new>
+
+#include "control/include/http/controller.h"
+
+using ::google::protobuf::util::Status;
+using ::istio::mixer::v1::CheckRequest;
+using ::istio::mixer::v1::CheckResponse;
+using ::istio::mixer::v1::ReportRequest;
+using ::istio::mixer::v1::ReportResponse;
+using ::istio::mixer::v1::config::client::HttpClientConfig;
+using ::istio::mixer_client::CancelFunc;
+using ::istio::mixer_client::DoneFunc;
+
+namespace {
+
+std::atomic<int64_t> num_allocations(0);
+
+}  // namespace
+
+void* operator new(size_t size) {
+  ++num_allocations;
+  void* p = malloc(size == 0 ? 1 : size);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void* p) noexcept { free(p); }
+
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+namespace istio {
+namespace mixer_control {
+namespace http {
+namespace {
+
+const int kNumRequests = 100000;
+
+// The data of a typical request.
+class FakeCheckData : public CheckData {
+ public:
+  bool ExtractIstioAttributes(std::string* data) const override {
+    return false;
+  }
+  bool GetSourceIpPort(std::string* ip, int* port) const override {
+    *ip = std::string("\x0a\x00\x00\x0c", 4);
+    *port = 34567;
+    return true;
+  }
+  bool GetSourceUser(std::string* user) const override {
+    *user = "spiffe://cluster.local/ns/default/sa/reviews";
+    return true;
+  }
+  std::map<std::string, std::string> GetRequestHeaders() const override {
+    return {{":authority", "productpage:9080"},
+            {":method", "GET"},
+            {":path", "/productpage?id=12345"},
+            {"user-agent", "curl/7.54.0"},
+            {"x-request-id", "8c3b1b4e-5d0a-4b6f-9d3e-2f6c1a7b9e10"}};
+  }
+  bool IsMutualTLS() const override { return true; }
+  bool FindHeaderByType(HeaderType header_type,
+                        std::string* value) const override {
+    switch (header_type) {
+      case HEADER_PATH:
+        *value = "/productpage?id=12345";
+        return true;
+      case HEADER_HOST:
+        *value = "productpage:9080";
+        return true;
+      case HEADER_METHOD:
+        *value = "GET";
+        return true;
+      case HEADER_USER_AGENT:
+        *value = "curl/7.54.0";
+        return true;
+      default:
+        return false;
+    }
+  }
+  bool FindHeaderByName(const std::string& name,
+                        std::string* value) const override {
+    return false;
+  }
+  bool FindQueryParameter(const std::string& name,
+                          std::string* value) const override {
+    return false;
+  }
+  bool FindCookie(const std::string& name, std::string* value) const override {
+    return false;
+  }
+  bool GetJWTPayload(
+      std::map<std::string, std::string>* payload) const override {
+    return false;
+  }
+};
+
+class FakeHeaderUpdate : public HeaderUpdate {
+ public:
+  void RemoveIstioAttributes() override {}
+  void AddIstioAttributes(const std::string& data) override {}
+};
+
+class FakeReportData : public ReportData {
+ public:
+  std::map<std::string, std::string> GetResponseHeaders() const override {
+    return {{":status", "200"}, {"content-type", "text/html"}};
+  }
+  void GetReportInfo(ReportInfo* info) const override {
+    info->send_bytes = 4096;
+    info->received_bytes = 512;
+    info->duration = std::chrono::milliseconds(3);
+    info->response_code = 200;
+  }
+};
+
+// Runs the requests, prints the allocations and nanoseconds per request.
+void Run(int request_context_pool_size) {
+  HttpClientConfig config;
+  config.set_default_destination_service(":default");
+  auto* attributes =
+      (*config.mutable_service_configs())[":default"]
+          .mutable_mixer_attributes()
+          ->mutable_attributes();
+  (*attributes)["destination.service"].set_string_value(
+      "productpage.default.svc.cluster.local");
+  (*attributes)["destination.uid"].set_string_value(
+      "kubernetes://productpage-v1-6f7b9c7d5d-8xk2p.default");
+
+  Controller::Options options(config);
+  options.request_context_pool_size = request_context_pool_size;
+  // The check responses are cached, the reports are batched.
+  options.env.check_transport = [](const CheckRequest& request,
+                                   CheckResponse* response,
+                                   DoneFunc on_done) -> CancelFunc {
+    response->mutable_precondition()->set_valid_use_count(1000000);
+    response->mutable_precondition()->mutable_valid_duration()->set_seconds(
+        1000);
+    on_done(Status::OK);
+    return nullptr;
+  };
+  options.env.report_transport = [](const ReportRequest& request,
+                                    ReportResponse* response,
+                                    DoneFunc on_done) -> CancelFunc {
+    on_done(Status::OK);
+    return nullptr;
+  };
+  std::unique_ptr<Controller> controller = Controller::Create(options);
+
+  FakeCheckData check_data;
+  FakeHeaderUpdate header_update;
+  FakeReportData report_data;
+  Controller::PerRouteConfig per_route;
+  // Warms up the caches and the pool.
+  for (int i = 0; i < 100; ++i) {
+    auto handler = controller->CreateRequestHandler(per_route);
+    handler->Check(&check_data, &header_update, nullptr,
+                   [](const Status& status) {});
+    handler->Report(&report_data);
+  }
+
+  const int64_t start_allocations = num_allocations;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kNumRequests; ++i) {
+    auto handler = controller->CreateRequestHandler(per_route);
+    handler->Check(&check_data, &header_update, nullptr,
+                   [](const Status& status) {});
+    handler->Report(&report_data);
+  }
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+  printf("%8s %16.1f %16.1f\n",
+         request_context_pool_size > 0 ? "pooled" : "new",
+         static_cast<double>(num_allocations - start_allocations) /
+             kNumRequests,
+         elapsed.count() / kNumRequests);
+}
+
+}  // namespace
+}  // namespace http
+}  // namespace mixer_control
+}  // namespace istio
+
+int main(int argc, char** argv) {
+  using namespace ::istio::mixer_control::http;
+  printf("%8s %16s %16s\n", "context", "allocs/request", "ns/request");
+  Run(0);
+  Run(100);
+  return 0;
+}
@@ -28,18 +28,33 @@ namespace http {
 
 RequestHandlerImpl::RequestHandlerImpl(
     std::shared_ptr<ServiceContext> service_context)
-    : service_context_(service_context) {}
+    : request_context_(
+          service_context->client_context()->request_context_pool().Get()),
+      service_context_(service_context) {}
+
+RequestHandlerImpl::~RequestHandlerImpl() {
+  if (pending_check_) {
+    std::lock_guard<std::mutex> lock(pending_check_->mutex);
+    if (!pending_check_->done) {
+      // The Check callback still writes into the context.
+      pending_check_->request_context = std::move(request_context_);
+      return;
+    }
+  }
+  service_context_->client_context()->request_context_pool().Put(
+      std::move(request_context_));
+}
 
 void RequestHandlerImpl::ExtractRequestAttributes(CheckData* check_data) {
   if (service_context_->enable_mixer_check() ||
       service_context_->enable_mixer_report()) {
-    service_context_->AddStaticAttributes(&request_context_);
+    service_context_->AddStaticAttributes(request_context_.get());
 
-    AttributesBuilder builder(&request_context_);
+    AttributesBuilder builder(request_context_.get());
     builder.ExtractForwardedAttributes(check_data);
     builder.ExtractCheckAttributes(check_data);
 
-    service_context_->AddApiAttributes(check_data, &request_context_);
+    service_context_->AddApiAttributes(check_data, request_context_.get());
   }
 }
 
@@ -62,10 +77,32 @@ CancelFunc RequestHandlerImpl::Check(CheckData* check_data,
     return nullptr;
   }
 
-  service_context_->AddQuotas(&request_context_);
+  service_context_->AddQuotas(request_context_.get());
+
+  // The request context is returned to the pool by the callback if this
+  // handler is deleted first.
+  std::shared_ptr<PendingCheck> pending_check(new PendingCheck);
+  pending_check_ = pending_check;
+  std::shared_ptr<ServiceContext> service_context = service_context_;
+  DoneFunc check_done = [pending_check, service_context,
+                         on_done](const Status& status) {
+    on_done(status);
+    std::unique_ptr<RequestContext> request_context;
+    {
+      std::lock_guard<std::mutex> lock(pending_check->mutex);
+      pending_check->done = true;
+      request_context = std::move(pending_check->request_context);
+    }
+    if (request_context) {
+      service_context->client_context()->request_context_pool().Put(
+          std::move(request_context));
+    }
+  };
 
-  return service_context_->client_context()->SendCheck(transport, on_done,
-                                                       &request_context_);
+  // The attributes are only needed after Check for Report.
+  return service_context_->client_context()->SendCheck(
+      transport, check_done, request_context_.get(),
+      !service_context_->enable_mixer_report());
 }
 
 // Make remote report call.
@@ -73,10 +110,11 @@ void RequestHandlerImpl::Report(ReportData* report_data) {
   if (!service_context_->enable_mixer_report()) {
     return;
   }
-  AttributesBuilder builder(&request_context_);
+  AttributesBuilder builder(request_context_.get());
   builder.ExtractReportAttributes(report_data);
 
-  service_context_->client_context()->SendReport(request_context_);
+  // It is the last call of the request.
+  service_context_->client_context()->SendReport(std::move(*request_context_));
 }
 
 }  // namespace http
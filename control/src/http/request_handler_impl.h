@@ -21,6 +21,9 @@
 #include "control/src/request_context.h"
 #include "service_context.h"
 
+#include <memory>
+#include <mutex>
+
 namespace istio {
 namespace mixer_control {
 namespace http {
@@ -29,6 +32,9 @@ namespace http {
 class RequestHandlerImpl : public RequestHandler {
  public:
   RequestHandlerImpl(std::shared_ptr<ServiceContext> service_context);
+  // Returns the request context to the pool, or lets the pending Check
+  // call return it when it is done.
+  ~RequestHandlerImpl();
 
   // Makes a Check call.
   ::istio::mixer_client::CancelFunc Check(
@@ -42,8 +48,19 @@ class RequestHandlerImpl : public RequestHandler {
   void ExtractRequestAttributes(CheckData* check_data) override;
 
  private:
-  // The request context object.
-  RequestContext request_context_;
+  // A Check call, which uses the request context until it is done.
+  struct PendingCheck {
+    std::mutex mutex;
+    bool done = false;
+    // Set if the handler is deleted before the call is done.
+    std::unique_ptr<RequestContext> request_context;
+  };
+
+  // The request context object, from the pool of the client context.
+  std::unique_ptr<RequestContext> request_context_;
+
+  // The last Check call, null if none.
+  std::shared_ptr<PendingCheck> pending_check_;
 
   // The service context.
   std::shared_ptr<ServiceContext> service_context_;
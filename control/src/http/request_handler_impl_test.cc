@@ -390,6 +390,68 @@ TEST_F(RequestHandlerImplTest, TestHandlerReport) {
   handler->Report(&mock_data);
 }
 
+TEST_F(RequestHandlerImplTest, TestRequestContextReused) {
+  ::testing::NiceMock<MockCheckData> mock_check_data;
+  ::testing::NiceMock<MockReportData> mock_data;
+  std::vector<Attributes> reports;
+  EXPECT_CALL(*mock_client_, Report(_))
+      .WillRepeatedly(Invoke([&reports](const Attributes& attributes) {
+        reports.push_back(attributes);
+      }));
+
+  ServiceConfig config;
+  (*config.mutable_mixer_attributes()->mutable_attributes())["route-key"]
+      .set_string_value("route-value");
+  Controller::PerRouteConfig per_route;
+  ApplyPerRouteConfig(config, &per_route);
+  auto handler = controller_->CreateRequestHandler(per_route);
+  handler->ExtractRequestAttributes(&mock_check_data);
+  handler->Report(&mock_data);
+  EXPECT_EQ(client_context_->request_context_pool().size(), 0);
+  handler.reset();
+  EXPECT_EQ(client_context_->request_context_pool().size(), 1);
+
+  // The next request reuses the cleared context.
+  Controller::PerRouteConfig default_route;
+  handler = controller_->CreateRequestHandler(default_route);
+  EXPECT_EQ(client_context_->request_context_pool().size(), 0);
+  handler->ExtractRequestAttributes(&mock_check_data);
+  handler->Report(&mock_data);
+  ASSERT_EQ(reports.size(), 2);
+  EXPECT_EQ(reports[0].attributes().count("route-key"), 1);
+  EXPECT_EQ(reports[1].attributes().count("route-key"), 0);
+}
+
+TEST_F(RequestHandlerImplTest, TestRequestContextReturnedAfterCheck) {
+  ::testing::NiceMock<MockCheckData> mock_data;
+  ::testing::NiceMock<MockHeaderUpdate> mock_header;
+  DoneFunc check_done;
+  EXPECT_CALL(*mock_client_, Check(_, _, _, _))
+      .WillOnce(Invoke([&check_done](const Attributes& attributes,
+                                     const std::vector<Requirement>& quotas,
+                                     TransportCheckFunc transport,
+                                     DoneFunc on_done) -> CancelFunc {
+        check_done = on_done;
+        return nullptr;
+      }));
+
+  ServiceConfig config;
+  Controller::PerRouteConfig per_route;
+  ApplyPerRouteConfig(config, &per_route);
+  auto handler = controller_->CreateRequestHandler(per_route);
+  Status done_status = Status::UNKNOWN;
+  handler->Check(&mock_data, &mock_header, nullptr,
+                 [&done_status](Status status) { done_status = status; });
+
+  // The context is in use until the Check call is done.
+  handler.reset();
+  EXPECT_EQ(client_context_->request_context_pool().size(), 0);
+  ASSERT_TRUE(check_done != nullptr);
+  check_done(Status::OK);
+  EXPECT_TRUE(done_status.ok());
+  EXPECT_EQ(client_context_->request_context_pool().size(), 1);
+}
+
 TEST_F(RequestHandlerImplTest, TestHandlerDisabledReport) {
   ::testing::NiceMock<MockReportData> mock_data;
   EXPECT_CALL(mock_data, GetResponseHeaders()).Times(0);
@@ -29,6 +29,7 @@ ServiceContext::ServiceContext(std::shared_ptr<ClientContext> client_context,
     service_config_.reset(new ServiceConfig(*config));
   }
   BuildParsers();
+  BuildStaticAttributes();
 }
 
 void ServiceContext::BuildParsers() {
@@ -48,13 +49,24 @@ void ServiceContext::BuildParsers() {
   }
 }
 
-// Add static mixer attributes.
-void ServiceContext::AddStaticAttributes(RequestContext* request) const {
+void ServiceContext::BuildStaticAttributes() {
   if (client_context_->config().has_mixer_attributes()) {
-    request->attributes.MergeFrom(client_context_->config().mixer_attributes());
+    static_attributes_.MergeFrom(client_context_->config().mixer_attributes());
+  }
+  if (service_config_ && service_config_->has_mixer_attributes()) {
+    static_attributes_.MergeFrom(service_config_->mixer_attributes());
+  }
+  if (static_attributes_.attributes_size() > 0) {
+    compressed_static_attributes_ =
+        client_context_->CreateStaticAttributes(static_attributes_);
   }
-  if (service_config_->has_mixer_attributes()) {
-    request->attributes.MergeFrom(service_config_->mixer_attributes());
+}
+
+// Add static mixer attributes.
+void ServiceContext::AddStaticAttributes(RequestContext* request) const {
+  if (static_attributes_.attributes_size() > 0) {
+    request->attributes.MergeFrom(static_attributes_);
+    request->static_attributes = compressed_static_attributes_.get();
   }
 }
 
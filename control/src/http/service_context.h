@@ -57,6 +57,9 @@ class ServiceContext {
   // Pre-process the config data to build parser objects.
   void BuildParsers();
 
+  // Merges the static attributes of both configs, and compresses them.
+  void BuildStaticAttributes();
+
   // The client context object.
   std::shared_ptr<ClientContext> client_context_;
 
@@ -71,6 +74,11 @@ class ServiceContext {
   // The service config.
   std::unique_ptr<::istio::mixer::v1::config::client::ServiceConfig>
       service_config_;
+
+  // The mixer_attributes of the client config and the service config.
+  ::istio::mixer::v1::Attributes static_attributes_;
+  std::shared_ptr<const ::istio::mixer_client::StaticAttributes>
+      compressed_static_attributes_;
 };
 
 }  // namespace http
@@ -17,6 +17,7 @@
 #define MIXERCONTROL_REQUEST_CONTEXT_H
 
 #include "google/protobuf/stubs/status.h"
+#include "include/client.h"
 #include "mixer/v1/attributes.pb.h"
 #include "quota/include/requirement.h"
 
@@ -29,6 +30,9 @@ namespace mixer_control {
 struct RequestContext {
   // The attributes for both Check and Report.
   ::istio::mixer::v1::Attributes attributes;
+  // The compressed static attributes included in attributes, owned by the
+  // context adding them. Null if none.
+  const ::istio::mixer_client::StaticAttributes* static_attributes = nullptr;
   // The quota requirements
   std::vector<::istio::quota::Requirement> quotas;
   // The check status.
@@ -0,0 +1,55 @@
+/* Copyright 2018 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "control/src/request_context_pool.h"
+
+using ::google::protobuf::util::Status;
+
+namespace istio {
+namespace mixer_control {
+
+RequestContextPool::RequestContextPool(int max_size) : max_size_(max_size) {}
+
+std::unique_ptr<RequestContext> RequestContextPool::Get() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!contexts_.empty()) {
+      std::unique_ptr<RequestContext> context = std::move(contexts_.back());
+      contexts_.pop_back();
+      return context;
+    }
+  }
+  return std::unique_ptr<RequestContext>(new RequestContext);
+}
+
+void RequestContextPool::Put(std::unique_ptr<RequestContext> context) {
+  // Cleared outside of the lock, it frees the map entries.
+  context->attributes.Clear();
+  context->static_attributes = nullptr;
+  context->quotas.clear();
+  context->check_status = Status::OK;
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (static_cast<int>(contexts_.size()) < max_size_) {
+    contexts_.push_back(std::move(context));
+  }
+}
+
+int RequestContextPool::size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return contexts_.size();
+}
+
+}  // namespace mixer_control
+}  // namespace istio
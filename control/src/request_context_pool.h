@@ -0,0 +1,58 @@
+/* Copyright 2018 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIXERCONTROL_REQUEST_CONTEXT_POOL_H
+#define MIXERCONTROL_REQUEST_CONTEXT_POOL_H
+
+#include "control/src/request_context.h"
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace istio {
+namespace mixer_control {
+
+// A pool of request contexts to be reused by the requests of a client
+// context. A returned context is cleared, but its attributes map keeps its
+// hash table and its quota vector keeps its capacity, so a recycled
+// context doesn't need to grow them again. This class is thread safe.
+class RequestContextPool {
+ public:
+  // At most max_size contexts are kept in the pool.
+  explicit RequestContextPool(int max_size);
+
+  // Gets a context from the pool, or creates a new one if it is empty.
+  std::unique_ptr<RequestContext> Get();
+
+  // Clears the context and returns it to the pool.
+  void Put(std::unique_ptr<RequestContext> context);
+
+  // The number of contexts in the pool.
+  int size() const;
+
+ private:
+  const int max_size_;
+
+  mutable std::mutex mutex_;
+  std::vector<std::unique_ptr<RequestContext>> contexts_;
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(RequestContextPool);
+};
+
+}  // namespace mixer_control
+}  // namespace istio
+
+#endif  // MIXERCONTROL_REQUEST_CONTEXT_POOL_H
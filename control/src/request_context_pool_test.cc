@@ -0,0 +1,61 @@
+/* Copyright 2018 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "control/src/request_context_pool.h"
+
+#include "gtest/gtest.h"
+
+using ::google::protobuf::util::Status;
+using ::google::protobuf::util::error::Code;
+using ::istio::quota::Requirement;
+
+namespace istio {
+namespace mixer_control {
+namespace {
+
+TEST(RequestContextPoolTest, TestReuseContext) {
+  RequestContextPool pool(1);
+  std::unique_ptr<RequestContext> context = pool.Get();
+  RequestContext* raw_context = context.get();
+  (*context->attributes.mutable_attributes())["key"].set_string_value("v");
+  context->quotas.push_back(Requirement{"quota", 1});
+  context->check_status = Status(Code::UNAVAILABLE, "unavailable");
+
+  pool.Put(std::move(context));
+  EXPECT_EQ(pool.size(), 1);
+  context = pool.Get();
+  EXPECT_EQ(context.get(), raw_context);
+  EXPECT_EQ(pool.size(), 0);
+  // The context is cleared, the quota vector keeps its capacity.
+  EXPECT_EQ(context->attributes.attributes_size(), 0);
+  EXPECT_TRUE(context->quotas.empty());
+  EXPECT_GE(context->quotas.capacity(), 1);
+  EXPECT_TRUE(context->check_status.ok());
+  EXPECT_EQ(context->static_attributes, nullptr);
+}
+
+TEST(RequestContextPoolTest, TestMaxSize) {
+  RequestContextPool pool(1);
+  std::unique_ptr<RequestContext> context1 = pool.Get();
+  std::unique_ptr<RequestContext> context2 = pool.Get();
+  EXPECT_NE(context1.get(), context2.get());
+  pool.Put(std::move(context1));
+  pool.Put(std::move(context2));
+  EXPECT_EQ(pool.size(), 1);
+}
+
+}  // namespace
+}  // namespace mixer_control
+}  // namespace istio
@@ -34,6 +34,7 @@ class ClientContext : public ClientContextBase {
       : ClientContextBase(data.config.transport(), data.env),
         config_(data.config) {
     BuildQuotaParser();
+    BuildStaticAttributes();
   }
 
   // A constructor for unit-test to pass in a mock mixer_client
@@ -42,12 +43,14 @@ class ClientContext : public ClientContextBase {
       const ::istio::mixer::v1::config::client::TcpClientConfig& config)
       : ClientContextBase(std::move(mixer_client)), config_(config) {
     BuildQuotaParser();
+    BuildStaticAttributes();
   }
 
   // Add static mixer attributes.
   void AddStaticAttributes(RequestContext* request) const {
     if (config_.has_mixer_attributes()) {
       request->attributes.MergeFrom(config_.mixer_attributes());
+      request->static_attributes = compressed_static_attributes_.get();
     }
   }
 
@@ -69,9 +72,21 @@ class ClientContext : public ClientContextBase {
           ::istio::quota::ConfigParser::Create(config_.connection_quota_spec());
     }
   }
+  // Compresses the static mixer attributes once.
+  void BuildStaticAttributes() {
+    if (config_.has_mixer_attributes()) {
+      compressed_static_attributes_ =
+          CreateStaticAttributes(config_.mixer_attributes());
+    }
+  }
+
   // The mixer client config.
   const ::istio::mixer::v1::config::client::TcpClientConfig& config_;
 
+  // The compressed mixer_attributes of the config.
+  std::shared_ptr<const ::istio::mixer_client::StaticAttributes>
+      compressed_static_attributes_;
+
   // The quota parser.
   std::unique_ptr<::istio::quota::ConfigParser> quota_parser_;
 };
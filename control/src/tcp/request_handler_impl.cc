@@ -46,7 +46,9 @@ CancelFunc RequestHandlerImpl::Check(CheckData* check_data, DoneFunc on_done) {
 
   client_context_->AddQuotas(&request_context_);
 
-  return client_context_->SendCheck(nullptr, on_done, &request_context_);
+  // The attributes are only needed after Check for Report.
+  return client_context_->SendCheck(nullptr, on_done, &request_context_,
+                                    !client_context_->enable_mixer_report());
 }
 
 // Make remote report call.
@@ -63,7 +65,11 @@ void RequestHandlerImpl::Report(ReportData* report_data, bool is_final_report) {
   builder.ExtractReportAttributes(report_data, is_final_report,
                                   &last_report_info_);
 
-  client_context_->SendReport(request_context_);
+  if (is_final_report) {
+    client_context_->SendReport(std::move(request_context_));
+  } else {
+    client_context_->SendReport(request_context_);
+  }
 }
 
 }  // namespace tcp
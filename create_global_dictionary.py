@@ -33,6 +33,9 @@ TOP = r"""/* Copyright 2017 Istio Authors. All Rights Reserved.
 
 #include "src/global_dictionary.h"
 
+#include <stdint.h>
+#include <string.h>
+
 namespace istio {
 namespace mixer_client {
 namespace {
@@ -49,21 +52,246 @@ namespace {
 const std::vector<std::string> kGlobalWords{
 """
 
-BOTTOM = r"""};
+MIDDLE = r"""};
+
+// A minimal perfect hash of the words. The high bits of the hash of a word
+// pick a seed, and the low bits mixed with the seed pick its slot.
+constexpr uint32_t kNumSlots = %d;
+constexpr size_t kMaxWordSize = %d;
+
+constexpr uint32_t kSeeds[] = {
+%s};
+
+// The index of the word in each slot.
+constexpr uint32_t kSlotWords[] = {
+%s};
+
+// The words and their offsets in one array, compared without the
+// indirection of kGlobalWords.
+constexpr char kWordData[] =
+%s;
+constexpr uint32_t kWordOffsets[] = {
+%s};
+
+// Loads bytes in little endian order, as the generator does.
+inline uint64_t Load64(const char* data) {
+  uint64_t value;
+  memcpy(&value, data, sizeof(value));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  value = __builtin_bswap64(value);
+#endif
+  return value;
+}
+
+inline uint64_t Load32(const char* data) {
+  uint32_t value;
+  memcpy(&value, data, sizeof(value));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  value = __builtin_bswap32(value);
+#endif
+  return value;
+}
+
+inline uint64_t Load8(const char* data) {
+  return static_cast<unsigned char>(*data);
+}
+
+inline uint64_t HashChunk(uint64_t hash, uint64_t chunk) {
+  hash = (hash ^ chunk) * 0x9e3779b97f4a7c15ull;
+  return hash ^ (hash >> 29);
+}
+
+// Hashes 8 bytes at a time. The last chunk overlaps the one before it,
+// a short word is loaded as one chunk, so there is no loop over its bytes.
+// The size is hashed as a chunk of its own, since a short chunk may use
+// any of the bits.
+inline uint64_t Hash(const char* data, size_t size) {
+  uint64_t hash = 0xcbf29ce484222325ull;
+  if (size > 8) {
+    const char* last = data + size - 8;
+    for (; data < last; data += 8) {
+      hash = HashChunk(hash, Load64(data));
+    }
+    hash = HashChunk(hash, Load64(last));
+  } else {
+    uint64_t chunk = 0;
+    if (size >= 4) {
+      chunk = Load32(data) << 32 | Load32(data + size - 4);
+    } else if (size > 0) {
+      chunk = Load8(data) << 16 | Load8(data + size / 2) << 8 |
+              Load8(data + size - 1);
+    }
+    hash = HashChunk(hash, chunk);
+  }
+  return HashChunk(hash, size);
+}
+
+// The finalizer of MurmurHash3.
+inline uint32_t Mix(uint32_t hash) {
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6bu;
+  hash ^= hash >> 13;
+  hash *= 0xc2b2ae35u;
+  hash ^= hash >> 16;
+  return hash;
+}
+
+// Maps a 32 bit hash to a slot with a multiplication instead of a modulo.
+inline uint32_t Reduce(uint64_t hash) { return (hash * kNumSlots) >> 32; }
 
 }  // namespace
 
 const std::vector<std::string>& GetGlobalWords() { return kGlobalWords; }
 
+int GetGlobalWordIndex(const std::string& word) {
+  // Also rejects most string values without hashing them.
+  if (kNumSlots == 0 || word.size() > kMaxWordSize) {
+    return -1;
+  }
+  uint64_t hash = Hash(word.data(), word.size());
+  uint32_t seed = kSeeds[Reduce(hash >> 32)];
+  uint32_t slot = Reduce(Mix(static_cast<uint32_t>(hash) + seed));
+  uint32_t index = kSlotWords[slot];
+  if (kWordOffsets[index + 1] - kWordOffsets[index] != word.size() ||
+      memcmp(kWordData + kWordOffsets[index], word.data(), word.size()) != 0) {
+    return -1;
+  }
+  return index;
+}
+
 }  // namespace mixer_client
 }  // namespace istio"""
 
-all_words = ''
+MASK32 = 0xFFFFFFFF
+MASK64 = 0xFFFFFFFFFFFFFFFF
+
+
+def load(data, offset, size):
+    """Loads size bytes in little endian order."""
+    value = 0
+    for i in range(size):
+        value |= data[offset + i] << (8 * i)
+    return value
+
+
+def hash_chunk(h, chunk):
+    h = ((h ^ chunk) * 0x9e3779b97f4a7c15) & MASK64
+    return h ^ (h >> 29)
+
+
+def word_hash(word):
+    """Hash() of the generated code."""
+    data = bytearray(word.encode('utf-8'))
+    size = len(data)
+    h = 0xcbf29ce484222325
+    if size > 8:
+        offset = 0
+        while offset < size - 8:
+            h = hash_chunk(h, load(data, offset, 8))
+            offset += 8
+        h = hash_chunk(h, load(data, size - 8, 8))
+    else:
+        chunk = 0
+        if size >= 4:
+            chunk = load(data, 0, 4) << 32 | load(data, size - 4, 4)
+        elif size > 0:
+            chunk = data[0] << 16 | data[size // 2] << 8 | data[size - 1]
+        h = hash_chunk(h, chunk)
+    return hash_chunk(h, size)
+
+
+def mix(h):
+    """Mix() of the generated code."""
+    h ^= h >> 16
+    h = (h * 0x85ebca6b) & MASK32
+    h ^= h >> 13
+    h = (h * 0xc2b2ae35) & MASK32
+    h ^= h >> 16
+    return h
+
+
+def reduce_hash(h, n):
+    """Reduce() of the generated code."""
+    return (h * n) >> 32
+
+
+# The seed search gives up after this many seeds of a bucket.
+MAX_SEEDS = 1 << 24
+
+
+def perfect_hash(words):
+    """Returns the seeds and slot word indexes of a minimal perfect hash,
+    found by hash and displace. A repeated word maps to its last index."""
+    index = {}
+    for i, word in enumerate(words):
+        index[word] = i
+    n = max(len(index), 1)
+    buckets = [[] for _ in range(n)]
+    for word in index:
+        buckets[reduce_hash(word_hash(word) >> 32, n)].append(word)
+    seeds = [0] * n
+    slots = [None] * n
+    # The largest buckets are placed first, while most slots are free.
+    for b in sorted(range(n), key=lambda b: -len(buckets[b])):
+        if not buckets[b]:
+            break
+        # Words of a bucket with the same low hash bits get the same slot
+        # with any seed.
+        low_bits = {}
+        for word in buckets[b]:
+            other = low_bits.setdefault(word_hash(word) & MASK32, word)
+            if other != word:
+                sys.exit('Words "%s" and "%s" have colliding hashes, '
+                         'change Hash() to build the dictionary.' %
+                         (other, word))
+        seed = 0
+        while True:
+            placed = set(
+                reduce_hash(mix((word_hash(word) + seed) & MASK32), n)
+                for word in buckets[b])
+            if len(placed) == len(buckets[b]) and all(
+                    slots[slot] is None for slot in placed):
+                break
+            seed += 1
+            if seed == MAX_SEEDS:
+                sys.exit('No perfect hash seed found for words: ' +
+                         ', '.join(buckets[b]))
+        seeds[b] = seed
+        for word in buckets[b]:
+            slot = reduce_hash(mix((word_hash(word) + seed) & MASK32), n)
+            slots[slot] = index[word]
+    return seeds, slots
+
+
+def format_table(values):
+    lines = ''
+    for i in range(0, len(values), 8):
+        lines += '    ' + ', '.join(
+            '%du' % v for v in values[i:i + 8]) + ',\n'
+    return lines
+
+
+words = []
 with open(sys.argv[1]) as src_file:
     for line in src_file:
         if line.startswith("-"):
-            all_words += "    \"" + line[1:].strip() + "\",\n"
-
-print TOP + all_words + BOTTOM
+            words.append(line[1:].strip())
 
+all_words = ''
+for word in words:
+    all_words += "    \"" + word + "\",\n"
 
+seeds, slots = perfect_hash(words)
+num_slots = len(slots) if words else 0
+# An empty table still needs a slot, never used.
+slots = [slot or 0 for slot in slots]
+max_word_size = max([len(bytearray(word.encode('utf-8'))) for word in words] +
+                    [0])
+word_data = ''.join('    "%s"\n' % word for word in words) or '    ""\n'
+offsets = [0]
+for word in words:
+    offsets.append(offsets[-1] + len(bytearray(word.encode('utf-8'))))
+print(TOP + all_words + MIDDLE % (num_slots, max_word_size,
+                                  format_table(seeds), format_table(slots),
+                                  word_data.rstrip('\n'),
+                                  format_table(offsets)))
@@ -20,6 +20,7 @@
 #include "options.h"
 #include "quota/include/requirement.h"
 
+#include <memory>
 #include <vector>
 
 namespace istio {
@@ -46,6 +47,9 @@ struct MixerClientOptions {
   QuotaOptions quota_options;
   // The environment functions.
   Environment env;
+  // If not empty, the check cache is restored at creation from this
+  // snapshot file, written by MixerClient::SaveSnapshot() before a restart.
+  std::string snapshot_path;
 };
 
 // The statistics recorded by mixerclient library.
@@ -56,6 +60,18 @@ struct Statistics {
   uint64_t total_remote_check_calls;
   // Total number of remote check calls that blocking origin requests.
   uint64_t total_blocking_remote_check_calls;
+  // Total number of check cache lookups with learned referenced attributes.
+  uint64_t total_check_cache_lookups;
+  // Total number of referenced attribute sets evaluated by those lookups.
+  // Divided by total_check_cache_lookups, it is the average number of
+  // cache keys calculated per lookup.
+  uint64_t total_check_cache_referenced_evaluated;
+  // Total number of check calls attached to an in-flight remote check call
+  // for the same cache signature, instead of making their own.
+  uint64_t total_coalesced_check_calls;
+  // Total number of non-blocking remote check calls sent to refresh
+  // cache entries ahead of their expiration.
+  uint64_t total_refresh_remote_check_calls;
 
   // Total number of quota calls.
   uint64_t total_quota_calls;
@@ -68,6 +84,49 @@ struct Statistics {
   uint64_t total_report_calls;
   // Total number of remote report calls.
   uint64_t total_remote_report_calls;
+  // Total number of reports sent by remote report calls. Divided by
+  // total_remote_report_calls, it is the average number of entries per batch.
+  uint64_t total_remote_report_entries;
+  // Total encoded bytes of remote report requests.
+  uint64_t total_remote_report_bytes;
+  // Number of remote report calls by the reason the batch was sent: it
+  // reached max_batch_entries, max_batch_bytes or max_batch_time_ms, a new
+  // report could not be delta encoded into it, or it was flushed explicitly.
+  uint64_t total_report_flushes_by_entries;
+  uint64_t total_report_flushes_by_bytes;
+  uint64_t total_report_flushes_by_time;
+  uint64_t total_report_flushes_by_delta_update;
+  uint64_t total_report_flushes_by_request;
+  // Total number of report batches, and reports in them, dropped or
+  // cancelled because of the in-flight limits of ReportOptions.
+  uint64_t total_dropped_report_batches;
+  uint64_t total_dropped_report_entries;
+  // Total number of failed report batches kept in the spool file, sent
+  // again from it, and dropped from it to make room.
+  uint64_t total_spooled_report_batches;
+  uint64_t total_replayed_report_batches;
+  uint64_t total_spool_dropped_report_batches;
+  // Total number of reports merged into the report of their group, with
+  // ReportOptions::aggregate_reports.
+  uint64_t total_aggregated_reports;
+  // Total number of report batches encoded with a global dictionary the
+  // server does not have, encoded again with the shrunk one and resent.
+  uint64_t total_reencoded_report_batches;
+  // Total bytes saved by ReportOptions::learned_dictionary_size, negative
+  // if the learned words cost more than they saved.
+  int64_t learned_dictionary_bytes_saved;
+  // The current maximum batch time and size of reports, tuned with
+  // ReportOptions::adaptive_flush.
+  uint64_t report_batch_time_ms;
+  uint64_t report_batch_entries;
+};
+
+// Static attributes included in many calls, such as the mixer_attributes
+// of a service config, compressed once by
+// MixerClient::CreateStaticAttributes().
+class StaticAttributes {
+ public:
+  virtual ~StaticAttributes() {}
 };
 
 class MixerClient {
@@ -89,11 +148,64 @@ class MixerClient {
       const std::vector<::istio::quota::Requirement>& quotas,
       TransportCheckFunc transport, DoneFunc on_done) = 0;
 
+  // A check call taking the ownership of the attributes. The client moves
+  // them into the remote call instead of copying them; the attributes are
+  // left in an unspecified state.
+  virtual CancelFunc Check(
+      ::istio::mixer::v1::Attributes&& attributes,
+      const std::vector<::istio::quota::Requirement>& quotas,
+      TransportCheckFunc transport, DoneFunc on_done) {
+    const ::istio::mixer::v1::Attributes& const_attributes = attributes;
+    return Check(const_attributes, quotas, transport, on_done);
+  }
+
+  // Compresses static attributes once. The check calls passing them only
+  // compress the other attributes if the check transport takes serialized
+  // requests, see Environment::raw_check_transport. Returns null if not
+  // supported.
+  virtual std::shared_ptr<const StaticAttributes> CreateStaticAttributes(
+      const ::istio::mixer::v1::Attributes& attributes) {
+    return nullptr;
+  }
+
+  // Check calls whose attributes include static_attributes, created by
+  // CreateStaticAttributes() of this client. static_attributes may be null.
+  virtual CancelFunc Check(
+      const StaticAttributes* static_attributes,
+      const ::istio::mixer::v1::Attributes& attributes,
+      const std::vector<::istio::quota::Requirement>& quotas,
+      TransportCheckFunc transport, DoneFunc on_done) {
+    return Check(attributes, quotas, transport, on_done);
+  }
+  virtual CancelFunc Check(
+      const StaticAttributes* static_attributes,
+      ::istio::mixer::v1::Attributes&& attributes,
+      const std::vector<::istio::quota::Requirement>& quotas,
+      TransportCheckFunc transport, DoneFunc on_done) {
+    return Check(std::move(attributes), quotas, transport, on_done);
+  }
+
   // A report call.
   virtual void Report(const ::istio::mixer::v1::Attributes& attributes) = 0;
 
+  // A report call taking the ownership of the attributes.
+  virtual void Report(::istio::mixer::v1::Attributes&& attributes) {
+    const ::istio::mixer::v1::Attributes& const_attributes = attributes;
+    Report(const_attributes);
+  }
+
   // Get statistics.
   virtual void GetStatistics(Statistics* stat) const = 0;
+
+  // Writes the learned check cache keys and the unexpired check cache
+  // entries into a snapshot file, to warm start a new client with
+  // MixerClientOptions::snapshot_path. Not supported by default.
+  virtual ::google::protobuf::util::Status SaveSnapshot(
+      const std::string& path) {
+    return ::google::protobuf::util::Status(
+        ::google::protobuf::util::error::UNIMPLEMENTED,
+        "SaveSnapshot is not supported");
+  }
 };
 
 // Creates a MixerClient object.
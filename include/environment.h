@@ -41,9 +41,21 @@ using TransportReportFunc = std::function<CancelFunc(
     const ::istio::mixer::v1::ReportRequest& request,
     ::istio::mixer::v1::ReportResponse* response, DoneFunc on_done)>;
 
+// Defines function prototypes to make the asynchronous Check and Report
+// calls with serialized requests, for transports which send bytes as is.
+using TransportRawCheckFunc = std::function<CancelFunc(
+    const std::string& serialized_request,
+    ::istio::mixer::v1::CheckResponse* response, DoneFunc on_done)>;
+using TransportRawReportFunc = std::function<CancelFunc(
+    const std::string& serialized_request,
+    ::istio::mixer::v1::ReportResponse* response, DoneFunc on_done)>;
+
 // Defines a function prototype to generate an UUID
 using UUIDGenerateFunc = std::function<std::string()>;
 
+// Defines a function prototype to run a task asynchronously.
+using ExecutorFunc = std::function<void(std::function<void()> task)>;
+
 // Store functions provided by the Environments, such as
 // * transport function to make remote Check and Report calls
 // * timer function to create a timer
@@ -52,6 +64,13 @@ struct Environment {
   TransportCheckFunc check_transport;
   TransportReportFunc report_transport;
 
+  // Optional transport functions taking serialized requests. If set, they
+  // are used instead of the ones above, and the requests are encoded
+  // directly without building the messages. A transport passed to
+  // MixerClient::Check() still takes the CheckRequest.
+  TransportRawCheckFunc raw_check_transport;
+  TransportRawReportFunc raw_report_transport;
+
   // Timer create function.
   // Usually there are some restrictions on timer_create_func.
   // Don't call it at program start, or init time, it is not ready.
@@ -61,6 +80,11 @@ struct Environment {
   // UUID generating function
   UUIDGenerateFunc uuid_generate_func;
 
+  // Executor to compress and send reports with ReportOptions::async_report.
+  // Tasks may call the report transport and create timers, so it should
+  // run them on a thread where both are allowed.
+  ExecutorFunc report_executor;
+
   // TODO: Add logging function here.
 };
 
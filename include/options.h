@@ -16,13 +16,23 @@
 #ifndef MIXERCLIENT_OPTIONS_H
 #define MIXERCLIENT_OPTIONS_H
 
+#include <stddef.h>
 #include <memory>
 #include <set>
+#include <string>
 #include <vector>
 
 namespace istio {
 namespace mixer_client {
 
+// The hash function to calculate cache keys from attributes.
+enum class CacheKeyHash {
+  // A fast non-cryptographic 128 bit hash, seeded randomly for each cache.
+  FAST,
+  // MD5 digest.
+  MD5,
+};
+
 // Options controlling check behavior.
 struct CheckOptions {
   // Default constructor.
@@ -40,6 +50,38 @@ struct CheckOptions {
 
   // If true, Check is passed for any network failures.
   bool network_fail_open = true;
+
+  // Number of cache shards. Each shard has its own lock and an equal share
+  // of num_entries, so lookups from different threads for different
+  // signatures don't contend on one lock. It is capped by num_entries.
+  int num_shards = 16;
+
+  // The hash function to calculate cache keys.
+  CacheKeyHash cache_key_hash = CacheKeyHash::FAST;
+
+  // If true, concurrent cache misses for the same cache signature share one
+  // remote Check call and are all completed by its response. Only checks
+  // without quota requirements are coalesced.
+  bool coalesce_misses = true;
+
+  // If greater than 0, a cache entry is refreshed ahead of its expiration:
+  // once the remaining fraction of its valid duration or valid use count
+  // drops to this value, the cached status is still used, and one remote
+  // Check is sent in background to refresh it. For example, 0.1 refreshes
+  // an entry in the last 10% of its lifetime. 0 disables it.
+  double refresh_ahead_fraction = 0;
+};
+
+// What to do with a new report batch when the in-flight limits of
+// ReportOptions are reached.
+enum class ReportDropPolicy {
+  // Drops the new batch.
+  DROP_NEWEST,
+  // Cancels the oldest in-flight batches to make room for the new one.
+  DROP_OLDEST,
+  // Sends one in every drop_sample_interval new batches like DROP_OLDEST,
+  // and drops the others, so Mixer keeps seeing a sample of recent traffic.
+  SAMPLE,
 };
 
 // Options controlling report batch.
@@ -58,6 +100,82 @@ struct ReportOptions {
 
   // Maximum milliseconds a report item stayed in the buffer for batching.
   const int max_batch_time_ms;
+
+  // A batch is sent once its encoded size reaches this many bytes, so it
+  // exceeds the budget by at most one report. 0 disables the limit.
+  size_t max_batch_bytes = 1024 * 1024;
+
+  // Reports in a batch are delta encoded, each only has the attributes
+  // changed from the one before it. Removed attributes can't be encoded,
+  // so a report lacking attributes of the batch starts another delta
+  // chain, sent as a separate request with the batch. Once a report fits
+  // none of max_delta_chains chains, the batch is sent.
+  int max_delta_chains = 4;
+
+  // If true, the batch time and size are tuned from the observed report
+  // rate and transport round trip time. A batch is sent once it is expected
+  // to hold target_batch_bytes, but its first report waits at most
+  // max_batch_time_ms including the round trip. Reports too rare to be
+  // batched within that time are sent quickly. max_batch_entries is only
+  // used until the first batches are measured.
+  bool adaptive_flush = false;
+  size_t target_batch_bytes = 64 * 1024;
+
+  // Maximum number of report requests waiting for responses, and their
+  // maximum total encoded bytes. 0 disables the limit. A batch over the
+  // limits is handled by drop_policy.
+  int max_inflight_requests = 0;
+  size_t max_inflight_bytes = 0;
+  ReportDropPolicy drop_policy = ReportDropPolicy::DROP_NEWEST;
+  // Used by ReportDropPolicy::SAMPLE.
+  int drop_sample_interval = 10;
+
+  // If not empty, report requests failed by the transport are kept in a
+  // ring file of spool_bytes at this path, and sent again once a report
+  // request succeeds, or once the retry time below passed. The latter
+  // needs a timer, or async_report without an executor. The oldest ones
+  // are dropped when the file is full.
+  std::string spool_path;
+  size_t spool_bytes = 64 * 1024 * 1024;
+  // Milliseconds to wait after a failed request or replay, doubled up to
+  // the maximum after each failed replay.
+  int spool_retry_min_ms = 1000;
+  int spool_retry_max_ms = 60000;
+
+  // If true, the reports of a batch are merged by group before they are
+  // compressed, and the batch holds one report per group. Reports are in
+  // the same group if they have the same aggregate_keys attributes, or if
+  // aggregate_keys is empty, the same attributes except the summed ones.
+  // The int64, double and duration attributes in aggregate_sum_attributes
+  // are summed over the group, other attributes are taken from its first
+  // report. max_batch_entries limits the number of groups.
+  bool aggregate_reports = false;
+  std::vector<std::string> aggregate_keys;
+  std::vector<std::string> aggregate_sum_attributes;
+  // If not empty, this int64 attribute is set to the number of reports
+  // merged into a group.
+  std::string aggregate_count_attribute;
+
+  // If positive, up to this many reports are buffered before they are
+  // compressed, and ordered so the reports with the same report_order_keys
+  // attributes are next to each other. Delta encoding then compares each
+  // report with a similar one, instead of the one which happened to come
+  // before it. The order of the reports in a batch is changed. With
+  // aggregate_reports, the merged reports are ordered instead.
+  int report_order_window = 0;
+  std::vector<std::string> report_order_keys = {"destination.service",
+                                                "request.path"};
+
+  // If positive, up to this many words, not in the global dictionary but
+  // used by most batches, are learned from the sent batches. They come
+  // first in the per message dictionary of a batch, so their references
+  // are encoded in one byte. At most 64 words are learned.
+  int learned_dictionary_size = 0;
+
+  // If true, Report() only queues the attributes. They are compressed and
+  // sent in background, by Environment::report_executor if it is set, or
+  // by a dedicated thread otherwise.
+  bool async_report = false;
 };
 
 // Options controlling quota behavior.
@@ -78,6 +196,9 @@ struct QuotaOptions {
 
   // Maximum milliseconds before an idle cached quota should be deleted.
   const int expiration_ms;
+
+  // The hash function to calculate cache keys.
+  CacheKeyHash cache_key_hash = CacheKeyHash::FAST;
 };
 
 }  // namespace mixer_client
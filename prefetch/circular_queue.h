@@ -38,8 +38,10 @@ class CircularQueue {
   // Allow modifying the head item.
   T* Head();
 
-  // Calls the fn function for each element from head to tail.
-  void Iterate(std::function<bool(T&)> fn);
+  // Calls the fn function for each element from head to tail, until it
+  // returns false. fn is not wrapped in a std::function, not to allocate.
+  template <class Fn>
+  void Iterate(Fn fn);
 
  private:
   std::vector<T> nodes_;
@@ -82,7 +84,8 @@ T* CircularQueue<T>::Head() {
 }
 
 template <class T>
-void CircularQueue<T>::Iterate(std::function<bool(T&)> fn) {
+template <class Fn>
+void CircularQueue<T>::Iterate(Fn fn) {
   if (count_ == 0) return;
   int i = head_;
   while (i != tail_) {
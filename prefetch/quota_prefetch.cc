@@ -30,12 +30,18 @@ using namespace std::chrono;
             << duration_cast<milliseconds>(t.time_since_epoch()).count() \
             << "):"
 #else
-// Pipe to stringstream to disable logging.
-#include <sstream>
-std::ostringstream os;
-#define LOG(t) \
-  os.clear();  \
-  os
+// Discards the log without formatting it, so no memory is allocated.
+#include <ostream>
+namespace {
+struct NullLog {
+  template <class T>
+  NullLog& operator<<(const T&) {
+    return *this;
+  }
+  NullLog& operator<<(std::ostream& (*)(std::ostream&)) { return *this; }
+};
+}  // namespace
+#define LOG(t) NullLog()
 #endif
 
 namespace istio {
@@ -0,0 +1,70 @@
+/* Copyright 2018 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/arena_pool.h"
+
+using ::google::protobuf::Arena;
+using ::google::protobuf::ArenaOptions;
+
+namespace istio {
+namespace mixer_client {
+namespace {
+
+ArenaOptions CreateArenaOptions(char* block, size_t block_size) {
+  ArenaOptions options;
+  options.initial_block = block;
+  options.initial_block_size = block_size;
+  // Blocks allocated after the initial block are freed by Reset().
+  options.start_block_size = block_size;
+  return options;
+}
+
+}  // namespace
+
+PooledArena::PooledArena(size_t block_size)
+    : block_(new char[block_size]),
+      arena_(CreateArenaOptions(block_.get(), block_size)) {}
+
+ArenaPool::ArenaPool(int max_size, size_t block_size)
+    : max_size_(max_size), block_size_(block_size) {}
+
+std::unique_ptr<PooledArena> ArenaPool::Get() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!arenas_.empty()) {
+      std::unique_ptr<PooledArena> arena = std::move(arenas_.back());
+      arenas_.pop_back();
+      return arena;
+    }
+  }
+  return std::unique_ptr<PooledArena>(new PooledArena(block_size_));
+}
+
+void ArenaPool::Put(std::unique_ptr<PooledArena> arena) {
+  // Reset outside of the lock, it runs the destructors.
+  arena->arena()->Reset();
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (static_cast<int>(arenas_.size()) < max_size_) {
+    arenas_.push_back(std::move(arena));
+  }
+}
+
+int ArenaPool::size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return arenas_.size();
+}
+
+}  // namespace mixer_client
+}  // namespace istio
@@ -0,0 +1,74 @@
+/* Copyright 2018 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIXERCLIENT_ARENA_POOL_H
+#define MIXERCLIENT_ARENA_POOL_H
+
+#include "google/protobuf/arena.h"
+#include "google/protobuf/stubs/common.h"
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace istio {
+namespace mixer_client {
+
+// An arena with its own initial block. The block is kept when the arena
+// is reset, so a recycled arena doesn't need to allocate it again.
+class PooledArena {
+ public:
+  explicit PooledArena(size_t block_size);
+
+  google::protobuf::Arena* arena() { return &arena_; }
+
+ private:
+  std::unique_ptr<char[]> block_;
+  google::protobuf::Arena arena_;
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(PooledArena);
+};
+
+// A pool of arenas to be reused by remote calls. This class is thread safe.
+class ArenaPool {
+ public:
+  // At most max_size arenas are kept in the pool. Each arena has an
+  // initial block of block_size bytes.
+  ArenaPool(int max_size, size_t block_size);
+
+  // Gets an arena from the pool, or creates a new one if it is empty.
+  std::unique_ptr<PooledArena> Get();
+
+  // Resets the arena and returns it to the pool. All objects allocated
+  // from the arena are destroyed.
+  void Put(std::unique_ptr<PooledArena> arena);
+
+  // The number of arenas in the pool.
+  int size() const;
+
+ private:
+  const int max_size_;
+  const size_t block_size_;
+
+  mutable std::mutex mutex_;
+  std::vector<std::unique_ptr<PooledArena>> arenas_;
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(ArenaPool);
+};
+
+}  // namespace mixer_client
+}  // namespace istio
+
+#endif  // MIXERCLIENT_ARENA_POOL_H
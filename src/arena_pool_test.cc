@@ -0,0 +1,73 @@
+/* Copyright 2018 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/arena_pool.h"
+
+#include "gtest/gtest.h"
+#include "mixer/v1/check.pb.h"
+
+using ::google::protobuf::Arena;
+using ::istio::mixer::v1::CheckRequest;
+
+namespace istio {
+namespace mixer_client {
+namespace {
+
+// Sets a flag when destroyed.
+struct Destroyed {
+  explicit Destroyed(bool* flag) : flag(flag) {}
+  ~Destroyed() { *flag = true; }
+  bool* flag;
+};
+
+TEST(ArenaPoolTest, TestReuseArena) {
+  ArenaPool pool(1, 1024);
+  std::unique_ptr<PooledArena> arena = pool.Get();
+  PooledArena* raw_arena = arena.get();
+  CheckRequest* request = Arena::Create<CheckRequest>(arena->arena());
+  request->set_deduplication_id("id");
+
+  pool.Put(std::move(arena));
+  EXPECT_EQ(pool.size(), 1);
+  arena = pool.Get();
+  EXPECT_EQ(arena.get(), raw_arena);
+  EXPECT_EQ(pool.size(), 0);
+  // The arena is reset.
+  EXPECT_EQ(arena->arena()->SpaceUsed(), 0);
+}
+
+TEST(ArenaPoolTest, TestMaxSize) {
+  ArenaPool pool(1, 1024);
+  std::unique_ptr<PooledArena> arena1 = pool.Get();
+  std::unique_ptr<PooledArena> arena2 = pool.Get();
+  EXPECT_NE(arena1.get(), arena2.get());
+  pool.Put(std::move(arena1));
+  pool.Put(std::move(arena2));
+  EXPECT_EQ(pool.size(), 1);
+}
+
+TEST(ArenaPoolTest, TestDestroyObjects) {
+  ArenaPool pool(1, 1024);
+  std::unique_ptr<PooledArena> arena = pool.Get();
+  bool destroyed = false;
+  Arena::Create<Destroyed>(arena->arena(), &destroyed);
+  EXPECT_FALSE(destroyed);
+  pool.Put(std::move(arena));
+  EXPECT_TRUE(destroyed);
+}
+
+}  // namespace
+}  // namespace mixer_client
+}  // namespace istio
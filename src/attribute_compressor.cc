@@ -18,53 +18,179 @@
 #include "global_dictionary.h"
 #include "utils/protobuf.h"
 
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
+#include "google/protobuf/wire_format_lite.h"
+
+#include <unordered_map>
+#include <unordered_set>
+
 using ::istio::mixer::v1::Attributes;
 using ::istio::mixer::v1::Attributes_AttributeValue;
 using ::istio::mixer::v1::Attributes_StringMap;
 using ::istio::mixer::v1::CompressedAttributes;
+using ::google::protobuf::internal::WireFormatLite;
+using ::google::protobuf::StringPiece;
+using ::google::protobuf::io::CodedOutputStream;
+using ::google::protobuf::io::StringOutputStream;
 
 namespace istio {
 namespace mixer_client {
 namespace {
 
+typedef ::google::protobuf::RepeatedPtrField<std::string> WordList;
+
 // The size of first version of global dictionary.
 // If any dictionary error, global dictionary will fall back to this version.
 const int kGlobalDictionaryBaseSize = 111;
 
+// The maximum size of a one byte tag and a varint32.
+const int kMaxFieldHeaderSize = 6;
+
 // Return per message dictionary index.
 int MessageDictIndex(int idx) { return -(idx + 1); }
 
-// Per message dictionary.
+// The encoded size of a length delimited field with a one byte tag.
+size_t LengthDelimitedFieldSize(size_t size) {
+  return 1 + CodedOutputStream::VarintSize32(size) + size;
+}
+
+// The encoded size of a per message dictionary index.
+int MessageDictIndexSize(int idx) {
+  return CodedOutputStream::VarintSize32(
+      WireFormatLite::ZigZagEncode32(MessageDictIndex(idx)));
+}
+
+// Hashes a StringPiece with FNV-1a.
+struct StringPieceHash {
+  size_t operator()(StringPiece str) const {
+    uint64_t hash = 14695981039346656037ULL;
+    for (StringPiece::size_type i = 0; i < str.size(); ++i) {
+      hash = (hash ^ static_cast<unsigned char>(str[i])) * 1099511628211ULL;
+    }
+    return static_cast<size_t>(hash);
+  }
+};
+
+// Per message dictionary. Each new word is copied once, directly into the
+// words field of the outgoing message, and looked up by a StringPiece over
+// that copy. The strings of a RepeatedPtrField don't move when it grows.
 class MessageDictionary {
  public:
-  MessageDictionary(const GlobalDictionary& global_dict)
-      : global_dict_(global_dict) {}
+  MessageDictionary(const GlobalDictionary& global_dict, WordList* words)
+      : global_word_count_(global_dict.size()), words_(words) {}
+
+  // Adds the learned words first. A learned word is sent as an empty
+  // string unless it is used, see ClearUnused().
+  MessageDictionary(const GlobalDictionary& global_dict, WordList* words,
+                    const std::vector<std::string>& learned_words)
+      : global_word_count_(global_dict.size()), words_(words) {
+    for (const std::string& word : learned_words) {
+      int index;
+      if (GlobalDictionary::GetIndex(word, global_word_count_, &index) ||
+          message_dict_.find(word) != message_dict_.end()) {
+        continue;
+      }
+      AddWord(word);
+      references_.push_back(0);
+      first_uses_.push_back(-1);
+      words_byte_size_ += LengthDelimitedFieldSize(0);
+      ++num_learned_;
+    }
+  }
 
   int GetIndex(const std::string& name) {
     int index;
-    if (global_dict_.GetIndex(name, &index)) {
+    if (GlobalDictionary::GetIndex(name, global_word_count_, &index)) {
       return index;
     }
 
     const auto& message_it = message_dict_.find(name);
     if (message_it != message_dict_.end()) {
-      return MessageDictIndex(message_it->second);
+      index = message_it->second;
+      if (references_[index]++ == 0) {
+        // The first use of a learned word.
+        first_uses_[index] = num_used_++;
+        words_byte_size_ +=
+            LengthDelimitedFieldSize(name.size()) - LengthDelimitedFieldSize(0);
+      }
+      return MessageDictIndex(index);
     }
 
-    index = message_words_.size();
-    message_words_.push_back(name);
-    message_dict_[name] = index;
+    index = AddWord(name);
+    references_.push_back(1);
+    first_uses_.push_back(num_used_++);
+    words_byte_size_ += LengthDelimitedFieldSize(name.size());
     return MessageDictIndex(index);
   }
 
-  const std::vector<std::string>& GetWords() const { return message_words_; }
+  // The global dictionary size used by this dictionary.
+  int global_word_count() const { return global_word_count_; }
+
+  // The number of references to each word.
+  const std::vector<int>& references() const { return references_; }
+
+  // Empties the learned words which are not used. Must be called last,
+  // the dictionary can't be used after it.
+  void ClearUnused() {
+    if (num_learned_ == 0) {
+      return;
+    }
+    message_dict_.clear();
+    for (int i = 0; i < num_learned_; ++i) {
+      if (references_[i] == 0) {
+        words_->Mutable(i)->clear();
+      }
+    }
+  }
+
+  // The encoded size of the words as a repeated string field.
+  size_t words_byte_size() const { return words_byte_size_; }
+
+  // The bytes saved by the learned words, from the indexes the words would
+  // have without them, in the order of their first use.
+  int64_t learned_bytes_saved() const {
+    if (num_learned_ == 0) {
+      return 0;
+    }
+    int64_t saved = 0;
+    for (size_t i = 0; i < references_.size(); ++i) {
+      if (references_[i] == 0) {
+        saved -= LengthDelimitedFieldSize(0);
+      } else {
+        int index_size_saved =
+            MessageDictIndexSize(first_uses_[i]) - MessageDictIndexSize(i);
+        saved += static_cast<int64_t>(references_[i]) * index_size_saved;
+      }
+    }
+    return saved;
+  }
 
  private:
-  const GlobalDictionary& global_dict_;
+  // Appends the word to words_ and returns its index.
+  int AddWord(const std::string& word) {
+    int index = words_->size();
+    std::string* stored = words_->Add();
+    stored->assign(word);
+    message_dict_.emplace(StringPiece(*stored), index);
+    return index;
+  }
 
-  // Per message dictionary
-  std::vector<std::string> message_words_;
-  std::unordered_map<std::string, int> message_dict_;
+  // The global dictionary size when this dictionary is created, so the
+  // message is encoded with one epoch even if it shrinks meanwhile.
+  const int global_word_count_;
+
+  // Per message dictionary, keyed by the words stored in words_.
+  WordList* words_;
+  std::unordered_map<StringPiece, int, StringPieceHash> message_dict_;
+  size_t words_byte_size_ = 0;
+
+  // For each word, the number of references, and the order of its first
+  // use among the words, -1 if not used.
+  std::vector<int> references_;
+  std::vector<int> first_uses_;
+  int num_used_ = 0;
+  int num_learned_ = 0;
 };
 
 ::istio::mixer::v1::StringMap CreateStringMap(
@@ -128,85 +254,489 @@ bool CompressByDict(const Attributes& attributes, MessageDictionary& dict,
   return delta_update.Finish();
 }
 
+// The encoded size of a sint32 field with a one byte tag, such as a map
+// entry key.
+size_t SInt32FieldSize(int value) {
+  return 1 + CodedOutputStream::VarintSize32(
+                 WireFormatLite::ZigZagEncode32(value));
+}
+
+// Writes the tag, the length and the key of a map entry. The value is
+// written next, as field 2 of value_size bytes.
+void WriteEntryStart(int field, int key, size_t value_size,
+                     CodedOutputStream* out) {
+  WireFormatLite::WriteTag(field, WireFormatLite::WIRETYPE_LENGTH_DELIMITED,
+                           out);
+  out->WriteVarint32(SInt32FieldSize(key) + value_size);
+  WireFormatLite::WriteSInt32(1, key, out);
+}
+
+// Writes a map entry with a length delimited value of size bytes, whose
+// tag and length are included in the entry.
+void WriteMessageEntryStart(int field, int key, size_t size,
+                            CodedOutputStream* out) {
+  WriteEntryStart(field, key, 1 + CodedOutputStream::VarintSize32(size) + size,
+                  out);
+  WireFormatLite::WriteTag(2, WireFormatLite::WIRETYPE_LENGTH_DELIMITED, out);
+  out->WriteVarint32(size);
+}
+
+// Writes a StringMap entry, adding the words of the map to dict.
+void EncodeStringMap(int key, const Attributes_StringMap& raw_map,
+                     MessageDictionary& dict,
+                     std::vector<std::pair<int, int>>* entries,
+                     CodedOutputStream* out) {
+  entries->clear();
+  size_t size = 0;
+  for (const auto& it : raw_map.entries()) {
+    int entry_key = dict.GetIndex(it.first);
+    int entry_value = dict.GetIndex(it.second);
+    entries->emplace_back(entry_key, entry_value);
+    size_t entry_size =
+        SInt32FieldSize(entry_key) + SInt32FieldSize(entry_value);
+    size += 1 + CodedOutputStream::VarintSize32(entry_size) + entry_size;
+  }
+  WriteMessageEntryStart(CompressedAttributes::kStringMapsFieldNumber, key,
+                         size, out);
+  for (const auto& it : *entries) {
+    WriteEntryStart(::istio::mixer::v1::StringMap::kEntriesFieldNumber,
+                    it.first, SInt32FieldSize(it.second), out);
+    WireFormatLite::WriteSInt32(2, it.second, out);
+  }
+}
+
+// Same as CompressByDict, but writes the fields of a serialized
+// CompressedAttributes, except its words, without building the message.
+// The map entries are written in the order of the attributes. The ones
+// in static_attributes, if not null, are skipped. entries is a buffer
+// reused for the string maps.
+bool EncodeByDict(const Attributes& attributes, MessageDictionary& dict,
+                  DeltaUpdate& delta_update,
+                  const CompressedStaticAttributes* static_attributes,
+                  std::vector<std::pair<int, int>>* entries,
+                  CodedOutputStream* out) {
+  delta_update.Start();
+
+  for (const auto& it : attributes.attributes()) {
+    const std::string& name = it.first;
+    const Attributes_AttributeValue& value = it.second;
+
+    if (static_attributes && static_attributes->Contains(name, value)) {
+      continue;
+    }
+
+    int index = dict.GetIndex(name);
+
+    // Check delta update. If same, skip it.
+    if (delta_update.Check(index, value)) {
+      continue;
+    }
+
+    switch (value.value_case()) {
+      case Attributes_AttributeValue::kStringValue: {
+        int word = dict.GetIndex(value.string_value());
+        WriteEntryStart(CompressedAttributes::kStringsFieldNumber, index,
+                        SInt32FieldSize(word), out);
+        WireFormatLite::WriteSInt32(2, word, out);
+      } break;
+      case Attributes_AttributeValue::kBytesValue:
+        WriteMessageEntryStart(CompressedAttributes::kBytesFieldNumber, index,
+                               value.bytes_value().size(), out);
+        out->WriteString(value.bytes_value());
+        break;
+      case Attributes_AttributeValue::kInt64Value:
+        WriteEntryStart(CompressedAttributes::kInt64SFieldNumber, index,
+                        1 + WireFormatLite::Int64Size(value.int64_value()),
+                        out);
+        WireFormatLite::WriteInt64(2, value.int64_value(), out);
+        break;
+      case Attributes_AttributeValue::kDoubleValue:
+        WriteEntryStart(CompressedAttributes::kDoublesFieldNumber, index,
+                        1 + WireFormatLite::kDoubleSize, out);
+        WireFormatLite::WriteDouble(2, value.double_value(), out);
+        break;
+      case Attributes_AttributeValue::kBoolValue:
+        WriteEntryStart(CompressedAttributes::kBoolsFieldNumber, index,
+                        1 + WireFormatLite::kBoolSize, out);
+        WireFormatLite::WriteBool(2, value.bool_value(), out);
+        break;
+      case Attributes_AttributeValue::kTimestampValue:
+        WriteMessageEntryStart(CompressedAttributes::kTimestampsFieldNumber,
+                               index, value.timestamp_value().ByteSizeLong(),
+                               out);
+        value.timestamp_value().SerializeWithCachedSizes(out);
+        break;
+      case Attributes_AttributeValue::kDurationValue:
+        WriteMessageEntryStart(CompressedAttributes::kDurationsFieldNumber,
+                               index, value.duration_value().ByteSizeLong(),
+                               out);
+        value.duration_value().SerializeWithCachedSizes(out);
+        break;
+      case Attributes_AttributeValue::kStringMapValue:
+        EncodeStringMap(index, value.string_map_value(), dict, entries, out);
+        break;
+      case Attributes_AttributeValue::VALUE_NOT_SET:
+        break;
+    }
+  }
+
+  return delta_update.Finish();
+}
+
+// Appends a length delimited field to serialized.
+void AppendLengthDelimited(int field, const std::string& data,
+                           std::string* serialized) {
+  uint8_t header[kMaxFieldHeaderSize];
+  uint8_t* end = WireFormatLite::WriteTagToArray(
+      field, WireFormatLite::WIRETYPE_LENGTH_DELIMITED, header);
+  end = CodedOutputStream::WriteVarint32ToArray(data.size(), end);
+  serialized->append(reinterpret_cast<const char*>(header), end - header);
+  serialized->append(data);
+}
+
+// Appends a varint field to serialized.
+void AppendVarint(int field, uint32_t value, std::string* serialized) {
+  uint8_t buffer[kMaxFieldHeaderSize];
+  uint8_t* end =
+      WireFormatLite::WriteTagToArray(field, WireFormatLite::WIRETYPE_VARINT,
+                                      buffer);
+  end = CodedOutputStream::WriteVarint32ToArray(value, end);
+  serialized->append(reinterpret_cast<const char*>(buffer), end - buffer);
+}
+
+// Moves the global words at or above a dictionary size to the per message
+// dictionary of a request, for Reencode.
+class WordTranslator {
+ public:
+  WordTranslator(int global_word_count, WordList* words)
+      : global_word_count_(global_word_count), words_(words) {}
+
+  int Translate(int index) {
+    if (index < global_word_count_) {
+      return index;
+    }
+    const auto it = translated_.find(index);
+    if (it != translated_.end()) {
+      return it->second;
+    }
+    int message_index = MessageDictIndex(words_->size());
+    *words_->Add() = GetGlobalWords()[index];
+    translated_[index] = message_index;
+    return message_index;
+  }
+
+  // Translates the keys of a map indexed by dictionary indexes.
+  template <class Map>
+  void TranslateKeys(Map* map) {
+    std::vector<typename Map::key_type> keys;
+    for (const auto& it : *map) {
+      if (it.first >= global_word_count_) {
+        keys.push_back(it.first);
+      }
+    }
+    for (const auto key : keys) {
+      typename Map::mapped_type value;
+      value = (*map)[key];
+      map->erase(key);
+      (*map)[Translate(key)] = value;
+    }
+  }
+
+ private:
+  const int global_word_count_;
+  WordList* words_;
+  // Translated global indexes, to per message indexes.
+  std::unordered_map<int, int> translated_;
+};
+
 class BatchCompressorImpl : public BatchCompressor {
  public:
-  BatchCompressorImpl(const GlobalDictionary& global_dict)
-      : dict_(global_dict),
+  BatchCompressorImpl(const GlobalDictionary& global_dict,
+                      LearnedDictionary* learned_dict, bool serialize)
+      : report_(serialize ? nullptr : new ::istio::mixer::v1::ReportRequest),
+        dict_(global_dict,
+              serialize ? &words_ : report_->mutable_default_words(),
+              learned_dict ? learned_dict->words()
+                           : std::vector<std::string>()),
+        learned_dict_(learned_dict),
         delta_update_(DeltaUpdate::Create()),
-        report_(new ::istio::mixer::v1::ReportRequest) {
-    report_->set_global_word_count(global_dict.size());
+        global_word_count_(dict_.global_word_count()),
+        size_(0),
+        attributes_byte_size_(0) {
+    if (report_) {
+      report_->set_global_word_count(global_word_count_);
+    }
+    global_word_count_byte_size_ =
+        global_word_count_ == 0
+            ? 0
+            : 1 + CodedOutputStream::VarintSize32(global_word_count_);
   }
 
   bool Add(const Attributes& attributes) override {
-    CompressedAttributes pb;
-    if (!CompressByDict(attributes, dict_, *delta_update_, &pb)) {
+    // Checked first, so a rejected report doesn't change the delta state.
+    size_t found = 0;
+    for (const auto& it : attributes.attributes()) {
+      found += added_names_.count(it.first);
+    }
+    if (found < added_names_.size()) {
       return false;
     }
-    pb.GetReflection()->Swap(report_->add_attributes(), &pb);
+
+    if (report_ ? !AddToReport(attributes) : !AddSerialized(attributes)) {
+      return false;
+    }
+    if (found < static_cast<size_t>(attributes.attributes_size())) {
+      for (const auto& it : attributes.attributes()) {
+        added_names_.insert(it.first);
+      }
+    }
+    ++size_;
     return true;
   }
 
-  int size() const override { return report_->attributes_size(); }
+  int size() const override { return size_; }
+
+  size_t byte_size() const override {
+    return attributes_byte_size_ + dict_.words_byte_size() +
+           global_word_count_byte_size_;
+  }
 
   std::unique_ptr<::istio::mixer::v1::ReportRequest> Finish() override {
-    for (const std::string& word : dict_.GetWords()) {
-      report_->add_default_words(word);
+    if (!report_) {
+      std::string serialized;
+      FinishSerialized(&serialized);
+      std::unique_ptr<::istio::mixer::v1::ReportRequest> report(
+          new ::istio::mixer::v1::ReportRequest);
+      report->ParseFromString(serialized);
+      return report;
     }
+    FinishWords(report_->default_words());
     return std::move(report_);
   }
 
+  void FinishSerialized(std::string* serialized) override {
+    if (report_) {
+      Finish()->SerializeToString(serialized);
+      return;
+    }
+    FinishWords(words_);
+    serialized->swap(serialized_);
+    for (const std::string& word : words_) {
+      AppendLengthDelimited(
+          ::istio::mixer::v1::ReportRequest::kDefaultWordsFieldNumber, word,
+          serialized);
+    }
+    if (global_word_count_ > 0) {
+      AppendVarint(
+          ::istio::mixer::v1::ReportRequest::kGlobalWordCountFieldNumber,
+          global_word_count_, serialized);
+    }
+  }
+
  private:
+  bool AddToReport(const Attributes& attributes) {
+    CompressedAttributes pb;
+    if (!CompressByDict(attributes, dict_, *delta_update_, &pb)) {
+      return false;
+    }
+    attributes_byte_size_ += LengthDelimitedFieldSize(pb.ByteSizeLong());
+    pb.GetReflection()->Swap(report_->add_attributes(), &pb);
+    return true;
+  }
+
+  bool AddSerialized(const Attributes& attributes) {
+    // The attributes are encoded to scratch_ first, their size is needed
+    // before them.
+    scratch_.clear();
+    bool ok;
+    {
+      StringOutputStream stream(&scratch_);
+      CodedOutputStream out(&stream);
+      ok = EncodeByDict(attributes, dict_, *delta_update_, nullptr,
+                        &map_entries_, &out);
+    }
+    if (!ok) {
+      return false;
+    }
+    attributes_byte_size_ += LengthDelimitedFieldSize(scratch_.size());
+    AppendLengthDelimited(
+        ::istio::mixer::v1::ReportRequest::kAttributesFieldNumber, scratch_,
+        &serialized_);
+    return true;
+  }
+
+  // Learns from the words and empties the unused learned ones.
+  void FinishWords(const WordList& words) {
+    if (learned_dict_) {
+      learned_dict_->Update(words, dict_.references(),
+                            dict_.learned_bytes_saved());
+    }
+    dict_.ClearUnused();
+  }
+
+  // The request being built, null if it is serialized as it is built.
+  // Declared first, dict_ stores its words in it.
+  std::unique_ptr<::istio::mixer::v1::ReportRequest> report_;
+  // The words if the request is serialized.
+  WordList words_;
   MessageDictionary dict_;
+  // Learns from the batch if not null.
+  LearnedDictionary* learned_dict_;
   std::unique_ptr<DeltaUpdate> delta_update_;
-  std::unique_ptr<::istio::mixer::v1::ReportRequest> report_;
+  // The names of the added attributes. Deletion can't be delta encoded,
+  // a report without one of them is rejected.
+  std::unordered_set<std::string> added_names_;
+  int global_word_count_;
+  int size_;
+
+  // The serialized attributes field of the request, and the buffers reused
+  // to encode one report.
+  std::string serialized_;
+  std::string scratch_;
+  std::vector<std::pair<int, int>> map_entries_;
+
+  // The encoded sizes of the request fields.
+  size_t attributes_byte_size_;
+  size_t global_word_count_byte_size_;
 };
 
 }  // namespace
 
-GlobalDictionary::GlobalDictionary() {
-  const std::vector<std::string>& global_words = GetGlobalWords();
-  for (unsigned int i = 0; i < global_words.size(); i++) {
-    global_dict_[global_words[i]] = i;
-  }
-  top_index_ = global_words.size();
-}
+GlobalDictionary::GlobalDictionary() : top_index_(GetGlobalWords().size()) {}
 
 // Lookup the index, return true if found.
-bool GlobalDictionary::GetIndex(const std::string name, int* index) const {
-  const auto& it = global_dict_.find(name);
-  if (it != global_dict_.end() && it->second < top_index_) {
+bool GlobalDictionary::GetIndex(const std::string& name, int size,
+                                int* index) {
+  int global_index = GetGlobalWordIndex(name);
+  if (global_index >= 0 && global_index < size) {
     // Return global dictionary index.
-    *index = it->second;
+    *index = global_index;
     return true;
   }
   return false;
 }
 
-void GlobalDictionary::ShrinkToBase() {
-  if (top_index_ > kGlobalDictionaryBaseSize) {
-    top_index_ = kGlobalDictionaryBaseSize;
-    GOOGLE_LOG(INFO) << "Shrink global dictionary " << top_index_
-                     << " to base.";
+bool GlobalDictionary::ShrinkToBase() {
+  int top_index = top_index_.load();
+  // Concurrent failures with the same epoch shrink it once.
+  while (top_index > kGlobalDictionaryBaseSize) {
+    if (top_index_.compare_exchange_weak(top_index,
+                                         kGlobalDictionaryBaseSize)) {
+      GOOGLE_LOG(INFO) << "Shrink global dictionary " << top_index
+                       << " to base.";
+      return true;
+    }
   }
+  return false;
 }
 
-void AttributeCompressor::Compress(
+int AttributeCompressor::Compress(
     const Attributes& attributes,
     ::istio::mixer::v1::CompressedAttributes* pb) const {
-  MessageDictionary dict(global_dict_);
+  MessageDictionary dict(global_dict_, pb->mutable_words());
   std::unique_ptr<DeltaUpdate> delta_update = DeltaUpdate::CreateNoOp();
 
   CompressByDict(attributes, dict, *delta_update, pb);
+  return dict.global_word_count();
+}
+
+bool CompressedStaticAttributes::Contains(
+    const std::string& name, const Attributes_AttributeValue& value) const {
+  const auto& map = attributes_.attributes();
+  const auto it = map.find(name);
+  return it != map.end() && AttributeValueEquals(it->second, value);
+}
+
+int AttributeCompressor::CompressToString(
+    const Attributes& attributes, std::string* serialized,
+    const CompressedStaticAttributes* static_attributes) const {
+  WordList words;
+  MessageDictionary dict(global_dict_, &words);
+  std::unique_ptr<DeltaUpdate> delta_update = DeltaUpdate::CreateNoOp();
+  std::vector<std::pair<int, int>> map_entries;
+
+  serialized->clear();
+  // Not usable once the global dictionary is shrunk.
+  if (static_attributes &&
+      static_attributes->global_word_count_ == dict.global_word_count()) {
+    // Their words take the same indexes as when they were compressed.
+    for (const std::string& word : static_attributes->words_) {
+      dict.GetIndex(word);
+    }
+    serialized->assign(static_attributes->serialized_);
+  } else {
+    static_attributes = nullptr;
+  }
+  {
+    StringOutputStream stream(serialized);
+    CodedOutputStream out(&stream);
+    EncodeByDict(attributes, dict, *delta_update, static_attributes,
+                 &map_entries, &out);
+  }
+  for (const std::string& word : words) {
+    AppendLengthDelimited(CompressedAttributes::kWordsFieldNumber, word,
+                          serialized);
+  }
+  return dict.global_word_count();
+}
+
+std::shared_ptr<const CompressedStaticAttributes>
+AttributeCompressor::CompressStatic(const Attributes& attributes) const {
+  std::shared_ptr<CompressedStaticAttributes> compressed(
+      new CompressedStaticAttributes);
+  compressed->attributes_ = attributes;
 
-  for (const std::string& word : dict.GetWords()) {
-    pb->add_words(word);
+  WordList words;
+  MessageDictionary dict(global_dict_, &words);
+  compressed->global_word_count_ = dict.global_word_count();
+  std::unique_ptr<DeltaUpdate> delta_update = DeltaUpdate::CreateNoOp();
+  std::vector<std::pair<int, int>> map_entries;
+  {
+    StringOutputStream stream(&compressed->serialized_);
+    CodedOutputStream out(&stream);
+    EncodeByDict(attributes, dict, *delta_update, nullptr, &map_entries,
+                 &out);
+  }
+  compressed->words_.assign(words.begin(), words.end());
+  return compressed;
+}
+
+bool AttributeCompressor::Reencode(
+    ::istio::mixer::v1::ReportRequest* request) const {
+  const int global_word_count = global_dict_.size();
+  if (static_cast<int>(request->global_word_count()) <= global_word_count) {
+    return false;
+  }
+  WordTranslator translator(global_word_count,
+                            request->mutable_default_words());
+  for (auto& attributes : *request->mutable_attributes()) {
+    translator.TranslateKeys(attributes.mutable_strings());
+    for (auto& it : *attributes.mutable_strings()) {
+      it.second = translator.Translate(it.second);
+    }
+    translator.TranslateKeys(attributes.mutable_int64s());
+    translator.TranslateKeys(attributes.mutable_doubles());
+    translator.TranslateKeys(attributes.mutable_bools());
+    translator.TranslateKeys(attributes.mutable_timestamps());
+    translator.TranslateKeys(attributes.mutable_durations());
+    translator.TranslateKeys(attributes.mutable_bytes());
+    translator.TranslateKeys(attributes.mutable_string_maps());
+    for (auto& it : *attributes.mutable_string_maps()) {
+      auto* entries = it.second.mutable_entries();
+      translator.TranslateKeys(entries);
+      for (auto& entry : *entries) {
+        entry.second = translator.Translate(entry.second);
+      }
+    }
   }
+  request->set_global_word_count(global_word_count);
+  return true;
 }
 
-std::unique_ptr<BatchCompressor> AttributeCompressor::CreateBatchCompressor()
-    const {
+std::unique_ptr<BatchCompressor> AttributeCompressor::CreateBatchCompressor(
+    LearnedDictionary* learned_dict, bool serialize) const {
   return std::unique_ptr<BatchCompressor>(
-      new BatchCompressorImpl(global_dict_));
+      new BatchCompressorImpl(global_dict_, learned_dict, serialize));
 }
 
 }  // namespace mixer_client
@@ -16,32 +16,35 @@
 #ifndef MIXERCLIENT_ATTRIBUTE_COMPRESSOR_H
 #define MIXERCLIENT_ATTRIBUTE_COMPRESSOR_H
 
-#include <unordered_map>
-
+#include "include/client.h"
 #include "mixer/v1/attributes.pb.h"
 #include "mixer/v1/report.pb.h"
+#include "src/learned_dictionary.h"
+
+#include <atomic>
 
 namespace istio {
 namespace mixer_client {
 
-// A class to store global dictionary
+// A class to store global dictionary. Its size is its epoch: the size
+// only changes when it shrinks, and each request records the size it is
+// encoded with as its global_word_count. This class is thread safe.
 class GlobalDictionary {
  public:
   GlobalDictionary();
 
-  // Lookup the index, return true if found.
-  bool GetIndex(const std::string word, int* index) const;
+  // Lookup the index among the first size words, return true if found.
+  static bool GetIndex(const std::string& word, int size, int* index);
 
-  // Shrink the global dictioanry
-  void ShrinkToBase();
+  // Shrink the global dictioanry. Returns true if it shrank.
+  bool ShrinkToBase();
 
-  int size() const { return top_index_; }
+  int size() const { return top_index_.load(); }
 
  private:
-  std::unordered_map<std::string, int> global_dict_;
   // the last index of the global dictionary.
   // If mis-matched with server, it will set to base
-  int top_index_;
+  std::atomic<int> top_index_;
 };
 
 // A attribute batch compressor for report.
@@ -50,30 +53,83 @@ class BatchCompressor {
   virtual ~BatchCompressor() {}
 
   // Add an attribute set to the batch.
-  // Return false if it could not be added for delta update.
+  // Return false if it could not be added for delta update, because it
+  // lacks some attributes of the batch. The batch is not changed then.
   virtual bool Add(const ::istio::mixer::v1::Attributes& attributes) = 0;
 
   // Get the batched size.
   virtual int size() const = 0;
 
+  // Get the encoded size of the report request Finish() would return.
+  virtual size_t byte_size() const = 0;
+
   // Finish the batch and create the batched report request.
   virtual std::unique_ptr<::istio::mixer::v1::ReportRequest> Finish() = 0;
+
+  // Finish the batch and write the serialized report request, instead of
+  // Finish(). Its size is byte_size().
+  virtual void FinishSerialized(std::string* serialized) = 0;
 };
 
-// Compress attributes.
-class AttributeCompressor {
+// Static attributes compressed by AttributeCompressor::CompressStatic().
+class CompressedStaticAttributes : public StaticAttributes {
  public:
-  void Compress(const ::istio::mixer::v1::Attributes& attributes,
-                ::istio::mixer::v1::CompressedAttributes* attributes_pb) const;
+  // Returns true if the attribute is one of the static ones, with the same
+  // value.
+  bool Contains(const std::string& name,
+                const ::istio::mixer::v1::Attributes_AttributeValue& value)
+      const;
 
-  // Create a batch compressor.
-  std::unique_ptr<BatchCompressor> CreateBatchCompressor() const;
+ private:
+  friend class AttributeCompressor;
+
+  ::istio::mixer::v1::Attributes attributes_;
+  // Their per message words, and their encoded map entries using them.
+  std::vector<std::string> words_;
+  std::string serialized_;
+  // The global dictionary size they were compressed with.
+  int global_word_count_;
+};
+
+// Compress attributes. The compressions are thread safe, each one uses
+// the global dictionary size at its start.
+class AttributeCompressor {
+ public:
+  // Returns the global dictionary size used, for global_word_count.
+  int Compress(const ::istio::mixer::v1::Attributes& attributes,
+               ::istio::mixer::v1::CompressedAttributes* attributes_pb) const;
+
+  // Same as Compress, but writes the serialized CompressedAttributes
+  // without building the message. The map entries may be in another order.
+  // If static_attributes is not null, the attributes found in it are not
+  // compressed again, its encoding is copied instead. Returns the global
+  // dictionary size used.
+  int CompressToString(
+      const ::istio::mixer::v1::Attributes& attributes,
+      std::string* serialized,
+      const CompressedStaticAttributes* static_attributes = nullptr) const;
+
+  // Compresses static attributes once, for CompressToString().
+  std::shared_ptr<const CompressedStaticAttributes> CompressStatic(
+      const ::istio::mixer::v1::Attributes& attributes) const;
+
+  // Create a batch compressor. If learned_dict is not null, the batch
+  // starts with its words and updates it when finished; it must outlive
+  // the batch compressor. If serialize is true, the reports are encoded
+  // as they are added, for FinishSerialized(); Finish() has to parse them.
+  std::unique_ptr<BatchCompressor> CreateBatchCompressor(
+      LearnedDictionary* learned_dict = nullptr, bool serialize = false) const;
 
   int global_word_count() const { return global_dict_.size(); }
 
   // Shrink global dictionary to the first version.
   void ShrinkGlobalDictionary() { global_dict_.ShrinkToBase(); }
 
+  // Re-encodes a report request encoded with a larger global dictionary
+  // than the current one, moving the words no longer in it to its
+  // default_words. Returns false if it is not encoded with a larger one.
+  bool Reencode(::istio::mixer::v1::ReportRequest* request) const;
+
  private:
   GlobalDictionary global_dict_;
 };
@@ -15,8 +15,12 @@
 
 #include "src/attribute_compressor.h"
 #include "include/attributes_builder.h"
+#include "src/global_dictionary.h"
 
 #include <time.h>
+#include <atomic>
+#include <set>
+#include <thread>
 #include "google/protobuf/text_format.h"
 #include "google/protobuf/util/message_differencer.h"
 #include "gtest/gtest.h"
@@ -180,6 +184,43 @@ default_words: "JWT-Token"
 global_word_count: 111
 )";
 
+// Returns the word of a dictionary index of the request, or "?" if the
+// index is not valid.
+std::string DecodeWord(const ::istio::mixer::v1::ReportRequest& request,
+                       int index) {
+  if (index >= 0) {
+    return index < static_cast<int>(request.global_word_count())
+               ? GetGlobalWords()[index]
+               : "?";
+  }
+  return -index - 1 < request.default_words_size()
+             ? request.default_words(-index - 1)
+             : "?";
+}
+
+// Decodes the names, string values and string map entries of a request.
+std::set<std::string> DecodeWords(
+    const ::istio::mixer::v1::ReportRequest& request) {
+  std::set<std::string> words;
+  for (const auto& attributes : request.attributes()) {
+    for (const auto& it : attributes.strings()) {
+      words.insert(DecodeWord(request, it.first) + "=" +
+                   DecodeWord(request, it.second));
+    }
+    for (const auto& it : attributes.int64s()) {
+      words.insert(DecodeWord(request, it.first));
+    }
+    for (const auto& it : attributes.string_maps()) {
+      for (const auto& entry : it.second.entries()) {
+        words.insert(DecodeWord(request, it.first) + "." +
+                     DecodeWord(request, entry.first) + "=" +
+                     DecodeWord(request, entry.second));
+      }
+    }
+  }
+  return words;
+}
+
 class AttributeCompressorTest : public ::testing::Test {
  protected:
   void SetUp() {
@@ -252,6 +293,7 @@ TEST_F(AttributeCompressorTest, BatchCompressTest) {
   attributes_.mutable_attributes()->erase("response.size");
   // Batch should fail.
   EXPECT_FALSE(batch_compressor->Add(attributes_));
+  EXPECT_EQ(batch_compressor->size(), 2);
 
   auto report_pb = batch_compressor->Finish();
 
@@ -266,6 +308,232 @@ TEST_F(AttributeCompressorTest, BatchCompressTest) {
   EXPECT_TRUE(MessageDifferencer::Equals(*report_pb, expected_report_pb));
 }
 
+TEST_F(AttributeCompressorTest, BatchCompressByteSizeTest) {
+  AttributeCompressor compressor;
+  auto batch_compressor = compressor.CreateBatchCompressor();
+  size_t empty_byte_size = batch_compressor->byte_size();
+  EXPECT_EQ(empty_byte_size, batch_compressor->Finish()->ByteSizeLong());
+
+  batch_compressor = compressor.CreateBatchCompressor();
+  EXPECT_TRUE(batch_compressor->Add(attributes_));
+  AttributesBuilder(&attributes_).AddString("new-word", "new-value");
+  EXPECT_TRUE(batch_compressor->Add(attributes_));
+
+  size_t byte_size = batch_compressor->byte_size();
+  EXPECT_EQ(byte_size, batch_compressor->Finish()->ByteSizeLong());
+}
+
+TEST_F(AttributeCompressorTest, CompressToStringTest) {
+  AttributeCompressor compressor;
+  ::istio::mixer::v1::CompressedAttributes attributes_pb;
+  compressor.Compress(attributes_, &attributes_pb);
+
+  std::string serialized = "not empty";
+  compressor.CompressToString(attributes_, &serialized);
+  EXPECT_EQ(serialized.size(), attributes_pb.ByteSizeLong());
+  ::istio::mixer::v1::CompressedAttributes parsed_pb;
+  ASSERT_TRUE(parsed_pb.ParseFromString(serialized));
+  EXPECT_TRUE(MessageDifferencer::Equals(parsed_pb, attributes_pb));
+}
+
+TEST_F(AttributeCompressorTest, CompressStaticTest) {
+  AttributeCompressor compressor;
+  Attributes static_attributes;
+  AttributesBuilder builder(&static_attributes);
+  builder.AddString("source.name", "connection.received.bytes_total");
+  builder.AddInt64("target.port", 8080);
+  // Overridden by the request.
+  builder.AddInt64("source.port", 1);
+  auto compressed_static = compressor.CompressStatic(static_attributes);
+  EXPECT_TRUE(compressed_static->Contains(
+      "target.port", static_attributes.attributes().at("target.port")));
+  EXPECT_FALSE(compressed_static->Contains(
+      "source.port", attributes_.attributes().at("source.port")));
+
+  std::string serialized;
+  compressor.CompressToString(attributes_, &serialized,
+                              compressed_static.get());
+  ::istio::mixer::v1::CompressedAttributes parsed_pb;
+  ASSERT_TRUE(parsed_pb.ParseFromString(serialized));
+  ::istio::mixer::v1::CompressedAttributes attributes_pb;
+  compressor.Compress(attributes_, &attributes_pb);
+  EXPECT_TRUE(MessageDifferencer::Equals(parsed_pb, attributes_pb));
+}
+
+TEST_F(AttributeCompressorTest, BatchCompressSerializedTest) {
+  AttributeCompressor compressor;
+  auto batch_compressor = compressor.CreateBatchCompressor();
+  auto serialized_compressor = compressor.CreateBatchCompressor(nullptr, true);
+  for (int i = 0; i < 3; ++i) {
+    AttributesBuilder builder(&attributes_);
+    builder.AddInt64("source.port", i);
+    builder.AddString("new-word", "new-value" + std::to_string(i));
+    EXPECT_TRUE(batch_compressor->Add(attributes_));
+    EXPECT_TRUE(serialized_compressor->Add(attributes_));
+  }
+  attributes_.mutable_attributes()->erase("new-word");
+  EXPECT_FALSE(serialized_compressor->Add(attributes_));
+  EXPECT_EQ(serialized_compressor->size(), 3);
+
+  size_t byte_size = serialized_compressor->byte_size();
+  EXPECT_EQ(byte_size, batch_compressor->byte_size());
+  std::string serialized;
+  serialized_compressor->FinishSerialized(&serialized);
+  EXPECT_EQ(serialized.size(), byte_size);
+
+  ::istio::mixer::v1::ReportRequest report_pb;
+  ASSERT_TRUE(report_pb.ParseFromString(serialized));
+  EXPECT_TRUE(
+      MessageDifferencer::Equals(report_pb, *batch_compressor->Finish()));
+}
+
+TEST_F(AttributeCompressorTest, BatchCompressLearnedWordsTest) {
+  AttributeCompressor compressor;
+  LearnedDictionary learned_dict(2);
+  // Learns "JWT-Token", the only word not in the global dictionary.
+  for (int i = 0; i < 30; ++i) {
+    auto batch_compressor = compressor.CreateBatchCompressor(&learned_dict);
+    EXPECT_TRUE(batch_compressor->Add(attributes_));
+    batch_compressor->Finish();
+  }
+  ASSERT_EQ(learned_dict.words(), std::vector<std::string>({"JWT-Token"}));
+
+  // Over 64 words are used before the learned one in the batch.
+  Attributes attributes;
+  for (int i = 0; i < 70; ++i) {
+    AttributesBuilder(&attributes).AddString("word" + std::to_string(i), "");
+  }
+  auto batch_compressor = compressor.CreateBatchCompressor(&learned_dict);
+  EXPECT_TRUE(batch_compressor->Add(attributes));
+  for (int i = 0; i < 70; ++i) {
+    AttributesBuilder(&attributes)
+        .AddString("word" + std::to_string(i), "JWT-Token");
+  }
+  EXPECT_TRUE(batch_compressor->Add(attributes));
+  size_t byte_size = batch_compressor->byte_size();
+  int64_t bytes_saved = learned_dict.bytes_saved();
+  auto report_pb = batch_compressor->Finish();
+  EXPECT_EQ(byte_size, report_pb->ByteSizeLong());
+
+  // The learned word comes first, then the names and "".
+  ASSERT_EQ(report_pb->default_words_size(), 72);
+  EXPECT_EQ(report_pb->default_words(0), "JWT-Token");
+  // Its 70 references take 1 byte instead of 2. The name moved from index
+  // 63 to 64 takes 2 bytes instead of 1 for its 2 references.
+  EXPECT_EQ(learned_dict.bytes_saved() - bytes_saved, 68);
+
+  // An unused learned word is sent as an empty string.
+  batch_compressor = compressor.CreateBatchCompressor(&learned_dict);
+  EXPECT_TRUE(batch_compressor->Add(Attributes()));
+  byte_size = batch_compressor->byte_size();
+  report_pb = batch_compressor->Finish();
+  EXPECT_EQ(byte_size, report_pb->ByteSizeLong());
+  ASSERT_EQ(report_pb->default_words_size(), 1);
+  EXPECT_EQ(report_pb->default_words(0), "");
+}
+
+TEST_F(AttributeCompressorTest, ReencodeTest) {
+  AttributeCompressor compressor;
+  const std::vector<std::string>& words = GetGlobalWords();
+  const int full_size = compressor.global_word_count();
+  AttributeCompressor shrunk;
+  shrunk.ShrinkGlobalDictionary();
+  const int base_size = shrunk.global_word_count();
+  if (full_size == base_size) {
+    // Nothing to shrink.
+    return;
+  }
+
+  // Words removed from the dictionary by the shrink, and a kept one.
+  AttributesBuilder builder(&attributes_);
+  builder.AddString(words[full_size - 1], words[full_size - 2]);
+  builder.AddString("source.name", words[full_size - 1]);
+  builder.AddInt64(words[full_size - 3], 1);
+  builder.AddStringMap("request.headers", {{words[full_size - 2], "JWT-Token"},
+                                           {words[0], words[full_size - 3]}});
+  auto batch_compressor = compressor.CreateBatchCompressor();
+  EXPECT_TRUE(batch_compressor->Add(attributes_));
+  builder.AddInt64(words[full_size - 3], 2);
+  EXPECT_TRUE(batch_compressor->Add(attributes_));
+  auto report_pb = batch_compressor->Finish();
+  EXPECT_EQ(report_pb->global_word_count(), full_size);
+  std::set<std::string> decoded = DecodeWords(*report_pb);
+
+  // Encoded with the current dictionary.
+  EXPECT_FALSE(compressor.Reencode(report_pb.get()));
+
+  compressor.ShrinkGlobalDictionary();
+  ASSERT_TRUE(compressor.Reencode(report_pb.get()));
+  EXPECT_EQ(report_pb->global_word_count(), base_size);
+  EXPECT_EQ(DecodeWords(*report_pb), decoded);
+  // Each removed word is added once.
+  std::set<std::string> default_words(report_pb->default_words().begin(),
+                                      report_pb->default_words().end());
+  EXPECT_EQ(default_words.size(), report_pb->default_words_size());
+  EXPECT_GE(report_pb->default_words_size(), 4);
+  EXPECT_FALSE(compressor.Reencode(report_pb.get()));
+}
+
+TEST_F(AttributeCompressorTest, ShrinkConcurrentlyTest) {
+  const std::vector<std::string>& words = GetGlobalWords();
+  std::vector<Attributes> reports(4);
+  std::set<std::string> expected;
+  for (size_t i = 0; i < reports.size(); ++i) {
+    AttributesBuilder builder(&reports[i]);
+    for (size_t j = 0; j < 8; ++j) {
+      // Spread over the whole dictionary, the last words first.
+      const std::string& name = words[words.size() - 1 - j * 13 % words.size()];
+      const std::string& value = words[(i * 31 + j * 7) % words.size()];
+      builder.AddString(name, value);
+      expected.insert(name + "=" + value);
+    }
+    builder.AddInt64("count", i);
+    expected.insert("count");
+  }
+
+  const int kThreads = 4;
+  const int kIterations = 20;
+  for (int iteration = 0; iteration < kIterations; ++iteration) {
+    AttributeCompressor compressor;
+    std::atomic<int> batches(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+      threads.emplace_back([&, t]() {
+        for (int n = 0; n < 50; ++n) {
+          auto batch_compressor =
+              compressor.CreateBatchCompressor(nullptr, (t + n) % 2 == 0);
+          for (const auto& report : reports) {
+            EXPECT_TRUE(batch_compressor->Add(report));
+          }
+          std::unique_ptr<::istio::mixer::v1::ReportRequest> report_pb =
+              batch_compressor->Finish();
+          // Every index must be decoded with the recorded dictionary size,
+          // before and after it is encoded again.
+          std::set<std::string> decoded = DecodeWords(*report_pb);
+          std::set<std::string> all_words = decoded;
+          compressor.Reencode(report_pb.get());
+          EXPECT_LE(report_pb->global_word_count(),
+                    compressor.global_word_count());
+          EXPECT_EQ(DecodeWords(*report_pb), decoded);
+          for (const auto& word : expected) {
+            all_words.erase(word);
+          }
+          EXPECT_TRUE(all_words.empty());
+          ++batches;
+        }
+      });
+    }
+    // Shrinks while the batches are built.
+    while (batches < iteration % 10 * 20) {
+      std::this_thread::yield();
+    }
+    compressor.ShrinkGlobalDictionary();
+    for (auto& thread : threads) {
+      thread.join();
+    }
+  }
+}
+
 }  // namespace
 }  // namespace mixer_client
 }  // namespace istio
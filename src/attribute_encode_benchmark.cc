@@ -0,0 +1,139 @@
+/* Copyright 2018 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the cost of compressing and serializing attributes, building
+// the messages and serializing them, against encoding them directly.
+// Usage: bazel run -c opt //:attribute_encode_benchmark
+
+#include "include/attributes_builder.h"
+#include "src/attribute_compressor.h"
+
+#include <stdio.h>
+#include <chrono>
+#include <vector>
+
+using ::istio::mixer::v1::Attributes;
+using ::istio::mixer::v1::CompressedAttributes;
+
+namespace istio {
+namespace mixer_client {
+namespace {
+
+const int kNumReports = 100000;
+const int kNumVariants = 16;
+const int kBatchSize = 100;
+
+std::vector<Attributes> CreateReports() {
+  std::vector<Attributes> reports;
+  for (int i = 0; i < kNumVariants; ++i) {
+    Attributes attributes;
+    AttributesBuilder builder(&attributes);
+    builder.AddString("target.service",
+                      "productpage.default.svc.cluster.local");
+    builder.AddString("target.name", "productpage-v1-6f7b9c7d5d-8xk2p");
+    builder.AddString("source.name", "reviews-v1-5b7b7f7d8c-x2lqf");
+    builder.AddBytes("source.ip", std::string("\x0a\x00\x00\x0c", 4));
+    builder.AddString("request.method", "GET");
+    builder.AddString("request.path", "/productpage?id=" + std::to_string(i));
+    builder.AddInt64("response.code", i % 8 == 0 ? 503 : 200);
+    builder.AddInt64("response.size", 4096 + i);
+    builder.AddDouble("request.sample_rate", 0.5);
+    builder.AddDuration("response.duration", std::chrono::microseconds(i));
+    // A fixed time, so the runs encode the same bytes.
+    builder.AddTimestamp("request.time",
+                         std::chrono::system_clock::time_point(
+                             std::chrono::seconds(1500000000 + i)));
+    builder.AddBool("connection.mtls", true);
+    builder.AddStringMap("request.headers", {{":method", "GET"},
+                                             {":path", "/productpage"},
+                                             {"user-agent", "curl/7.54.0"},
+                                             {"x-request-id", "abc"}});
+    reports.push_back(attributes);
+  }
+  return reports;
+}
+
+// The result of one run, bytes are counted so the work isn't optimized out.
+struct Result {
+  double ns_per_report;
+  size_t bytes;
+};
+
+template <class Func>
+Result Run(Func encode) {
+  std::vector<Attributes> reports = CreateReports();
+  size_t bytes = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kNumReports; ++i) {
+    bytes += encode(reports[i % kNumVariants], i);
+  }
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return {elapsed.count() / kNumReports, bytes};
+}
+
+}  // namespace
+}  // namespace mixer_client
+}  // namespace istio
+
+int main(int argc, char** argv) {
+  using namespace ::istio::mixer_client;
+  AttributeCompressor compressor;
+  std::string serialized;
+
+  Result message = Run([&](const Attributes& attributes, int) -> size_t {
+    CompressedAttributes pb;
+    compressor.Compress(attributes, &pb);
+    pb.SerializeToString(&serialized);
+    return serialized.size();
+  });
+  Result direct = Run([&](const Attributes& attributes, int) -> size_t {
+    compressor.CompressToString(attributes, &serialized);
+    return serialized.size();
+  });
+
+  // A batch is serialized when it is full, its size is counted once.
+  std::unique_ptr<BatchCompressor> batch;
+  auto batch_run = [&](bool serialize) {
+    return Run([&](const Attributes& attributes, int i) -> size_t {
+      if (!batch) {
+        batch = compressor.CreateBatchCompressor(nullptr, serialize);
+      }
+      batch->Add(attributes);
+      if ((i + 1) % kBatchSize != 0) {
+        return 0;
+      }
+      if (serialize) {
+        batch->FinishSerialized(&serialized);
+      } else {
+        batch->Finish()->SerializeToString(&serialized);
+      }
+      batch.reset();
+      return serialized.size();
+    });
+  };
+  Result batch_message = batch_run(false);
+  Result batch_direct = batch_run(true);
+
+  printf("%16s %16s %16s\n", "impl", "ns/report", "bytes");
+  printf("%16s %16.1f %16zu\n", "message", message.ns_per_report,
+         message.bytes);
+  printf("%16s %16.1f %16zu\n", "direct", direct.ns_per_report, direct.bytes);
+  printf("%16s %16.1f %16zu\n", "batch message", batch_message.ns_per_report,
+         batch_message.bytes);
+  printf("%16s %16.1f %16zu\n", "batch direct", batch_direct.ns_per_report,
+         batch_direct.bytes);
+  return 0;
+}
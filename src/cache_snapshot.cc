@@ -0,0 +1,160 @@
+/* Copyright 2018 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/cache_snapshot.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using ::google::protobuf::StringPiece;
+using ::google::protobuf::util::Status;
+using ::google::protobuf::util::error::Code;
+
+namespace istio {
+namespace mixer_client {
+namespace {
+
+const char kMagic[] = "MXSNAP";
+const size_t kMagicLength = sizeof(kMagic) - 1;
+// Increase it if the layout is changed.
+const uint32_t kVersion = 1;
+
+}  // namespace
+
+SnapshotWriter::SnapshotWriter() {
+  buffer_.append(kMagic, kMagicLength);
+  PutUint32(kVersion);
+}
+
+void SnapshotWriter::PutUint32(uint32_t value) {
+  buffer_.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+void SnapshotWriter::PutUint64(uint64_t value) {
+  buffer_.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+void SnapshotWriter::PutString(const StringPiece &value) {
+  PutUint32(value.size());
+  buffer_.append(value.data(), value.size());
+}
+
+Status SnapshotWriter::WriteFile(const std::string &path) const {
+  std::string tmp_path = path + ".tmp";
+  FILE *file = fopen(tmp_path.c_str(), "wb");
+  if (file == nullptr) {
+    return Status(Code::UNAVAILABLE, "Failed to create " + tmp_path);
+  }
+  bool ok = fwrite(buffer_.data(), 1, buffer_.size(), file) == buffer_.size();
+  ok = (fclose(file) == 0) && ok;
+  if (!ok || rename(tmp_path.c_str(), path.c_str()) != 0) {
+    unlink(tmp_path.c_str());
+    return Status(Code::UNAVAILABLE, "Failed to write " + path);
+  }
+  return Status::OK;
+}
+
+SnapshotReader::SnapshotReader(const char *data, size_t size, bool mapped)
+    : data_(data), size_(size), pos_(0), mapped_(mapped) {}
+
+SnapshotReader::~SnapshotReader() {
+  if (mapped_) {
+    munmap(const_cast<char *>(data_), size_);
+  }
+}
+
+Status SnapshotReader::Open(const std::string &path,
+                            std::unique_ptr<SnapshotReader> *reader) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return Status(Code::NOT_FOUND, "Failed to open " + path);
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    return Status(Code::DATA_LOSS, "Empty snapshot " + path);
+  }
+  void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping stays valid after the file is closed.
+  close(fd);
+  if (data == MAP_FAILED) {
+    return Status(Code::UNAVAILABLE, "Failed to map " + path);
+  }
+  reader->reset(
+      new SnapshotReader(static_cast<const char *>(data), st.st_size, true));
+  return (*reader)->ReadHeader();
+}
+
+Status SnapshotReader::FromBuffer(const StringPiece &buffer,
+                                  std::unique_ptr<SnapshotReader> *reader) {
+  reader->reset(new SnapshotReader(buffer.data(), buffer.size(), false));
+  return (*reader)->ReadHeader();
+}
+
+Status SnapshotReader::ReadHeader() {
+  uint32_t version = 0;
+  if (size_ < kMagicLength || memcmp(data_, kMagic, kMagicLength) != 0) {
+    return Status(Code::DATA_LOSS, "Not a cache snapshot");
+  }
+  pos_ = kMagicLength;
+  if (!GetUint32(&version) || version != kVersion) {
+    return Status(Code::DATA_LOSS, "Unsupported cache snapshot version");
+  }
+  return Status::OK;
+}
+
+bool SnapshotReader::GetUint32(uint32_t *value) {
+  if (size_ - pos_ < sizeof(*value)) {
+    return false;
+  }
+  memcpy(value, data_ + pos_, sizeof(*value));
+  pos_ += sizeof(*value);
+  return true;
+}
+
+bool SnapshotReader::GetUint64(uint64_t *value) {
+  if (size_ - pos_ < sizeof(*value)) {
+    return false;
+  }
+  memcpy(value, data_ + pos_, sizeof(*value));
+  pos_ += sizeof(*value);
+  return true;
+}
+
+bool SnapshotReader::GetInt64(int64_t *value) {
+  uint64_t data;
+  if (!GetUint64(&data)) {
+    return false;
+  }
+  *value = static_cast<int64_t>(data);
+  return true;
+}
+
+bool SnapshotReader::GetString(StringPiece *value) {
+  uint32_t size;
+  if (!GetUint32(&size) || size_ - pos_ < size) {
+    return false;
+  }
+  *value = StringPiece(data_ + pos_, size);
+  pos_ += size;
+  return true;
+}
+
+}  // namespace mixer_client
+}  // namespace istio
@@ -0,0 +1,93 @@
+/* Copyright 2018 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIXER_CLIENT_CACHE_SNAPSHOT_H_
+#define MIXER_CLIENT_CACHE_SNAPSHOT_H_
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+
+#include "google/protobuf/stubs/status.h"
+#include "google/protobuf/stubs/stringpiece.h"
+
+namespace istio {
+namespace mixer_client {
+
+// The snapshot file of the check cache is a flat sequence of fixed size
+// integers in host byte order and length prefixed strings, so it can be
+// read in place from a memory mapped file. It is meant to be restored on
+// the same host, e.g. after a restart. Its layout:
+//   header:  magic "MXSNAP", uint32 version
+//   check cache:  uint32 hash, uint64 seed, Referenced list, entry list
+// The quota cache is not saved.
+
+// Writes a snapshot into a memory buffer, then into a file.
+class SnapshotWriter {
+ public:
+  SnapshotWriter();
+
+  void PutUint32(uint32_t value);
+  void PutUint64(uint64_t value);
+  void PutInt64(int64_t value) { PutUint64(static_cast<uint64_t>(value)); }
+  void PutString(const ::google::protobuf::StringPiece& value);
+
+  // Writes the buffer into a temporary file, then renames it to path,
+  // so a reader never sees a partial file.
+  ::google::protobuf::util::Status WriteFile(const std::string& path) const;
+
+  const std::string& buffer() const { return buffer_; }
+
+ private:
+  std::string buffer_;
+};
+
+// Reads a snapshot from a memory mapped file. Strings returned by
+// GetString() point into the mapping, they are valid while the reader is.
+// All Get functions return false at the end of data.
+class SnapshotReader {
+ public:
+  ~SnapshotReader();
+
+  // Maps the file and verifies its header.
+  static ::google::protobuf::util::Status Open(
+      const std::string& path, std::unique_ptr<SnapshotReader>* reader);
+
+  // Reads from a buffer instead of a file, the buffer is not copied.
+  static ::google::protobuf::util::Status FromBuffer(
+      const ::google::protobuf::StringPiece& buffer,
+      std::unique_ptr<SnapshotReader>* reader);
+
+  bool GetUint32(uint32_t* value);
+  bool GetUint64(uint64_t* value);
+  bool GetInt64(int64_t* value);
+  bool GetString(::google::protobuf::StringPiece* value);
+
+ private:
+  SnapshotReader(const char* data, size_t size, bool mapped);
+
+  ::google::protobuf::util::Status ReadHeader();
+
+  const char* data_;
+  size_t size_;
+  size_t pos_;
+  // If data_ is mapped from a file, to be unmapped.
+  bool mapped_;
+};
+
+}  // namespace mixer_client
+}  // namespace istio
+
+#endif  // MIXER_CLIENT_CACHE_SNAPSHOT_H_
@@ -0,0 +1,130 @@
+/* Copyright 2018 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the startup latency of a mixer client with a cold check cache,
+// and with a check cache restored from a snapshot.
+// Usage: bazel run -c opt //:cache_snapshot_benchmark
+
+#include "include/attributes_builder.h"
+#include "include/client.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using ::istio::mixer::v1::Attributes;
+using ::istio::mixer::v1::CheckRequest;
+using ::istio::mixer::v1::CheckResponse;
+using ::istio::mixer::v1::ReferencedAttributes;
+using ::google::protobuf::util::Status;
+
+namespace istio {
+namespace mixer_client {
+namespace {
+
+const int kNumKeys = 2000;
+// The simulated latency of a remote check call.
+const std::chrono::microseconds kRemoteLatency(500);
+
+// A transport responding after kRemoteLatency, keyed on target.service.
+CancelFunc FakeTransport(const CheckRequest& request, CheckResponse* response,
+                         DoneFunc on_done) {
+  std::this_thread::sleep_for(kRemoteLatency);
+  response->mutable_precondition()->set_valid_use_count(-1);
+  auto match = response->mutable_precondition()
+                   ->mutable_referenced_attributes()
+                   ->add_attribute_matches();
+  match->set_condition(ReferencedAttributes::EXACT);
+  match->set_name(9);  // target.service
+  on_done(Status::OK);
+  return nullptr;
+}
+
+MixerClientOptions CreateOptions(const std::string& snapshot_path) {
+  // Room for all keys, even with unevenly filled cache shards.
+  MixerClientOptions options(CheckOptions(2 * kNumKeys),
+                             ReportOptions(1000, 1000),
+                             QuotaOptions(10000, 600000));
+  options.env.check_transport = FakeTransport;
+  options.snapshot_path = snapshot_path;
+  return options;
+}
+
+// Sends one check per request, returns elapsed milliseconds.
+double RunChecks(MixerClient* client, const std::vector<Attributes>& requests) {
+  std::vector<::istio::quota::Requirement> no_quotas;
+  auto start = std::chrono::steady_clock::now();
+  for (const auto& request : requests) {
+    client->Check(request, no_quotas, nullptr, [](const Status& status) {});
+  }
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+uint64_t RemoteChecks(const MixerClient& client) {
+  Statistics stat;
+  client.GetStatistics(&stat);
+  return stat.total_blocking_remote_check_calls;
+}
+
+}  // namespace
+}  // namespace mixer_client
+}  // namespace istio
+
+int main(int argc, char** argv) {
+  using namespace ::istio::mixer_client;
+  const char* dir = getenv("TEST_TMPDIR");
+  std::string path = std::string(dir ? dir : "/tmp") + "/mixer_cache_snapshot";
+
+  std::vector<Attributes> requests(kNumKeys);
+  for (int i = 0; i < kNumKeys; ++i) {
+    AttributesBuilder builder(&requests[i]);
+    builder.AddString("target.service", "service-" + std::to_string(i));
+    builder.AddString("source.name", "source-name");
+  }
+
+  auto cold_client = CreateMixerClient(CreateOptions(""));
+  double cold_ms = RunChecks(cold_client.get(), requests);
+  uint64_t cold_remote = RemoteChecks(*cold_client);
+
+  auto start = std::chrono::steady_clock::now();
+  if (!cold_client->SaveSnapshot(path).ok()) {
+    fprintf(stderr, "Failed to save snapshot to %s\n", path.c_str());
+    return 1;
+  }
+  std::chrono::duration<double, std::milli> save_ms =
+      std::chrono::steady_clock::now() - start;
+
+  start = std::chrono::steady_clock::now();
+  auto warm_client = CreateMixerClient(CreateOptions(path));
+  std::chrono::duration<double, std::milli> load_ms =
+      std::chrono::steady_clock::now() - start;
+  double warm_ms = RunChecks(warm_client.get(), requests);
+  uint64_t warm_remote = RemoteChecks(*warm_client);
+
+  printf("%d keys, %lld us per remote check, snapshot save %.2f ms\n",
+         kNumKeys, static_cast<long long>(kRemoteLatency.count()),
+         save_ms.count());
+  printf("%6s %12s %12s %16s\n", "start", "load ms", "first ms",
+         "blocking calls");
+  printf("%6s %12.2f %12.2f %16llu\n", "cold", 0.0, cold_ms,
+         static_cast<unsigned long long>(cold_remote));
+  printf("%6s %12.2f %12.2f %16llu\n", "warm", load_ms.count(), warm_ms,
+         static_cast<unsigned long long>(warm_remote));
+  return 0;
+}
@@ -0,0 +1,100 @@
+/* Copyright 2018 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/cache_snapshot.h"
+
+#include <stdlib.h>
+
+#include "gtest/gtest.h"
+#include "utils/status_test_util.h"
+
+using ::google::protobuf::StringPiece;
+using ::google::protobuf::util::Status;
+using ::google::protobuf::util::error::Code;
+
+namespace istio {
+namespace mixer_client {
+namespace {
+
+std::string TempPath(const std::string& name) {
+  const char* dir = getenv("TEST_TMPDIR");
+  return std::string(dir ? dir : "/tmp") + "/" + name;
+}
+
+void WriteValues(SnapshotWriter* writer) {
+  writer->PutUint32(7);
+  writer->PutUint64(0x123456789ULL);
+  writer->PutInt64(-5);
+  writer->PutString("hello");
+  writer->PutString("");
+}
+
+void VerifyValues(SnapshotReader* reader) {
+  uint32_t u32;
+  uint64_t u64;
+  int64_t i64;
+  StringPiece str;
+  ASSERT_TRUE(reader->GetUint32(&u32));
+  EXPECT_EQ(u32, 7);
+  ASSERT_TRUE(reader->GetUint64(&u64));
+  EXPECT_EQ(u64, 0x123456789ULL);
+  ASSERT_TRUE(reader->GetInt64(&i64));
+  EXPECT_EQ(i64, -5);
+  ASSERT_TRUE(reader->GetString(&str));
+  EXPECT_EQ(str.ToString(), "hello");
+  ASSERT_TRUE(reader->GetString(&str));
+  EXPECT_TRUE(str.empty());
+  // At the end.
+  EXPECT_FALSE(reader->GetUint32(&u32));
+}
+
+TEST(CacheSnapshotTest, TestBuffer) {
+  SnapshotWriter writer;
+  WriteValues(&writer);
+  std::unique_ptr<SnapshotReader> reader;
+  EXPECT_OK(SnapshotReader::FromBuffer(writer.buffer(), &reader));
+  VerifyValues(reader.get());
+}
+
+TEST(CacheSnapshotTest, TestFile) {
+  std::string path = TempPath("cache_snapshot_test");
+  SnapshotWriter writer;
+  WriteValues(&writer);
+  EXPECT_OK(writer.WriteFile(path));
+
+  std::unique_ptr<SnapshotReader> reader;
+  EXPECT_OK(SnapshotReader::Open(path, &reader));
+  VerifyValues(reader.get());
+
+  EXPECT_ERROR_CODE(Code::NOT_FOUND,
+                    SnapshotReader::Open(path + ".missing", &reader));
+}
+
+TEST(CacheSnapshotTest, TestInvalidData) {
+  std::unique_ptr<SnapshotReader> reader;
+  EXPECT_ERROR_CODE(Code::DATA_LOSS,
+                    SnapshotReader::FromBuffer("not a snapshot", &reader));
+
+  SnapshotWriter writer;
+  writer.PutString("truncated");
+  std::string truncated = writer.buffer().substr(0, writer.buffer().size() - 1);
+  EXPECT_OK(SnapshotReader::FromBuffer(truncated, &reader));
+  StringPiece str;
+  EXPECT_FALSE(reader->GetString(&str));
+}
+
+}  // namespace
+}  // namespace mixer_client
+}  // namespace istio
@@ -14,30 +14,68 @@
  */
 
 #include "src/check_cache.h"
+#include "utils/fast_hash.h"
 #include "utils/protobuf.h"
 
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+
 using namespace std::chrono;
 using ::istio::mixer::v1::Attributes;
 using ::istio::mixer::v1::CheckResponse;
+using ::google::protobuf::StringPiece;
 using ::google::protobuf::util::Status;
 using ::google::protobuf::util::error::Code;
 
 namespace istio {
 namespace mixer_client {
+namespace {
+
+// Times are saved in snapshots as milliseconds since epoch.
+const int64_t kSnapshotTimeMax = INT64_MAX;
+
+int64_t ToSnapshotTime(time_point<system_clock> time) {
+  if (time == time_point<system_clock>::max()) {
+    return kSnapshotTimeMax;
+  }
+  return duration_cast<milliseconds>(time.time_since_epoch()).count();
+}
+
+time_point<system_clock> FromSnapshotTime(int64_t time) {
+  if (time == kSnapshotTimeMax) {
+    return time_point<system_clock>::max();
+  }
+  return time_point<system_clock>(milliseconds(time));
+}
+
+}  // namespace
 
 void CheckCache::CacheElem::CacheElem::SetResponse(
     const CheckResponse &response, Tick time_now) {
+  refreshing_ = false;
+  refresh_time_ = time_point<system_clock>::max();
+  refresh_use_count_ = -1;
   if (response.has_precondition()) {
     status_ = parent_.ConvertRpcStatus(response.precondition().status());
 
+    const double fraction = parent_.options_.refresh_ahead_fraction;
     if (response.precondition().has_valid_duration()) {
-      expire_time_ =
-          time_now + ToMilliseonds(response.precondition().valid_duration());
+      milliseconds duration =
+          ToMilliseonds(response.precondition().valid_duration());
+      expire_time_ = time_now + duration;
+      if (fraction > 0) {
+        refresh_time_ = expire_time_ - duration_cast<milliseconds>(
+                                           duration * fraction);
+      }
     } else {
       // never expired.
       expire_time_ = time_point<system_clock>::max();
     }
     use_count_ = response.precondition().valid_use_count();
+    if (fraction > 0 && use_count_ > 0) {
+      refresh_use_count_ = static_cast<int>(use_count_ * fraction);
+    }
   } else {
     status_ = Status(Code::INVALID_ARGUMENT,
                      "CheckResponse doesn't have PreconditionResult");
@@ -57,15 +95,39 @@ bool CheckCache::CacheElem::CacheElem::IsExpired(Tick time_now) {
   return false;
 }
 
+// check if the item should be refreshed, only once until a new response.
+bool CheckCache::CacheElem::CacheElem::NeedRefresh(Tick time_now) {
+  if (refreshing_) {
+    return false;
+  }
+  if (time_now >= refresh_time_ ||
+      (use_count_ >= 0 && use_count_ <= refresh_use_count_)) {
+    refreshing_ = true;
+  }
+  return refreshing_;
+}
+
 CheckCache::CheckResult::CheckResult() : status_(Code::UNAVAILABLE, "") {}
 
 bool CheckCache::CheckResult::IsCacheHit() const {
   return status_.error_code() != Code::UNAVAILABLE;
 }
 
-CheckCache::CheckCache(const CheckOptions &options) : options_(options) {
+CheckCache::CheckCache(const CheckOptions &options)
+    : options_(options),
+      hash_seed_(FastHash::RandomSeed()),
+      referenced_index_(nullptr),
+      total_lookups_(0),
+      total_referenced_evaluated_(0) {
   if (options.num_entries > 0) {
-    cache_.reset(new CheckLRUCache(options.num_entries));
+    int num_shards = std::max(1, std::min(options.num_shards,
+                                          options.num_entries));
+    int shard_entries = (options.num_entries + num_shards - 1) / num_shards;
+    for (int i = 0; i < num_shards; ++i) {
+      std::unique_ptr<CacheShard> shard(new CacheShard);
+      shard->cache.reset(new CheckLRUCache(shard_entries));
+      shards_.push_back(std::move(shard));
+    }
   }
 }
 
@@ -75,57 +137,98 @@ CheckCache::~CheckCache() {
 }
 
 void CheckCache::Check(const Attributes &attributes, CheckResult *result) {
-  Status status = Check(attributes, system_clock::now());
+  Status status = Check(attributes, system_clock::now(), result);
   if (status.error_code() != Code::NOT_FOUND) {
     result->status_ = status;
   }
+  result->cache_ = this;
+}
 
-  result->on_response_ = [this](const Status &status,
-                                const Attributes &attributes,
-                                const CheckResponse &response) -> Status {
-    if (!status.ok()) {
-      if (options_.network_fail_open) {
-        return Status::OK;
-      } else {
-        return status;
-      }
+Status CheckCache::OnResponse(const Status &status,
+                              const Attributes &attributes,
+                              const CheckResponse &response,
+                              const SignatureKey *refresh_signature) {
+  if (!status.ok()) {
+    if (refresh_signature) {
+      RefreshFailed(*refresh_signature);
+    }
+    if (options_.network_fail_open) {
+      return Status::OK;
     } else {
-      return CacheResponse(attributes, response, system_clock::now());
+      return status;
     }
-  };
+  } else {
+    return CacheResponse(attributes, response, system_clock::now(),
+                         refresh_signature);
+  }
+}
+
+CheckCache::CacheShard &CheckCache::GetShard(const SignatureKey &signature) {
+  // Signatures are digests, any of their bits are evenly distributed.
+  uint32_t bits;
+  memcpy(&bits, signature.bytes, sizeof(bits));
+  return *shards_[bits % shards_.size()];
 }
 
-Status CheckCache::Check(const Attributes &attributes, Tick time_now) {
-  if (!cache_) {
+Status CheckCache::Check(const Attributes &attributes, Tick time_now,
+                         CheckResult *result) {
+  const ReferencedIndex *referenced_index =
+      referenced_index_.load(std::memory_order_acquire);
+  if (shards_.empty() || referenced_index == nullptr) {
     // By returning NOT_FOUND, caller will send request to server.
     return Status(Code::NOT_FOUND, "");
   }
 
-  for (const auto &it : referenced_map_) {
-    const Referenced &reference = it.second;
-    std::string signature;
-    if (!reference.Signature(attributes, "", &signature)) {
-      continue;
-    }
+  Status status(Code::NOT_FOUND, "");
+  int evaluated = referenced_index->Lookup(
+      attributes, [this, &attributes, time_now, &status,
+                   result](const Referenced &reference) -> bool {
+        SignatureKey signature;
+        if (!reference.Signature(attributes, "", options_.cache_key_hash,
+                                 hash_seed_, &signature)) {
+          return false;
+        }
 
-    std::lock_guard<std::mutex> lock(cache_mutex_);
-    CheckLRUCache::ScopedLookup lookup(cache_.get(), signature);
-    if (lookup.Found()) {
-      CacheElem *elem = lookup.value();
-      if (elem->IsExpired(time_now)) {
-        cache_->Remove(signature);
-        return Status(Code::NOT_FOUND, "");
-      }
-      return elem->status();
-    }
-  }
+        CacheShard &shard = GetShard(signature);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        CheckLRUCache::ScopedLookup lookup(shard.cache.get(), signature);
+        if (!lookup.Found()) {
+          if (result && !result->has_signature_) {
+            result->signature_ = signature;
+            result->has_signature_ = true;
+          }
+          return false;
+        }
+        CacheElem *elem = lookup.value();
+        if (elem->IsExpired(time_now)) {
+          shard.cache->Remove(signature);
+          if (result) {
+            result->signature_ = signature;
+            result->has_signature_ = true;
+          }
+        } else {
+          status = elem->status();
+          if (result && elem->NeedRefresh(time_now)) {
+            result->signature_ = signature;
+            result->has_signature_ = true;
+            result->need_refresh_ = true;
+          }
+        }
+        return true;
+      });
 
-  return Status(Code::NOT_FOUND, "");
+  ++total_lookups_;
+  total_referenced_evaluated_ += evaluated;
+  return status;
 }
 
 Status CheckCache::CacheResponse(const Attributes &attributes,
-                                 const CheckResponse &response, Tick time_now) {
-  if (!cache_ || !response.has_precondition()) {
+                                 const CheckResponse &response, Tick time_now,
+                                 const SignatureKey *refresh_signature) {
+  if (shards_.empty() || !response.has_precondition()) {
+    if (refresh_signature) {
+      RefreshFailed(*refresh_signature);
+    }
     if (response.has_precondition()) {
       return ConvertRpcStatus(response.precondition().status());
     } else {
@@ -138,41 +241,216 @@ Status CheckCache::CacheResponse(const Attributes &attributes,
   if (!referenced.Fill(attributes,
                        response.precondition().referenced_attributes())) {
     // Failed to decode referenced_attributes, not to cache this result.
+    if (refresh_signature) {
+      RefreshFailed(*refresh_signature);
+    }
     return ConvertRpcStatus(response.precondition().status());
   }
-  std::string signature;
-  if (!referenced.Signature(attributes, "", &signature)) {
+  SignatureKey signature;
+  if (!referenced.Signature(attributes, "", options_.cache_key_hash,
+                           hash_seed_, &signature)) {
     GOOGLE_LOG(ERROR) << "Response referenced mismatchs with request";
     GOOGLE_LOG(ERROR) << "Request attributes: " << attributes.DebugString();
     GOOGLE_LOG(ERROR) << "Referenced attributes: " << referenced.DebugString();
+    if (refresh_signature) {
+      RefreshFailed(*refresh_signature);
+    }
     return ConvertRpcStatus(response.precondition().status());
   }
 
-  std::lock_guard<std::mutex> lock(cache_mutex_);
-  std::string hash = referenced.Hash();
-  if (referenced_map_.find(hash) == referenced_map_.end()) {
-    referenced_map_[hash] = referenced;
-    GOOGLE_LOG(INFO) << "Add a new Referenced for check cache: "
-                     << referenced.DebugString();
+  {
+    std::lock_guard<std::mutex> lock(referenced_mutex_);
+    if (AddReferenced(std::move(referenced))) {
+      PublishReferencedIndex();
+    }
+  }
+
+  // The response is cached under another signature, the refreshed entry
+  // is left as it was; allow it to be refreshed again.
+  if (refresh_signature && !(*refresh_signature == signature)) {
+    RefreshFailed(*refresh_signature);
   }
 
-  CheckLRUCache::ScopedLookup lookup(cache_.get(), signature);
+  CacheShard &shard = GetShard(signature);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  CheckLRUCache::ScopedLookup lookup(shard.cache.get(), signature);
   if (lookup.Found()) {
     lookup.value()->SetResponse(response, time_now);
     return lookup.value()->status();
   }
 
   CacheElem *cache_elem = new CacheElem(*this, response, time_now);
-  cache_->Insert(signature, cache_elem, 1);
+  shard.cache->Insert(signature, cache_elem, 1);
   return cache_elem->status();
 }
 
+void CheckCache::RefreshFailed(const SignatureKey &signature) {
+  if (shards_.empty()) {
+    return;
+  }
+  CacheShard &shard = GetShard(signature);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  CheckLRUCache::ScopedLookup lookup(shard.cache.get(), signature);
+  if (lookup.Found()) {
+    // Allow the next request to try again.
+    lookup.value()->ClearRefreshing();
+  }
+}
+
+bool CheckCache::AddReferenced(Referenced &&referenced) {
+  std::string hash = referenced.Hash();
+  if (referenced_map_.find(hash) != referenced_map_.end()) {
+    return false;
+  }
+  GOOGLE_LOG(INFO) << "Add a new Referenced for check cache: "
+                   << referenced.DebugString();
+  Referenced *new_referenced = new Referenced(std::move(referenced));
+  referenced_map_[hash].reset(new_referenced);
+  referenced_list_.push_back(new_referenced);
+  return true;
+}
+
+void CheckCache::PublishReferencedIndex() {
+  std::unique_ptr<ReferencedIndex> new_index(
+      new ReferencedIndex(referenced_list_));
+  referenced_index_.store(new_index.get(), std::memory_order_release);
+  referenced_indexes_.push_back(std::move(new_index));
+}
+
+void CheckCache::CacheElem::Save(SnapshotWriter *writer) const {
+  writer->PutInt64(ToSnapshotTime(expire_time_));
+  writer->PutInt64(ToSnapshotTime(refresh_time_));
+  writer->PutUint32(use_count_);
+  writer->PutUint32(refresh_use_count_);
+  writer->PutUint32(status_.error_code());
+  writer->PutString(status_.error_message());
+}
+
+bool CheckCache::CacheElem::Load(SnapshotReader *reader) {
+  int64_t expire_time;
+  int64_t refresh_time;
+  uint32_t use_count;
+  uint32_t refresh_use_count;
+  uint32_t code;
+  StringPiece message;
+  if (!reader->GetInt64(&expire_time) || !reader->GetInt64(&refresh_time) ||
+      !reader->GetUint32(&use_count) ||
+      !reader->GetUint32(&refresh_use_count) || !reader->GetUint32(&code) ||
+      !reader->GetString(&message)) {
+    return false;
+  }
+  expire_time_ = FromSnapshotTime(expire_time);
+  refresh_time_ = FromSnapshotTime(refresh_time);
+  use_count_ = static_cast<int>(use_count);
+  refresh_use_count_ = static_cast<int>(refresh_use_count);
+  refreshing_ = false;
+  status_ = Status(static_cast<Code>(code), message.ToString());
+  return true;
+}
+
+void CheckCache::SaveSnapshot(SnapshotWriter *writer) {
+  writer->PutUint32(static_cast<uint32_t>(options_.cache_key_hash));
+  writer->PutUint64(hash_seed_);
+  {
+    std::lock_guard<std::mutex> lock(referenced_mutex_);
+    writer->PutUint32(referenced_list_.size());
+    for (const Referenced *referenced : referenced_list_) {
+      referenced->Save(writer);
+    }
+  }
+
+  // Each entry is preceded by 1, the list ends with 0.
+  Tick time_now = system_clock::now();
+  for (const auto &shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard->mutex);
+    for (auto it = shard->cache->begin(); it != shard->cache->end(); ++it) {
+      if (it->second->IsExpiredAt(time_now)) {
+        continue;
+      }
+      writer->PutUint32(1);
+      writer->PutString(StringPiece(it->first.bytes, SignatureKey::kLength));
+      it->second->Save(writer);
+    }
+  }
+  writer->PutUint32(0);
+}
+
+bool CheckCache::Signature(const Referenced &referenced,
+                           const Attributes &attributes,
+                           SignatureKey *signature) const {
+  return referenced.Signature(attributes, "", options_.cache_key_hash,
+                              hash_seed_, signature);
+}
+
+bool CheckCache::LoadSnapshot(SnapshotReader *reader) {
+  uint32_t hash;
+  uint64_t seed;
+  uint32_t num_referenced;
+  if (!reader->GetUint32(&hash) || !reader->GetUint64(&seed) ||
+      !reader->GetUint32(&num_referenced)) {
+    return false;
+  }
+  // Signatures are only valid with the same hash function and seed.
+  bool same_hash = hash == static_cast<uint32_t>(options_.cache_key_hash);
+  if (same_hash) {
+    hash_seed_ = seed;
+  }
+
+  bool ok = true;
+  {
+    std::lock_guard<std::mutex> lock(referenced_mutex_);
+    size_t num_learned = referenced_list_.size();
+    for (uint32_t i = 0; i < num_referenced; ++i) {
+      Referenced referenced;
+      if (!referenced.Load(reader)) {
+        ok = false;
+        break;
+      }
+      AddReferenced(std::move(referenced));
+    }
+    if (referenced_list_.size() != num_learned) {
+      PublishReferencedIndex();
+    }
+  }
+  if (!ok) {
+    return false;
+  }
+
+  Tick time_now = system_clock::now();
+  uint32_t more;
+  while (true) {
+    if (!reader->GetUint32(&more)) {
+      return false;
+    }
+    if (more == 0) {
+      return true;
+    }
+    StringPiece signature;
+    std::unique_ptr<CacheElem> elem(new CacheElem(*this));
+    if (!reader->GetString(&signature) ||
+        signature.size() != SignatureKey::kLength || !elem->Load(reader)) {
+      return false;
+    }
+    if (!same_hash || shards_.empty() || elem->IsExpiredAt(time_now)) {
+      continue;
+    }
+    SignatureKey key;
+    memcpy(key.bytes, signature.data(), SignatureKey::kLength);
+    CacheShard &shard = GetShard(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    CheckLRUCache::ScopedLookup lookup(shard.cache.get(), key);
+    if (!lookup.Found()) {
+      shard.cache->Insert(key, elem.release(), 1);
+    }
+  }
+}
+
 // Flush out aggregated check requests, clear all cache items.
 // Usually called at destructor.
 Status CheckCache::FlushAll() {
-  if (cache_) {
-    std::lock_guard<std::mutex> lock(cache_mutex_);
-    cache_->RemoveAll();
+  for (const auto &shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard->mutex);
+    shard->cache->RemoveAll();
   }
 
   return Status::OK;
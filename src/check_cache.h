@@ -18,16 +18,21 @@
 #ifndef MIXERCLIENT_CHECK_CACHE_H
 #define MIXERCLIENT_CHECK_CACHE_H
 
+#include <atomic>
 #include <chrono>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include "google/protobuf/stubs/status.h"
 #include "include/client.h"
 #include "include/options.h"
+#include "src/cache_snapshot.h"
 #include "src/referenced.h"
+#include "src/referenced_index.h"
 #include "utils/simple_lru_cache.h"
 #include "utils/simple_lru_cache_inl.h"
 
@@ -56,11 +61,23 @@ class CheckCache {
 
     ::google::protobuf::util::Status status() const { return status_; }
 
+    // For a cache miss or a refresh, the signature of the cache entry the
+    // response is likely to fill. Empty if no learned Referenced matches
+    // the request.
+    std::string signature() const {
+      return has_signature_ ? signature_.ToString() : std::string();
+    }
+
+    // For a cache hit, true if the entry is close to its expiration and
+    // this request was chosen to refresh it with a remote call.
+    bool need_refresh() const { return need_refresh_; }
+
     void SetResponse(const ::google::protobuf::util::Status& status,
                      const ::istio::mixer::v1::Attributes& attributes,
                      const ::istio::mixer::v1::CheckResponse& response) {
-      if (on_response_) {
-        status_ = on_response_(status, attributes, response);
+      if (cache_) {
+        status_ = cache_->OnResponse(status, attributes, response,
+                                     need_refresh_ ? &signature_ : nullptr);
       }
     }
 
@@ -69,31 +86,73 @@ class CheckCache {
     // Check status.
     ::google::protobuf::util::Status status_;
 
-    // The function to set check response.
-    using OnResponseFunc = std::function<::google::protobuf::util::Status(
-        const ::google::protobuf::util::Status&,
-        const ::istio::mixer::v1::Attributes& attributes,
-        const ::istio::mixer::v1::CheckResponse&)>;
-    OnResponseFunc on_response_;
+    // The cache to set the check response.
+    CheckCache* cache_ = nullptr;
+
+    // The cache signature for a cache miss or a refresh.
+    SignatureKey signature_;
+    bool has_signature_ = false;
+
+    // If the cache hit needs a refresh.
+    bool need_refresh_ = false;
   };
 
   void Check(const ::istio::mixer::v1::Attributes& attributes,
              CheckResult* result);
 
+  // Computes the cache signature of the attributes under referenced, with
+  // the hash function and seed of the cache entries.
+  bool Signature(const Referenced& referenced,
+                 const ::istio::mixer::v1::Attributes& attributes,
+                 SignatureKey* signature) const;
+
+  // Writes the learned Referenced and the unexpired cache entries, with
+  // their absolute expiration, into a snapshot.
+  void SaveSnapshot(SnapshotWriter* writer);
+
+  // Restores a snapshot written by SaveSnapshot(). It should be called
+  // before the cache is used. Expired entries are skipped. Returns false
+  // if the data is invalid; the items read before the error are kept.
+  bool LoadSnapshot(SnapshotReader* reader);
+
+  // Number of lookups made with learned Referenced.
+  uint64_t total_lookups() const { return total_lookups_; }
+  // Number of Referenced signatures evaluated by these lookups.
+  uint64_t total_referenced_evaluated() const {
+    return total_referenced_evaluated_;
+  }
+
  private:
   friend class CheckCacheTest;
   using Tick = std::chrono::time_point<std::chrono::system_clock>;
 
   // If the check could not be handled by the cache, returns NOT_FOUND,
-  // caller has to send the request to mixer.
+  // caller has to send the request to mixer. If result is not null, its
+  // signature is set for a missed or expired entry, or for a hit on an
+  // entry which should be refreshed, then need_refresh is set too.
   ::google::protobuf::util::Status Check(
-      const ::istio::mixer::v1::Attributes& request, Tick time_now);
+      const ::istio::mixer::v1::Attributes& request, Tick time_now,
+      CheckResult* result = nullptr);
+
+  // Handles the response of a remote check for CheckResult::SetResponse.
+  // refresh_signature is set if the call refreshed that entry.
+  ::google::protobuf::util::Status OnResponse(
+      const ::google::protobuf::util::Status& status,
+      const ::istio::mixer::v1::Attributes& attributes,
+      const ::istio::mixer::v1::CheckResponse& response,
+      const SignatureKey* refresh_signature);
+
+  // A refresh call for the entry of the signature failed.
+  void RefreshFailed(const SignatureKey& signature);
 
   // Caches a response from a remote mixer call.
   // Return the converted status from response.
+  // refresh_signature is set if the call refreshed that entry; if the
+  // response is not cached under it, the entry can be refreshed again.
   ::google::protobuf::util::Status CacheResponse(
       const ::istio::mixer::v1::Attributes& attributes,
-      const ::istio::mixer::v1::CheckResponse& response, Tick time_now);
+      const ::istio::mixer::v1::CheckResponse& response, Tick time_now,
+      const SignatureKey* refresh_signature = nullptr);
 
   // Flushes out all cached check responses; clears all cache items.
   // Usually called at destructor.
@@ -111,6 +170,19 @@ class CheckCache {
       SetResponse(response, time);
     }
 
+    // An empty item to be loaded from a snapshot.
+    CacheElem(const CheckCache& parent)
+        : parent_(parent), use_count_(0), refreshing_(false) {}
+
+    // Writes or reads the item for a snapshot.
+    void Save(SnapshotWriter* writer) const;
+    bool Load(SnapshotReader* reader);
+
+    // Check if the item is expired, without using it.
+    bool IsExpiredAt(Tick time_now) const {
+      return time_now > expire_time_ || use_count_ == 0;
+    }
+
     // Set the response
     void SetResponse(const ::istio::mixer::v1::CheckResponse& response,
                      Tick time_now);
@@ -118,6 +190,13 @@ class CheckCache {
     // Check if the item is expired.
     bool IsExpired(Tick time_now);
 
+    // Check if the item should be refreshed ahead of its expiration.
+    // Returns true only once until a new response is set.
+    bool NeedRefresh(Tick time_now);
+
+    // Clears the on-going refresh, after it failed.
+    void ClearRefreshing() { refreshing_ = false; }
+
     // getter for converted status from response.
     ::google::protobuf::util::Status status() const { return status_; }
 
@@ -132,27 +211,69 @@ class CheckCache {
     // if 0, cache item should not be used.
     // use_cound is decreased by 1 for each request,
     int use_count_;
+    // Refresh the item after this time.
+    std::chrono::time_point<std::chrono::system_clock> refresh_time_;
+    // Refresh the item once use_count_ drops to this value, -1 for never.
+    int refresh_use_count_;
+    // A refresh call is on-going.
+    bool refreshing_;
   };
 
   // Key is the signature of the Attributes. Value is the CacheElem.
   // It is a LRU cache with maximum size.
   // When the maximum size is reached, oldest idle items will be removed.
-  using CheckLRUCache = SimpleLRUCache<std::string, CacheElem>;
+  using CheckLRUCache =
+      SimpleLRUCache<SignatureKey, CacheElem, SignatureKey::Hash>;
+
+  // A cache shard holds the cache items whose signatures map to it.
+  struct CacheShard {
+    // Mutex guarding the access of cache.
+    std::mutex mutex;
+    // The cache that maps from operation signature to an operation.
+    // We don't calculate fine grained cost for cache entries, assign each
+    // entry 1 cost unit.
+    std::unique_ptr<CheckLRUCache> cache;
+  };
+
+  // Get the shard for a signature.
+  CacheShard& GetShard(const SignatureKey& signature);
 
   // The check options.
   CheckOptions options_;
 
+  // The seed for CacheKeyHash::FAST.
+  uint64_t hash_seed_;
+
+  // Mutex guarding the update of referenced_map_ and referenced_indexes_.
+  std::mutex referenced_mutex_;
+
   // Referenced map keyed with their hashes
-  std::unordered_map<std::string, Referenced> referenced_map_;
+  std::unordered_map<std::string, std::unique_ptr<Referenced>> referenced_map_;
+
+  // referenced_map_ values in the order they were learned.
+  std::vector<const Referenced*> referenced_list_;
+
+  // Referenced objects are never removed once learned. Lookups use an
+  // immutable index of them published through an atomic pointer, so they
+  // don't take any lock. All published indexes are kept alive since
+  // lookups may still use an old one. The last one is the current index.
+  std::vector<std::unique_ptr<ReferencedIndex>> referenced_indexes_;
+
+  // The current index of referenced_map_ values.
+  std::atomic<const ReferencedIndex*> referenced_index_;
+
+  // Adds a Referenced if it is new. Return true if it is added.
+  // referenced_mutex_ must be held.
+  bool AddReferenced(Referenced&& referenced);
+  // Publishes a new index of referenced_list_.
+  // referenced_mutex_ must be held.
+  void PublishReferencedIndex();
 
-  // Mutex guarding the access of cache_;
-  std::mutex cache_mutex_;
+  std::atomic_int_fast64_t total_lookups_;
+  std::atomic_int_fast64_t total_referenced_evaluated_;
 
-  // The cache that maps from operation signature to an operation.
-  // We don't calculate fine grained cost for cache entries, assign each
-  // entry 1 cost unit.
-  // Guarded by mutex_, except when compare against NULL.
-  std::unique_ptr<CheckLRUCache> cache_;
+  // The cache shards. Empty if cache is disabled.
+  std::vector<std::unique_ptr<CacheShard>> shards_;
 
   GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(CheckCache);
 };
@@ -0,0 +1,111 @@
+/* Copyright 2018 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures check cache hit throughput with multiple threads.
+// Usage: bazel run -c opt //:check_cache_benchmark
+
+#include "include/attributes_builder.h"
+#include "src/check_cache.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using ::istio::mixer::v1::Attributes;
+using ::istio::mixer::v1::CheckResponse;
+using ::istio::mixer::v1::ReferencedAttributes;
+using ::google::protobuf::util::Status;
+
+namespace istio {
+namespace mixer_client {
+namespace {
+
+const int kNumKeys = 1000;
+const int kChecksPerThread = 200000;
+
+// Creates a cache filled with kNumKeys keys, all keyed on target.service.
+std::unique_ptr<CheckCache> CreateCache(int num_shards,
+                                        std::vector<Attributes>* requests) {
+  CheckOptions options;
+  options.num_shards = num_shards;
+  std::unique_ptr<CheckCache> cache(new CheckCache(options));
+
+  CheckResponse response;
+  response.mutable_precondition()->set_valid_use_count(-1);
+  auto match = response.mutable_precondition()
+                   ->mutable_referenced_attributes()
+                   ->add_attribute_matches();
+  match->set_condition(ReferencedAttributes::EXACT);
+  match->set_name(9);  // target.service
+
+  requests->resize(kNumKeys);
+  for (int i = 0; i < kNumKeys; ++i) {
+    Attributes& request = (*requests)[i];
+    AttributesBuilder builder(&request);
+    builder.AddString("target.service", "service-" + std::to_string(i));
+    builder.AddString("source.name", "source-name");
+    builder.AddInt64("source.port", 8080);
+    CheckCache::CheckResult result;
+    cache->Check(request, &result);
+    result.SetResponse(Status::OK, request, response);
+  }
+  return cache;
+}
+
+// Returns cache hits per second with num_threads threads.
+double RunHits(CheckCache* cache, const std::vector<Attributes>& requests,
+               int num_threads) {
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (int t = 0; t < num_threads; ++t) {
+    threads.push_back(std::thread([cache, &requests, t]() {
+      for (int i = 0; i < kChecksPerThread; ++i) {
+        CheckCache::CheckResult result;
+        cache->Check(requests[(i * 7 + t) % requests.size()], &result);
+        if (!result.IsCacheHit()) {
+          fprintf(stderr, "Unexpected cache miss\n");
+          abort();
+        }
+      }
+    }));
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return num_threads * kChecksPerThread / elapsed.count();
+}
+
+}  // namespace
+}  // namespace mixer_client
+}  // namespace istio
+
+int main(int argc, char** argv) {
+  using namespace ::istio::mixer_client;
+  int max_threads = std::max(1u, std::thread::hardware_concurrency());
+  printf("%8s %8s %16s\n", "shards", "threads", "hits/sec");
+  for (int num_shards : {1, 16}) {
+    std::vector<::istio::mixer::v1::Attributes> requests;
+    auto cache = CreateCache(num_shards, &requests);
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+      printf("%8d %8d %16.0f\n", num_shards, threads,
+             RunHits(cache.get(), requests, threads));
+    }
+  }
+  return 0;
+}
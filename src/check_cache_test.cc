@@ -20,6 +20,8 @@
 #include "utils/protobuf.h"
 #include "utils/status_test_util.h"
 
+#include <thread>
+
 using namespace std::chrono;
 using ::istio::mixer::v1::Attributes;
 using ::istio::mixer::v1::CheckResponse;
@@ -60,10 +62,33 @@ class CheckCacheTest : public ::testing::Test {
   Status Check(const Attributes& request, time_point<system_clock> time_now) {
     return cache_->Check(request, time_now);
   }
+  // Returns true if the check is a hit that needs a refresh.
+  bool CheckRefresh(const Attributes& request,
+                    time_point<system_clock> time_now,
+                    std::string* signature = nullptr) {
+    CheckCache::CheckResult result;
+    EXPECT_OK(cache_->Check(request, time_now, &result));
+    EXPECT_EQ(result.need_refresh(), !result.signature().empty());
+    if (signature) {
+      *signature = result.signature();
+    }
+    return result.need_refresh();
+  }
+  void RefreshFailed(const std::string& signature) {
+    SignatureKey key;
+    memcpy(key.bytes, signature.data(), SignatureKey::kLength);
+    cache_->RefreshFailed(key);
+  }
   Status CacheResponse(const Attributes& attributes,
                        const ::istio::mixer::v1::CheckResponse& response,
-                       time_point<system_clock> time_now) {
-    return cache_->CacheResponse(attributes, response, time_now);
+                       time_point<system_clock> time_now,
+                       const std::string& refresh_signature = "") {
+    if (refresh_signature.empty()) {
+      return cache_->CacheResponse(attributes, response, time_now);
+    }
+    SignatureKey key;
+    memcpy(key.bytes, refresh_signature.data(), SignatureKey::kLength);
+    return cache_->CacheResponse(attributes, response, time_now, &key);
   }
 
   Attributes attributes_;
@@ -124,6 +149,91 @@ TEST_F(CheckCacheTest, TestExpiredByDuration) {
   EXPECT_ERROR_CODE(Code::NOT_FOUND, Check(attributes_, FakeTime(11)));
 }
 
+TEST_F(CheckCacheTest, TestRefreshAheadByUseCount) {
+  CheckOptions options;
+  options.refresh_ahead_fraction = 0.5;
+  cache_ = std::unique_ptr<CheckCache>(new CheckCache(options));
+  EXPECT_ERROR_CODE(Code::NOT_FOUND, Check(attributes_, FakeTime(0)));
+
+  CheckResponse ok_response;
+  ok_response.mutable_precondition()->set_valid_use_count(4);
+  EXPECT_OK(CacheResponse(attributes_, ok_response, FakeTime(0)));
+
+  // Refresh once the remaining use count drops to 2.
+  EXPECT_FALSE(CheckRefresh(attributes_, FakeTime(0)));
+  EXPECT_TRUE(CheckRefresh(attributes_, FakeTime(0)));
+  // Only one refresh until a new response.
+  EXPECT_FALSE(CheckRefresh(attributes_, FakeTime(0)));
+
+  // A new response resets the entry.
+  EXPECT_OK(CacheResponse(attributes_, ok_response, FakeTime(0)));
+  EXPECT_FALSE(CheckRefresh(attributes_, FakeTime(0)));
+  EXPECT_TRUE(CheckRefresh(attributes_, FakeTime(0)));
+}
+
+TEST_F(CheckCacheTest, TestRefreshAheadByDuration) {
+  CheckOptions options;
+  options.refresh_ahead_fraction = 0.2;
+  cache_ = std::unique_ptr<CheckCache>(new CheckCache(options));
+  EXPECT_ERROR_CODE(Code::NOT_FOUND, Check(attributes_, FakeTime(0)));
+
+  CheckResponse ok_response;
+  ok_response.mutable_precondition()->set_valid_use_count(-1);
+  *ok_response.mutable_precondition()->mutable_valid_duration() =
+      CreateDuration(duration_cast<nanoseconds>(milliseconds(100)));
+  EXPECT_OK(CacheResponse(attributes_, ok_response, FakeTime(0)));
+
+  EXPECT_FALSE(CheckRefresh(attributes_, FakeTime(50)));
+  // Refresh in the last 20 milliseconds.
+  std::string signature;
+  EXPECT_TRUE(CheckRefresh(attributes_, FakeTime(85), &signature));
+  EXPECT_FALSE(CheckRefresh(attributes_, FakeTime(86)));
+
+  // After a failed refresh, the next request refreshes again.
+  RefreshFailed(signature);
+  EXPECT_TRUE(CheckRefresh(attributes_, FakeTime(87)));
+}
+
+TEST_F(CheckCacheTest, TestRefreshCachedWithOtherSignature) {
+  CheckOptions options;
+  options.refresh_ahead_fraction = 0.2;
+  cache_ = std::unique_ptr<CheckCache>(new CheckCache(options));
+  AttributesBuilder(&attributes_).AddString("target.name", "target name");
+
+  CheckResponse ok_response;
+  ok_response.mutable_precondition()->set_valid_use_count(-1);
+  *ok_response.mutable_precondition()->mutable_valid_duration() =
+      CreateDuration(duration_cast<nanoseconds>(milliseconds(100)));
+  auto match = ok_response.mutable_precondition()
+                   ->mutable_referenced_attributes()
+                   ->add_attribute_matches();
+  match->set_condition(ReferencedAttributes::EXACT);
+  match->set_name(9);  // target.service is used.
+  EXPECT_OK(CacheResponse(attributes_, ok_response, FakeTime(0)));
+
+  std::string signature;
+  EXPECT_TRUE(CheckRefresh(attributes_, FakeTime(85), &signature));
+  EXPECT_FALSE(CheckRefresh(attributes_, FakeTime(86)));
+
+  // The refresh response references other attributes, so it is cached
+  // under another signature. The refreshed entry is refreshed again.
+  match->set_name(10);  // target.name is used.
+  EXPECT_OK(CacheResponse(attributes_, ok_response, FakeTime(87), signature));
+  std::string new_signature;
+  EXPECT_TRUE(CheckRefresh(attributes_, FakeTime(88), &new_signature));
+  EXPECT_EQ(new_signature, signature);
+}
+
+TEST_F(CheckCacheTest, TestNoRefreshAheadByDefault) {
+  EXPECT_ERROR_CODE(Code::NOT_FOUND, Check(attributes_, FakeTime(0)));
+
+  CheckResponse ok_response;
+  ok_response.mutable_precondition()->set_valid_use_count(2);
+  EXPECT_OK(CacheResponse(attributes_, ok_response, FakeTime(0)));
+  EXPECT_FALSE(CheckRefresh(attributes_, FakeTime(0)));
+  EXPECT_FALSE(CheckRefresh(attributes_, FakeTime(0)));
+}
+
 TEST_F(CheckCacheTest, TestCheckResult) {
   CheckCache::CheckResult result;
   cache_->Check(attributes_, &result);
@@ -316,5 +426,151 @@ TEST_F(CheckCacheTest, TestTwoReferenced) {
   EXPECT_TRUE(result3.IsCacheHit());
 }
 
+TEST_F(CheckCacheTest, TestOnlyMatchingReferencedEvaluated) {
+  Attributes attributes1;
+  AttributesBuilder(&attributes1).AddString("target.name", "target name");
+
+  CheckResponse response;
+  response.mutable_precondition()->set_valid_use_count(1000);
+  auto match = response.mutable_precondition()
+                   ->mutable_referenced_attributes()
+                   ->add_attribute_matches();
+  match->set_condition(ReferencedAttributes::EXACT);
+  match->set_name(9);  // target.service is used.
+  EXPECT_OK(CacheResponse(attributes_, response, FakeTime(0)));
+
+  match->set_name(10);  // target.name is used.
+  EXPECT_OK(CacheResponse(attributes1, response, FakeTime(0)));
+
+  // Each request only evaluates the Referenced it has attributes for.
+  EXPECT_OK(Check(attributes_, FakeTime(1)));
+  EXPECT_OK(Check(attributes1, FakeTime(1)));
+  EXPECT_EQ(cache_->total_lookups(), 2);
+  EXPECT_EQ(cache_->total_referenced_evaluated(), 2);
+
+  // No Referenced is evaluated.
+  Attributes attributes2;
+  EXPECT_ERROR_CODE(Code::NOT_FOUND, Check(attributes2, FakeTime(1)));
+  EXPECT_EQ(cache_->total_lookups(), 3);
+  EXPECT_EQ(cache_->total_referenced_evaluated(), 2);
+}
+
+TEST_F(CheckCacheTest, TestShardedCache) {
+  CheckOptions options(100);
+  options.num_shards = 4;
+  cache_ = std::unique_ptr<CheckCache>(new CheckCache(options));
+
+  CheckResponse ok_response;
+  ok_response.mutable_precondition()->set_valid_use_count(1000);
+  auto match = ok_response.mutable_precondition()
+                   ->mutable_referenced_attributes()
+                   ->add_attribute_matches();
+  match->set_condition(ReferencedAttributes::EXACT);
+  match->set_name(9);  // target.service is used.
+
+  // Keys are spread over all shards, each shard has 25 entries.
+  std::vector<Attributes> requests(50);
+  for (size_t i = 0; i < requests.size(); ++i) {
+    AttributesBuilder(&requests[i])
+        .AddString("target.service", "service-" + std::to_string(i));
+    EXPECT_ERROR_CODE(Code::NOT_FOUND, Check(requests[i], FakeTime(0)));
+    EXPECT_OK(CacheResponse(requests[i], ok_response, FakeTime(0)));
+  }
+  for (const auto& request : requests) {
+    EXPECT_OK(Check(request, FakeTime(1)));
+  }
+}
+
+TEST_F(CheckCacheTest, TestSnapshot) {
+  CheckResponse response;
+  response.mutable_precondition()->set_valid_use_count(1000);
+  auto match = response.mutable_precondition()
+                   ->mutable_referenced_attributes()
+                   ->add_attribute_matches();
+  match->set_condition(ReferencedAttributes::EXACT);
+  match->set_name(9);  // target.service is used.
+
+  std::vector<Attributes> requests(4);
+  for (size_t i = 0; i < requests.size(); ++i) {
+    AttributesBuilder(&requests[i])
+        .AddString("target.service", "service-" + std::to_string(i));
+  }
+  time_point<system_clock> now = system_clock::now();
+  EXPECT_OK(CacheResponse(requests[0], response, now));
+  response.mutable_precondition()->mutable_status()->set_code(
+      Code::PERMISSION_DENIED);
+  EXPECT_ERROR_CODE(Code::PERMISSION_DENIED,
+                    CacheResponse(requests[1], response, now));
+  // Already expired.
+  *response.mutable_precondition()->mutable_valid_duration() =
+      CreateDuration(duration_cast<nanoseconds>(milliseconds(10)));
+  CacheResponse(requests[2], response, FakeTime(0));
+
+  SnapshotWriter writer;
+  cache_->SaveSnapshot(&writer);
+
+  CheckOptions options;
+  cache_ = std::unique_ptr<CheckCache>(new CheckCache(options));
+  std::unique_ptr<SnapshotReader> reader;
+  EXPECT_OK(SnapshotReader::FromBuffer(writer.buffer(), &reader));
+  EXPECT_TRUE(cache_->LoadSnapshot(reader.get()));
+
+  EXPECT_OK(Check(requests[0], now));
+  EXPECT_ERROR_CODE(Code::PERMISSION_DENIED, Check(requests[1], now));
+  EXPECT_ERROR_CODE(Code::NOT_FOUND, Check(requests[2], now));
+  // The Referenced is restored, a miss has a signature.
+  CheckCache::CheckResult result;
+  cache_->Check(requests[3], &result);
+  EXPECT_FALSE(result.IsCacheHit());
+  EXPECT_FALSE(result.signature().empty());
+
+  // With another hash function, only Referenced are restored.
+  options.cache_key_hash = CacheKeyHash::MD5;
+  cache_ = std::unique_ptr<CheckCache>(new CheckCache(options));
+  EXPECT_OK(SnapshotReader::FromBuffer(writer.buffer(), &reader));
+  EXPECT_TRUE(cache_->LoadSnapshot(reader.get()));
+  CheckCache::CheckResult result1;
+  cache_->Check(requests[0], &result1);
+  EXPECT_FALSE(result1.IsCacheHit());
+  EXPECT_FALSE(result1.signature().empty());
+
+  // Truncated data.
+  cache_ = std::unique_ptr<CheckCache>(new CheckCache(CheckOptions()));
+  std::string truncated = writer.buffer().substr(0, writer.buffer().size() - 4);
+  EXPECT_OK(SnapshotReader::FromBuffer(truncated, &reader));
+  EXPECT_FALSE(cache_->LoadSnapshot(reader.get()));
+}
+
+TEST_F(CheckCacheTest, TestConcurrentCheck) {
+  CheckResponse ok_response;
+  ok_response.mutable_precondition()->set_valid_use_count(100000);
+  auto match = ok_response.mutable_precondition()
+                   ->mutable_referenced_attributes()
+                   ->add_attribute_matches();
+  match->set_condition(ReferencedAttributes::EXACT);
+  match->set_name(9);  // target.service is used.
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; ++t) {
+    threads.push_back(std::thread([this, t, &ok_response]() {
+      Attributes request;
+      AttributesBuilder(&request)
+          .AddString("target.service", "service-" + std::to_string(t));
+      CheckCache::CheckResult result;
+      cache_->Check(request, &result);
+      result.SetResponse(Status::OK, request, ok_response);
+      for (int i = 0; i < 1000; ++i) {
+        CheckCache::CheckResult hit_result;
+        cache_->Check(request, &hit_result);
+        EXPECT_TRUE(hit_result.IsCacheHit());
+        EXPECT_OK(hit_result.status());
+      }
+    }));
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
 }  // namespace mixer_client
 }  // namespace istio
@@ -15,27 +15,52 @@
 #include "src/client_impl.h"
 #include "utils/protobuf.h"
 
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
+#include "google/protobuf/wire_format_lite.h"
+
 using ::istio::mixer::v1::Attributes;
 using ::istio::mixer::v1::CheckRequest;
 using ::istio::mixer::v1::CheckResponse;
 using ::istio::mixer::v1::ReportRequest;
 using ::istio::mixer::v1::ReportResponse;
+using ::google::protobuf::Arena;
+using ::google::protobuf::internal::WireFormatLite;
+using ::google::protobuf::io::CodedOutputStream;
+using ::google::protobuf::io::StringOutputStream;
 using ::google::protobuf::util::Status;
 using ::google::protobuf::util::error::Code;
 
 namespace istio {
 namespace mixer_client {
+namespace {
+
+// At most this many idle arenas are kept for remote check calls.
+const int kArenaPoolSize = 64;
+// The initial block of an arena, large enough for a typical remote check.
+const size_t kArenaBlockSize = 8192;
+
+// The quota requirements to refresh a rejected check cache entry.
+const std::vector<::istio::quota::Requirement> kNoQuotas;
+
+}  // namespace
 
 MixerClientImpl::MixerClientImpl(const MixerClientOptions &options)
-    : options_(options) {
+    : options_(options), arena_pool_(kArenaPoolSize, kArenaBlockSize) {
   check_cache_ =
       std::unique_ptr<CheckCache>(new CheckCache(options.check_options));
   report_batch_ = std::unique_ptr<ReportBatch>(
       new ReportBatch(options.report_options, options_.env.report_transport,
-                      options.env.timer_create_func, compressor_));
+                      options.env.timer_create_func, compressor_,
+                      options.env.report_executor,
+                      options.env.raw_report_transport));
   quota_cache_ =
       std::unique_ptr<QuotaCache>(new QuotaCache(options.quota_options));
 
+  if (!options_.snapshot_path.empty()) {
+    LoadSnapshot(options_.snapshot_path);
+  }
+
   if (options_.env.uuid_generate_func) {
     deduplication_id_base_ = options_.env.uuid_generate_func();
   }
@@ -43,6 +68,8 @@ MixerClientImpl::MixerClientImpl(const MixerClientOptions &options)
   total_check_calls_ = 0;
   total_remote_check_calls_ = 0;
   total_blocking_remote_check_calls_ = 0;
+  total_coalesced_check_calls_ = 0;
+  total_refresh_remote_check_calls_ = 0;
   total_quota_calls_ = 0;
   total_remote_quota_calls_ = 0;
   total_blocking_remote_quota_calls_ = 0;
@@ -55,98 +82,396 @@ CancelFunc MixerClientImpl::Check(
     const std::vector<::istio::quota::Requirement> &quotas,
     TransportCheckFunc transport, DoneFunc on_done) {
   ++total_check_calls_;
+  return DoCheck(nullptr, attributes, nullptr, quotas, transport, on_done);
+}
+
+CancelFunc MixerClientImpl::Check(
+    Attributes &&attributes,
+    const std::vector<::istio::quota::Requirement> &quotas,
+    TransportCheckFunc transport, DoneFunc on_done) {
+  ++total_check_calls_;
+  return DoCheck(nullptr, attributes, &attributes, quotas, transport, on_done);
+}
+
+std::shared_ptr<const StaticAttributes> MixerClientImpl::CreateStaticAttributes(
+    const Attributes &attributes) {
+  return compressor_.CompressStatic(attributes);
+}
 
-  std::unique_ptr<CheckCache::CheckResult> check_result(
-      new CheckCache::CheckResult);
-  check_cache_->Check(attributes, check_result.get());
-  if (check_result->IsCacheHit() && !check_result->status().ok()) {
-    on_done(check_result->status());
+CancelFunc MixerClientImpl::Check(
+    const StaticAttributes *static_attributes, const Attributes &attributes,
+    const std::vector<::istio::quota::Requirement> &quotas,
+    TransportCheckFunc transport, DoneFunc on_done) {
+  ++total_check_calls_;
+  return DoCheck(static_attributes, attributes, nullptr, quotas, transport,
+                 on_done);
+}
+
+CancelFunc MixerClientImpl::Check(
+    const StaticAttributes *static_attributes, Attributes &&attributes,
+    const std::vector<::istio::quota::Requirement> &quotas,
+    TransportCheckFunc transport, DoneFunc on_done) {
+  ++total_check_calls_;
+  return DoCheck(static_attributes, attributes, &attributes, quotas, transport,
+                 on_done);
+}
+
+CancelFunc MixerClientImpl::DoCheck(
+    const StaticAttributes *static_attributes, const Attributes &attributes,
+    Attributes *owned_attributes,
+    const std::vector<::istio::quota::Requirement> &quotas,
+    TransportCheckFunc transport, DoneFunc on_done) {
+  // The results are kept on stack, they are only moved to heap for a
+  // remote call, so a cache hit doesn't allocate memory.
+  CheckCache::CheckResult check_result;
+  check_cache_->Check(attributes, &check_result);
+  // A hit close to expiration still uses the cached status, but also
+  // sends a remote call to refresh the entry.
+  const bool refresh = check_result.need_refresh();
+  if (check_result.IsCacheHit() && !refresh &&
+      (quotas.empty() || !check_result.status().ok())) {
+    on_done(check_result.status());
     return nullptr;
   }
 
-  if (!quotas.empty()) {
+  const std::vector<::istio::quota::Requirement> *quota_requirements = &quotas;
+  if (check_result.IsCacheHit() && !check_result.status().ok()) {
+    on_done(check_result.status());
+    // Refresh the rejected entry without quota.
+    on_done = nullptr;
+    quota_requirements = &kNoQuotas;
+  }
+
+  // On a miss without quota, join an in-flight remote call for the same
+  // cache signature, or become the one making it.
+  std::shared_ptr<InflightCheck> inflight;
+  CancelFunc inflight_cancel;
+  if (options_.check_options.coalesce_misses && quotas.empty() && on_done &&
+      !check_result.IsCacheHit() && !check_result.signature().empty()) {
+    std::string signature = check_result.signature();
+    std::lock_guard<std::mutex> lock(inflight_mutex_);
+    auto it = inflight_checks_.find(signature);
+    if (it != inflight_checks_.end()) {
+      ++total_coalesced_check_calls_;
+      // Kept in case the response doesn't apply to this call.
+      std::unique_ptr<Attributes> waiter_attributes(new Attributes);
+      if (owned_attributes) {
+        waiter_attributes->Swap(owned_attributes);
+      } else {
+        waiter_attributes->CopyFrom(attributes);
+      }
+      return AddInflightWaiter(it->second, on_done,
+                               std::move(waiter_attributes), transport);
+    }
+    inflight = std::make_shared<InflightCheck>();
+    inflight->signature = signature;
+    inflight_checks_[inflight->signature] = inflight;
+    inflight_cancel = AddInflightWaiter(inflight, on_done, nullptr, nullptr);
+    on_done = [this, inflight](const Status &status) {
+      CompleteInflightCheck(inflight, status);
+    };
+  }
+
+  if (!quota_requirements->empty()) {
     ++total_quota_calls_;
   }
-  std::unique_ptr<QuotaCache::CheckResult> quota_result(
-      new QuotaCache::CheckResult);
+  QuotaCache::CheckResult quota_result;
   // Only use quota cache if Check is using cache with OK status.
   // Otherwise, a remote Check call may be rejected, but quota amounts were
   // substracted from quota cache already.
-  quota_cache_->Check(attributes, quotas, check_result->IsCacheHit(),
-                      quota_result.get());
+  quota_cache_->Check(attributes, *quota_requirements,
+                      check_result.IsCacheHit(), &quota_result);
 
-  CheckRequest request;
-  bool quota_call = quota_result->BuildRequest(&request);
-  if (check_result->IsCacheHit() && quota_result->IsCacheHit()) {
-    on_done(quota_result->status());
-    on_done = nullptr;
-    if (!quota_call) {
+  // Decided from the results on stack, so a check and quota cache hit
+  // doesn't allocate memory.
+  bool quota_call = quota_result.SetCacheStatus();
+  if (check_result.IsCacheHit() && quota_result.IsCacheHit()) {
+    if (on_done) {
+      on_done(quota_result.status());
+      on_done = nullptr;
+    }
+    if (!quota_call && !refresh) {
       return nullptr;
     }
   }
 
-  compressor_.Compress(attributes, request.mutable_attributes());
-  request.set_global_word_count(compressor_.global_word_count());
-  request.set_deduplication_id(deduplication_id_base_ +
-                               std::to_string(deduplication_id_.fetch_add(1)));
+  // The request, response and results of the remote call are allocated
+  // from one arena, recycled when the call is done.
+  PooledArena *pooled_arena = arena_pool_.Get().release();
+  Arena *arena = pooled_arena->arena();
+  CheckRequest *request = Arena::Create<CheckRequest>(arena);
+  quota_result.BuildRequest(request);
+
+  // With a raw transport, the attributes are encoded directly, and the
+  // other fields of the request are serialized before them.
+  std::string *serialized = nullptr;
+  std::string compressed_attributes;
+  // The global dictionary may shrink concurrently, the request records the
+  // size it is compressed with.
+  int global_word_count;
+  if (!transport && options_.env.raw_check_transport) {
+    serialized = Arena::Create<std::string>(arena);
+    // Only created by CreateStaticAttributes().
+    global_word_count = compressor_.CompressToString(
+        attributes, &compressed_attributes,
+        static_cast<const CompressedStaticAttributes *>(static_attributes));
+  } else {
+    global_word_count =
+        compressor_.Compress(attributes, request->mutable_attributes());
+  }
+  request->set_global_word_count(global_word_count);
+  request->set_deduplication_id(deduplication_id_base_ +
+                                std::to_string(deduplication_id_.fetch_add(1)));
+  if (serialized) {
+    request->SerializeToString(serialized);
+    StringOutputStream stream(serialized);
+    CodedOutputStream out(&stream);
+    WireFormatLite::WriteBytes(CheckRequest::kAttributesFieldNumber,
+                               compressed_attributes, &out);
+  }
 
   // Need to make a copy for processing the response for check cache.
-  Attributes *request_copy = new Attributes(attributes);
-  auto response = new CheckResponse;
-  // Lambda capture could not pass unique_ptr, use raw pointer.
-  CheckCache::CheckResult *raw_check_result = check_result.release();
-  QuotaCache::CheckResult *raw_quota_result = quota_result.release();
+  Attributes *request_copy;
+  if (owned_attributes) {
+    // Swapping with an arena message would copy, so the moved attributes
+    // stay on heap, owned by the arena.
+    request_copy = new Attributes;
+    request_copy->Swap(owned_attributes);
+    arena->Own(request_copy);
+  } else {
+    request_copy = Arena::Create<Attributes>(arena);
+    request_copy->CopyFrom(attributes);
+  }
+  auto response = Arena::Create<CheckResponse>(arena);
+  CheckCache::CheckResult *raw_check_result =
+      Arena::Create<CheckCache::CheckResult>(arena, std::move(check_result));
+  QuotaCache::CheckResult *raw_quota_result =
+      Arena::Create<QuotaCache::CheckResult>(arena, std::move(quota_result));
+  if (inflight) {
+    inflight->attributes = request_copy;
+    inflight->response = response;
+  }
   if (!transport) {
     transport = options_.env.check_transport;
   }
   // We are going to make a remote call now.
   ++total_remote_check_calls_;
-  if (!quotas.empty()) {
+  if (!quota_requirements->empty()) {
     ++total_remote_quota_calls_;
   }
   if (on_done) {
     ++total_blocking_remote_check_calls_;
-    if (!quotas.empty()) {
+    if (!quota_requirements->empty()) {
       ++total_blocking_remote_quota_calls_;
     }
+  } else if (refresh) {
+    ++total_refresh_remote_check_calls_;
   }
 
-  return transport(
-      request, response, [this, request_copy, response, raw_check_result,
-                          raw_quota_result, on_done](const Status &status) {
-        raw_check_result->SetResponse(status, *request_copy, *response);
-        raw_quota_result->SetResponse(status, *request_copy, *response);
-        if (on_done) {
-          if (!raw_check_result->status().ok()) {
-            on_done(raw_check_result->status());
-          } else {
-            on_done(raw_quota_result->status());
-          }
+  // A synchronous transport may still use the request after calling back,
+  // so the arena is recycled only when both the transport call returned
+  // and the call is done.
+  std::atomic<int> *arena_users = Arena::Create<std::atomic<int>>(arena, 2);
+  auto release_arena = [this, pooled_arena, arena_users]() {
+    if (arena_users->fetch_sub(1) == 1) {
+      // Destroys all objects allocated from the arena.
+      arena_pool_.Put(std::unique_ptr<PooledArena>(pooled_arena));
+    }
+  };
+  DoneFunc transport_done = [this, request_copy, response, raw_check_result,
+                             raw_quota_result, on_done,
+                             release_arena](const Status &status) {
+    raw_check_result->SetResponse(status, *request_copy, *response);
+    raw_quota_result->SetResponse(status, *request_copy, *response);
+    if (on_done) {
+      if (!raw_check_result->status().ok()) {
+        on_done(raw_check_result->status());
+      } else {
+        on_done(raw_quota_result->status());
+      }
+    }
+    release_arena();
+
+    if (InvalidDictionaryStatus(status)) {
+      compressor_.ShrinkGlobalDictionary();
+    }
+  };
+  CancelFunc cancel =
+      serialized ? options_.env.raw_check_transport(*serialized, response,
+                                                    transport_done)
+                 : transport(*request, response, transport_done);
+  release_arena();
+  if (!inflight) {
+    return cancel;
+  }
+
+  {
+    // The response may have arrived already.
+    std::lock_guard<std::mutex> lock(inflight_mutex_);
+    if (!inflight->waiters.empty()) {
+      inflight->cancel = cancel;
+    }
+  }
+  return inflight_cancel;
+}
+
+CancelFunc MixerClientImpl::AddInflightWaiter(
+    const std::shared_ptr<InflightCheck> &inflight, DoneFunc on_done,
+    std::unique_ptr<Attributes> attributes, TransportCheckFunc transport) {
+  uint64_t waiter_id = inflight->next_waiter_id++;
+  InflightCheck::Waiter waiter;
+  waiter.id = waiter_id;
+  waiter.on_done = on_done;
+  waiter.attributes = std::move(attributes);
+  waiter.transport = transport;
+  inflight->waiters.push_back(std::move(waiter));
+  return [this, inflight, waiter_id]() {
+    DetachInflightWaiter(inflight, waiter_id);
+  };
+}
+
+void MixerClientImpl::DetachInflightWaiter(
+    const std::shared_ptr<InflightCheck> &inflight, uint64_t waiter_id) {
+  CancelFunc cancel;
+  {
+    std::lock_guard<std::mutex> lock(inflight_mutex_);
+    auto recheck = inflight->rechecks.find(waiter_id);
+    if (recheck != inflight->rechecks.end()) {
+      // The waiter is being checked again with its own call.
+      cancel.swap(recheck->second);
+      inflight->rechecks.erase(recheck);
+    } else {
+      auto &waiters = inflight->waiters;
+      for (auto it = waiters.begin(); it != waiters.end(); ++it) {
+        if (it->id == waiter_id) {
+          waiters.erase(it);
+          break;
         }
-        delete raw_check_result;
-        delete raw_quota_result;
-        delete request_copy;
-        delete response;
+      }
+      if (!waiters.empty()) {
+        return;
+      }
+      auto it = inflight_checks_.find(inflight->signature);
+      if (it != inflight_checks_.end() && it->second == inflight) {
+        inflight_checks_.erase(it);
+      }
+      // Nobody is waiting for the response any more.
+      cancel.swap(inflight->cancel);
+    }
+  }
+  if (cancel) {
+    cancel();
+  }
+}
 
-        if (InvalidDictionaryStatus(status)) {
-          compressor_.ShrinkGlobalDictionary();
+void MixerClientImpl::CompleteInflightCheck(
+    const std::shared_ptr<InflightCheck> &inflight, const Status &status) {
+  std::vector<InflightCheck::Waiter> waiters;
+  {
+    std::lock_guard<std::mutex> lock(inflight_mutex_);
+    auto it = inflight_checks_.find(inflight->signature);
+    if (it != inflight_checks_.end() && it->second == inflight) {
+      inflight_checks_.erase(it);
+    }
+    waiters.swap(inflight->waiters);
+    inflight->cancel = nullptr;
+  }
+
+  // The waiters were joined by the signature under a learned Referenced,
+  // the response only applies to those with the same signature under its
+  // own Referenced.
+  // Hashed like the check cache keys, not to add an MD5 per waiter.
+  Referenced referenced;
+  SignatureKey signature;
+  bool has_signature =
+      referenced.Fill(*inflight->attributes,
+                      inflight->response->precondition()
+                          .referenced_attributes()) &&
+      check_cache_->Signature(referenced, *inflight->attributes, &signature);
+  for (auto &waiter : waiters) {
+    SignatureKey waiter_signature;
+    if (!waiter.attributes ||
+        (has_signature &&
+         check_cache_->Signature(referenced, *waiter.attributes,
+                                 &waiter_signature) &&
+         waiter_signature == signature)) {
+      waiter.on_done(status);
+    } else {
+      RecheckInflightWaiter(inflight, &waiter);
+    }
+  }
+}
+
+void MixerClientImpl::RecheckInflightWaiter(
+    const std::shared_ptr<InflightCheck> &inflight,
+    InflightCheck::Waiter *waiter) {
+  uint64_t waiter_id = waiter->id;
+  {
+    std::lock_guard<std::mutex> lock(inflight_mutex_);
+    inflight->rechecks[waiter_id] = nullptr;
+  }
+  DoneFunc on_done = waiter->on_done;
+  CancelFunc cancel = DoCheck(
+      nullptr, *waiter->attributes, waiter->attributes.get(), kNoQuotas,
+      waiter->transport,
+      [this, inflight, waiter_id, on_done](const Status &status) {
+        {
+          std::lock_guard<std::mutex> lock(inflight_mutex_);
+          // Not called if the waiter is detached.
+          if (inflight->rechecks.erase(waiter_id) == 0) {
+            return;
+          }
         }
+        on_done(status);
       });
+
+  std::lock_guard<std::mutex> lock(inflight_mutex_);
+  // Not found if the call is done already.
+  auto it = inflight->rechecks.find(waiter_id);
+  if (it != inflight->rechecks.end()) {
+    it->second = cancel;
+  }
 }
 
 void MixerClientImpl::Report(const Attributes &attributes) {
   report_batch_->Report(attributes);
 }
 
+void MixerClientImpl::Report(Attributes &&attributes) {
+  report_batch_->Report(std::move(attributes));
+}
+
+Status MixerClientImpl::SaveSnapshot(const std::string &path) {
+  SnapshotWriter writer;
+  check_cache_->SaveSnapshot(&writer);
+  return writer.WriteFile(path);
+}
+
+void MixerClientImpl::LoadSnapshot(const std::string &path) {
+  std::unique_ptr<SnapshotReader> reader;
+  Status status = SnapshotReader::Open(path, &reader);
+  if (!status.ok()) {
+    GOOGLE_LOG(WARNING) << "Not to restore cache snapshot: " << status.ToString();
+    return;
+  }
+  if (!check_cache_->LoadSnapshot(reader.get())) {
+    GOOGLE_LOG(WARNING) << "Invalid check cache snapshot: " << path;
+  }
+}
+
 void MixerClientImpl::GetStatistics(Statistics *stat) const {
   stat->total_check_calls = total_check_calls_;
   stat->total_remote_check_calls = total_remote_check_calls_;
   stat->total_blocking_remote_check_calls = total_blocking_remote_check_calls_;
+  stat->total_check_cache_lookups = check_cache_->total_lookups();
+  stat->total_check_cache_referenced_evaluated =
+      check_cache_->total_referenced_evaluated();
+  stat->total_coalesced_check_calls = total_coalesced_check_calls_;
+  stat->total_refresh_remote_check_calls = total_refresh_remote_check_calls_;
   stat->total_quota_calls = total_quota_calls_;
   stat->total_remote_quota_calls = total_remote_quota_calls_;
   stat->total_blocking_remote_quota_calls = total_blocking_remote_quota_calls_;
-  stat->total_report_calls = report_batch_->total_report_calls();
-  stat->total_remote_report_calls = report_batch_->total_remote_report_calls();
+  report_batch_->GetStatistics(stat);
 }
 
 // Creates a MixerClient object.
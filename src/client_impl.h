@@ -17,12 +17,15 @@
 #define MIXERCLIENT_CLIENT_IMPL_H
 
 #include "include/client.h"
+#include "src/arena_pool.h"
 #include "src/attribute_compressor.h"
 #include "src/check_cache.h"
 #include "src/quota_cache.h"
 #include "src/report_batch.h"
 
 #include <atomic>
+#include <mutex>
+#include <unordered_map>
 
 namespace istio {
 namespace mixer_client {
@@ -38,17 +41,97 @@ class MixerClientImpl : public MixerClient {
   CancelFunc Check(const ::istio::mixer::v1::Attributes& attributes,
                    const std::vector<::istio::quota::Requirement>& quotas,
                    TransportCheckFunc transport, DoneFunc on_done) override;
+  CancelFunc Check(::istio::mixer::v1::Attributes&& attributes,
+                   const std::vector<::istio::quota::Requirement>& quotas,
+                   TransportCheckFunc transport, DoneFunc on_done) override;
+  std::shared_ptr<const StaticAttributes> CreateStaticAttributes(
+      const ::istio::mixer::v1::Attributes& attributes) override;
+  CancelFunc Check(const StaticAttributes* static_attributes,
+                   const ::istio::mixer::v1::Attributes& attributes,
+                   const std::vector<::istio::quota::Requirement>& quotas,
+                   TransportCheckFunc transport, DoneFunc on_done) override;
+  CancelFunc Check(const StaticAttributes* static_attributes,
+                   ::istio::mixer::v1::Attributes&& attributes,
+                   const std::vector<::istio::quota::Requirement>& quotas,
+                   TransportCheckFunc transport, DoneFunc on_done) override;
   void Report(const ::istio::mixer::v1::Attributes& attributes) override;
+  void Report(::istio::mixer::v1::Attributes&& attributes) override;
 
   void GetStatistics(Statistics* stat) const override;
 
+  ::google::protobuf::util::Status SaveSnapshot(
+      const std::string& path) override;
+
  private:
+  // A remote check call shared by concurrent check cache misses with the
+  // same cache signature.
+  struct InflightCheck {
+    // A check call waiting for the response.
+    struct Waiter {
+      uint64_t id;
+      DoneFunc on_done;
+      // The attributes and the transport of a joined call, to check it
+      // again if the response doesn't apply to it. Null for the call
+      // making the remote call.
+      std::unique_ptr<::istio::mixer::v1::Attributes> attributes;
+      TransportCheckFunc transport;
+    };
+
+    std::string signature;
+    // To cancel the remote call, only called when all waiters are gone.
+    CancelFunc cancel;
+    std::vector<Waiter> waiters;
+    uint64_t next_waiter_id = 0;
+    // The attributes and the response of the remote call, owned by its
+    // arena. Set before the call is made.
+    const ::istio::mixer::v1::Attributes* attributes = nullptr;
+    const ::istio::mixer::v1::CheckResponse* response = nullptr;
+    // To cancel the calls made again for the waiters the response doesn't
+    // apply to, keyed by waiter id. Null until the call is made.
+    std::unordered_map<uint64_t, CancelFunc> rechecks;
+  };
+
+  // Makes a check call. If owned_attributes is not null, it is the same
+  // object as attributes, and it can be moved into the remote call.
+  // static_attributes may be null. The caller counts the check call.
+  CancelFunc DoCheck(const StaticAttributes* static_attributes,
+                     const ::istio::mixer::v1::Attributes& attributes,
+                     ::istio::mixer::v1::Attributes* owned_attributes,
+                     const std::vector<::istio::quota::Requirement>& quotas,
+                     TransportCheckFunc transport, DoneFunc on_done);
+
+  // Adds a waiter to an in-flight check. attributes is null for the call
+  // making the remote call. Returns the function to detach it.
+  // inflight_mutex_ must be held.
+  CancelFunc AddInflightWaiter(
+      const std::shared_ptr<InflightCheck>& inflight, DoneFunc on_done,
+      std::unique_ptr<::istio::mixer::v1::Attributes> attributes,
+      TransportCheckFunc transport);
+  // Removes a waiter; cancels the remote call if it was the last one.
+  void DetachInflightWaiter(const std::shared_ptr<InflightCheck>& inflight,
+                            uint64_t waiter_id);
+  // Calls the waiters of an in-flight check with the check status. The
+  // Referenced of the response may cover attributes the learned one did
+  // not; the waiters with a different signature under it are checked
+  // again.
+  void CompleteInflightCheck(const std::shared_ptr<InflightCheck>& inflight,
+                             const ::google::protobuf::util::Status& status);
+  // Checks a waiter again with its own call.
+  void RecheckInflightWaiter(const std::shared_ptr<InflightCheck>& inflight,
+                             InflightCheck::Waiter* waiter);
+
+  // Restores the check cache from a snapshot file.
+  void LoadSnapshot(const std::string& path);
+
   // Store the options
   MixerClientOptions options_;
 
   // To compress attributes.
   AttributeCompressor compressor_;
 
+  // Arenas for remote check calls.
+  ArenaPool arena_pool_;
+
   // Cache for Check call.
   std::unique_ptr<CheckCache> check_cache_;
   // Report batch.
@@ -60,6 +143,12 @@ class MixerClientImpl : public MixerClient {
   std::string deduplication_id_base_;
   std::atomic<std::uint64_t> deduplication_id_;
 
+  // Mutex guarding inflight_checks_ and their content.
+  std::mutex inflight_mutex_;
+  // The in-flight remote check calls keyed by cache signature.
+  std::unordered_map<std::string, std::shared_ptr<InflightCheck>>
+      inflight_checks_;
+
   // Atomic objects for recording statistics.
   // check cache miss rate:
   // total_blocking_remote_check_calls_ / total_check_calls_.
@@ -68,6 +157,8 @@ class MixerClientImpl : public MixerClient {
   std::atomic_int_fast64_t total_check_calls_;
   std::atomic_int_fast64_t total_remote_check_calls_;
   std::atomic_int_fast64_t total_blocking_remote_check_calls_;
+  std::atomic_int_fast64_t total_coalesced_check_calls_;
+  std::atomic_int_fast64_t total_refresh_remote_check_calls_;
   std::atomic_int_fast64_t total_quota_calls_;
   std::atomic_int_fast64_t total_remote_quota_calls_;
   std::atomic_int_fast64_t total_blocking_remote_quota_calls_;
@@ -0,0 +1,195 @@
+/* Copyright 2018 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Verifies that a check and quota cache hit doesn't allocate memory.
+// It replaces the global operator new to count allocations, so it is
+// a separate test binary.
+
+#include <stdlib.h>
+#include <atomic>
+#include <new>
+
+#include "gtest/gtest.h"
+#include "include/attributes_builder.h"
+#include "include/client.h"
+
+using ::istio::mixer::v1::Attributes;
+using ::istio::mixer::v1::CheckRequest;
+using ::istio::mixer::v1::CheckResponse;
+using ::istio::mixer::v1::ReferencedAttributes;
+using ::google::protobuf::util::Status;
+
+namespace {
+
+// Allocations are only counted when enabled.
+std::atomic<bool> count_allocations(false);
+std::atomic<int> num_allocations(0);
+
+}  // namespace
+
+void* operator new(size_t size) {
+  if (count_allocations) {
+    ++num_allocations;
+  }
+  void* p = malloc(size == 0 ? 1 : size);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+// GCC cannot tell that free() here pairs with the malloc() in the
+// replacement operator new above.
+#if !defined(__clang__) && defined(__GNUC__) && __GNUC__ >= 11
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void operator delete(void* p) noexcept { free(p); }
+
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+#if !defined(__clang__) && defined(__GNUC__) && __GNUC__ >= 11
+#pragma GCC diagnostic pop
+#endif
+
+namespace istio {
+namespace mixer_client {
+namespace {
+
+// Returns the number of allocations made by fn.
+template <class Fn>
+int CountAllocations(Fn fn) {
+  num_allocations = 0;
+  count_allocations = true;
+  fn();
+  count_allocations = false;
+  return num_allocations;
+}
+
+class ClientImplAllocationTest : public ::testing::Test {
+ public:
+  void SetUp() {
+    AttributesBuilder builder(&attributes_);
+    builder.AddString("target.service", "a-long-service-name-not-in-sso");
+    builder.AddString("source.name", "a-long-source-name-not-in-sso");
+    builder.AddStringMap("request.headers", {{":method", "GET"}});
+  }
+
+  void CreateClient(CacheKeyHash hash) {
+    MixerClientOptions options(CheckOptions(100), ReportOptions(1, 1000),
+                               QuotaOptions(100, 600000));
+    options.check_options.cache_key_hash = hash;
+    options.env.check_transport = [](const CheckRequest& request,
+                                     CheckResponse* response,
+                                     DoneFunc on_done) -> CancelFunc {
+      response->mutable_precondition()->set_valid_use_count(-1);
+      auto match = response->mutable_precondition()
+                       ->mutable_referenced_attributes()
+                       ->add_attribute_matches();
+      match->set_condition(ReferencedAttributes::EXACT);
+      match->set_name(9);  // target.service
+      // Grants the requested amounts.
+      for (const auto& it : request.quotas()) {
+        CheckResponse::QuotaResult result;
+        result.set_granted_amount(it.second.amount());
+        (*response->mutable_quotas())[it.first] = result;
+      }
+      on_done(Status::OK);
+      return nullptr;
+    };
+    client_ = CreateMixerClient(options);
+  }
+
+  std::unique_ptr<MixerClient> client_;
+  Attributes attributes_;
+  std::vector<::istio::quota::Requirement> no_quotas_;
+  std::vector<::istio::quota::Requirement> quotas_ = {
+      {"a-long-quota-name-not-in-sso", 1}};
+};
+
+TEST_F(ClientImplAllocationTest, TestCheckHitNoAllocation) {
+  for (auto hash : {CacheKeyHash::FAST, CacheKeyHash::MD5}) {
+    CreateClient(hash);
+    Status done_status = Status::UNKNOWN;
+    DoneFunc on_done = [&done_status](const Status& status) {
+      done_status = status;
+    };
+    // The first call is a cache miss, it fills the cache.
+    client_->Check(attributes_, no_quotas_, nullptr, on_done);
+    EXPECT_TRUE(done_status.ok());
+
+    int allocations = CountAllocations([&]() {
+      for (int i = 0; i < 100; ++i) {
+        done_status = Status::UNKNOWN;
+        client_->Check(attributes_, no_quotas_, nullptr, on_done);
+      }
+    });
+    EXPECT_TRUE(done_status.ok());
+    EXPECT_EQ(allocations, 0);
+
+    Statistics stat;
+    client_->GetStatistics(&stat);
+    EXPECT_EQ(stat.total_check_calls, 101);
+    EXPECT_EQ(stat.total_remote_check_calls, 1);
+  }
+}
+
+TEST_F(ClientImplAllocationTest, TestCheckQuotaHitNoAllocation) {
+  for (auto hash : {CacheKeyHash::FAST, CacheKeyHash::MD5}) {
+    CreateClient(hash);
+    Status done_status = Status::UNKNOWN;
+    DoneFunc on_done = [&done_status](const Status& status) {
+      done_status = status;
+    };
+    // The first call is a cache miss, it fills the caches. The prefetch
+    // calls made by the next ones are spread out once its prediction is
+    // settled.
+    for (int i = 0; i < 1000; ++i) {
+      client_->Check(attributes_, quotas_, nullptr, on_done);
+      EXPECT_TRUE(done_status.ok());
+    }
+    Statistics stat;
+    client_->GetStatistics(&stat);
+    uint64_t remote_check_calls = stat.total_remote_check_calls;
+
+    int allocations = CountAllocations([&]() {
+      for (int i = 0; i < 100; ++i) {
+        done_status = Status::UNKNOWN;
+        client_->Check(attributes_, quotas_, nullptr, on_done);
+      }
+    });
+    EXPECT_TRUE(done_status.ok());
+    EXPECT_EQ(allocations, 0);
+
+    client_->GetStatistics(&stat);
+    EXPECT_EQ(stat.total_quota_calls, 1100);
+    EXPECT_EQ(stat.total_remote_check_calls, remote_check_calls);
+    EXPECT_EQ(stat.total_blocking_remote_quota_calls, 1);
+  }
+}
+
+TEST_F(ClientImplAllocationTest, TestCheckMissAllocates) {
+  CreateClient(CacheKeyHash::FAST);
+  // Allocations are counted, so the test above is meaningful.
+  int allocations = CountAllocations([&]() {
+    client_->Check(attributes_, no_quotas_, nullptr, [](const Status&) {});
+  });
+  EXPECT_GT(allocations, 0);
+}
+
+}  // namespace
+}  // namespace mixer_client
+}  // namespace istio
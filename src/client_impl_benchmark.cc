@@ -0,0 +1,121 @@
+/* Copyright 2018 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the cost of a MixerClient::Check call which hits the cache,
+// with and without a quota.
+// Usage: bazel run -c opt //:client_impl_benchmark
+
+#include "include/attributes_builder.h"
+#include "include/client.h"
+
+#include <stdio.h>
+#include <chrono>
+
+using ::istio::mixer::v1::Attributes;
+using ::istio::mixer::v1::CheckRequest;
+using ::istio::mixer::v1::CheckResponse;
+using ::istio::mixer::v1::ReferencedAttributes;
+using ::google::protobuf::util::Status;
+
+namespace istio {
+namespace mixer_client {
+namespace {
+
+const int kNumChecks = 1000000;
+
+const char kQuotaName[] = "RequestCount";
+
+// Responds OK for keys on target.service and source.name, granting the
+// requested quota amounts.
+CancelFunc FakeTransport(const CheckRequest& request, CheckResponse* response,
+                         DoneFunc on_done) {
+  response->mutable_precondition()->set_valid_use_count(-1);
+  auto referenced =
+      response->mutable_precondition()->mutable_referenced_attributes();
+  for (int name : {9 /* target.service */, 2 /* source.name */}) {
+    auto match = referenced->add_attribute_matches();
+    match->set_condition(ReferencedAttributes::EXACT);
+    match->set_name(name);
+  }
+  for (const auto& it : request.quotas()) {
+    CheckResponse::QuotaResult result;
+    result.set_granted_amount(it.second.amount());
+    (*response->mutable_quotas())[it.first] = result;
+  }
+  on_done(Status::OK);
+  return nullptr;
+}
+
+// Returns nanoseconds per cache hit check, with a quota if with_quota.
+double RunHits(CacheKeyHash hash, bool with_quota) {
+  MixerClientOptions options(CheckOptions(1000), ReportOptions(1000, 1000),
+                             QuotaOptions(1000, 600000));
+  options.check_options.cache_key_hash = hash;
+  options.env.check_transport = FakeTransport;
+  auto client = CreateMixerClient(options);
+
+  Attributes attributes;
+  AttributesBuilder builder(&attributes);
+  builder.AddString("target.service", "productpage.default.svc.cluster.local");
+  builder.AddString("source.name", "reviews-v1-5b7b7f7d8c-x2lqf");
+  builder.AddString("request.path", "/productpage?id=12345");
+  builder.AddStringMap("request.headers", {{":method", "GET"},
+                                           {":path", "/productpage"},
+                                           {"user-agent", "curl/7.54.0"}});
+
+  std::vector<::istio::quota::Requirement> quotas;
+  if (with_quota) {
+    quotas.push_back({kQuotaName, 1});
+  }
+  int ok_count = 0;
+  DoneFunc on_done = [&ok_count](const Status& status) {
+    if (status.ok()) {
+      ++ok_count;
+    }
+  };
+  // Fill the cache.
+  client->Check(attributes, quotas, nullptr, on_done);
+
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kNumChecks; ++i) {
+    client->Check(attributes, quotas, nullptr, on_done);
+  }
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  Statistics stat;
+  client->GetStatistics(&stat);
+  // The quota prefetch makes remote calls, but none of them blocks.
+  if (ok_count != kNumChecks + 1 ||
+      stat.total_blocking_remote_check_calls != 1) {
+    fprintf(stderr, "Unexpected cache miss\n");
+    abort();
+  }
+  return elapsed.count() / kNumChecks;
+}
+
+}  // namespace
+}  // namespace mixer_client
+}  // namespace istio
+
+int main(int argc, char** argv) {
+  using namespace ::istio::mixer_client;
+  printf("%8s %16s %24s\n", "hash", "ns/check hit", "ns/check+quota hit");
+  printf("%8s %16.1f %24.1f\n", "FAST", RunHits(CacheKeyHash::FAST, false),
+         RunHits(CacheKeyHash::FAST, true));
+  printf("%8s %16.1f %24.1f\n", "MD5", RunHits(CacheKeyHash::MD5, false),
+         RunHits(CacheKeyHash::MD5, true));
+  return 0;
+}
@@ -19,6 +19,8 @@
 #include "include/attributes_builder.h"
 #include "utils/status_test_util.h"
 
+#include <stdlib.h>
+
 using ::istio::mixer::v1::Attributes;
 using ::istio::mixer::v1::CheckRequest;
 using ::istio::mixer::v1::CheckResponse;
@@ -146,6 +148,85 @@ TEST_F(MixerClientImplTest, TestPerRequestTransport) {
   EXPECT_EQ(stat.total_blocking_remote_quota_calls, 0);
 }
 
+TEST_F(MixerClientImplTest, TestRawCheckTransport) {
+  MixerClientOptions options(CheckOptions(1 /* entries */),
+                             ReportOptions(1, 1000),
+                             QuotaOptions(1 /* entries */,
+                                          600000 /* expiration_ms */));
+  CheckRequest request;
+  options.env.raw_check_transport = [&request](
+      const std::string& serialized, CheckResponse* response,
+      DoneFunc on_done) -> CancelFunc {
+    EXPECT_TRUE(request.ParseFromString(serialized));
+    response->mutable_precondition()->set_valid_use_count(1000);
+    CheckResponse::QuotaResult quota_result;
+    quota_result.set_granted_amount(10);
+    (*response->mutable_quotas())[kRequestCount] = quota_result;
+    on_done(Status::OK);
+    return nullptr;
+  };
+  client_ = CreateMixerClient(options);
+
+  // The static attributes are compressed once.
+  Attributes static_attributes;
+  AttributesBuilder(&static_attributes)
+      .AddString("target.service", "productpage");
+  auto compressed_static = client_->CreateStaticAttributes(static_attributes);
+  ASSERT_TRUE(compressed_static != nullptr);
+  request_.MergeFrom(static_attributes);
+  AttributesBuilder(&request_).AddString("source.name", "reviews");
+
+  Status done_status = Status::UNKNOWN;
+  client_->Check(compressed_static.get(), request_, quotas_, empty_transport_,
+                 [&done_status](Status status) { done_status = status; });
+  EXPECT_TRUE(done_status.ok());
+  // The request has both the encoded attributes and the other fields.
+  EXPECT_EQ(request.attributes().strings_size(), 2);
+  EXPECT_EQ(request.quotas().count(kRequestCount), 1);
+  EXPECT_FALSE(request.deduplication_id().empty());
+}
+
+TEST_F(MixerClientImplTest, TestSynchronousTransportUsesRequestAfterDone) {
+  MixerClientOptions options(CheckOptions(0 /* entries */),
+                             ReportOptions(1, 1000),
+                             QuotaOptions(0 /* entries */,
+                                          600000 /* expiration_ms */));
+  // The transports read the request after calling back, it is still valid.
+  TransportCheckFunc transport = [](const CheckRequest& request,
+                                    CheckResponse* response,
+                                    DoneFunc on_done) -> CancelFunc {
+    std::string deduplication_id = request.deduplication_id();
+    response->mutable_precondition()->set_valid_use_count(1000);
+    on_done(Status::OK);
+    EXPECT_EQ(request.deduplication_id(), deduplication_id);
+    return nullptr;
+  };
+  options.env.raw_check_transport = [](const std::string& serialized,
+                                       CheckResponse* response,
+                                       DoneFunc on_done) -> CancelFunc {
+    std::string copy = serialized;
+    response->mutable_precondition()->set_valid_use_count(1000);
+    on_done(Status::OK);
+    EXPECT_EQ(serialized, copy);
+    return nullptr;
+  };
+  client_ = CreateMixerClient(options);
+  AttributesBuilder(&request_).AddString("source.name", "reviews");
+  std::vector<Requirement> empty_quotas;
+
+  for (int i = 0; i < 3; ++i) {
+    Status done_status = Status::UNKNOWN;
+    client_->Check(request_, empty_quotas, transport,
+                   [&done_status](Status status) { done_status = status; });
+    EXPECT_TRUE(done_status.ok());
+    // Uses the raw transport.
+    done_status = Status::UNKNOWN;
+    client_->Check(request_, empty_quotas, empty_transport_,
+                   [&done_status](Status status) { done_status = status; });
+    EXPECT_TRUE(done_status.ok());
+  }
+}
+
 TEST_F(MixerClientImplTest, TestNoCheckCache) {
   CreateClient(false /* check_cache */, true /* quota_cache */);
 
@@ -306,6 +387,295 @@ TEST_F(MixerClientImplTest, TestFailedCheckAndQuota) {
   EXPECT_EQ(stat.total_blocking_remote_quota_calls, 1);
 }
 
+TEST_F(MixerClientImplTest, TestMovedAttributesCheck) {
+  AttributesBuilder(&request_).AddString("target.service", "foo.svc");
+  std::vector<Requirement> empty_quotas;
+  DoneFunc pending;
+  TransportCheckFunc async_transport = [&pending](
+      const CheckRequest& request, CheckResponse* response,
+      DoneFunc on_done) -> CancelFunc {
+    response->mutable_precondition()->set_valid_use_count(1000);
+    auto match = response->mutable_precondition()
+                     ->mutable_referenced_attributes()
+                     ->add_attribute_matches();
+    match->set_condition(::istio::mixer::v1::ReferencedAttributes::EXACT);
+    match->set_name(9);  // target.service
+    pending = on_done;
+    return nullptr;
+  };
+
+  Attributes moved_request = request_;
+  Status done_status = Status::UNKNOWN;
+  client_->Check(std::move(moved_request), empty_quotas, async_transport,
+                 [&done_status](Status status) { done_status = status; });
+  // The attributes are owned by the remote call now.
+  EXPECT_EQ(moved_request.attributes_size(), 0);
+  ASSERT_TRUE(pending != nullptr);
+  pending(Status::OK);
+  EXPECT_TRUE(done_status.ok());
+
+  // The response is cached with the moved attributes.
+  Status done_status1 = Status::UNKNOWN;
+  client_->Check(request_, empty_quotas, async_transport,
+                 [&done_status1](Status status) { done_status1 = status; });
+  EXPECT_TRUE(done_status1.ok());
+
+  Statistics stat;
+  client_->GetStatistics(&stat);
+  EXPECT_EQ(stat.total_check_calls, 2);
+  EXPECT_EQ(stat.total_remote_check_calls, 1);
+}
+
+TEST_F(MixerClientImplTest, TestCoalescedCheck) {
+  std::vector<Requirement> empty_quotas;
+  // The first response is cached for one use.
+  EXPECT_CALL(mock_check_transport_, Check(_, _, _))
+      .WillOnce(Invoke([](const CheckRequest& request, CheckResponse* response,
+                          DoneFunc on_done) {
+        response->mutable_precondition()->set_valid_use_count(1);
+        on_done(Status::OK);
+      }));
+  for (int i = 0; i < 2; i++) {
+    Status done_status = Status::UNKNOWN;
+    client_->Check(request_, empty_quotas, empty_transport_,
+                   [&done_status](Status status) { done_status = status; });
+    EXPECT_TRUE(done_status.ok());
+  }
+
+  // The cache entry is expired now, the following misses share one call.
+  std::vector<DoneFunc> pending;
+  int cancel_count = 0;
+  TransportCheckFunc async_transport = [&](const CheckRequest& request,
+                                           CheckResponse* response,
+                                           DoneFunc on_done) -> CancelFunc {
+    response->mutable_precondition()->mutable_status()->set_code(
+        Code::PERMISSION_DENIED);
+    pending.push_back(on_done);
+    return [&cancel_count]() { ++cancel_count; };
+  };
+
+  std::vector<Status> done_status(4, Status::UNKNOWN);
+  std::vector<CancelFunc> cancels;
+  for (int i = 0; i < 4; i++) {
+    cancels.push_back(client_->Check(
+        request_, empty_quotas, async_transport,
+        [&done_status, i](Status status) { done_status[i] = status; }));
+  }
+  ASSERT_EQ(pending.size(), 1);
+
+  // A detached waiter is not called, nor is the remote call cancelled.
+  cancels[2]();
+  EXPECT_EQ(cancel_count, 0);
+
+  pending[0](Status::OK);
+  EXPECT_ERROR_CODE(Code::PERMISSION_DENIED, done_status[0]);
+  EXPECT_ERROR_CODE(Code::PERMISSION_DENIED, done_status[1]);
+  EXPECT_ERROR_CODE(Code::UNKNOWN, done_status[2]);
+  EXPECT_ERROR_CODE(Code::PERMISSION_DENIED, done_status[3]);
+
+  Statistics stat;
+  client_->GetStatistics(&stat);
+  EXPECT_EQ(stat.total_check_calls, 6);
+  EXPECT_EQ(stat.total_remote_check_calls, 2);
+  EXPECT_EQ(stat.total_blocking_remote_check_calls, 2);
+  EXPECT_EQ(stat.total_coalesced_check_calls, 3);
+}
+
+TEST_F(MixerClientImplTest, TestCoalescedCheckCancel) {
+  std::vector<Requirement> empty_quotas;
+  EXPECT_CALL(mock_check_transport_, Check(_, _, _))
+      .WillOnce(Invoke([](const CheckRequest& request, CheckResponse* response,
+                          DoneFunc on_done) {
+        response->mutable_precondition()->set_valid_use_count(0);
+        on_done(Status::OK);
+      }));
+  Status done_status = Status::UNKNOWN;
+  client_->Check(request_, empty_quotas, empty_transport_,
+                 [&done_status](Status status) { done_status = status; });
+  EXPECT_TRUE(done_status.ok());
+
+  int transport_count = 0;
+  int cancel_count = 0;
+  TransportCheckFunc async_transport = [&](const CheckRequest& request,
+                                           CheckResponse* response,
+                                           DoneFunc on_done) -> CancelFunc {
+    ++transport_count;
+    return [&cancel_count]() { ++cancel_count; };
+  };
+  CancelFunc cancel1 = client_->Check(request_, empty_quotas, async_transport,
+                                      [](Status status) { FAIL(); });
+  CancelFunc cancel2 = client_->Check(request_, empty_quotas, async_transport,
+                                      [](Status status) { FAIL(); });
+  EXPECT_EQ(transport_count, 1);
+
+  // The remote call is cancelled when its last waiter is gone.
+  cancel1();
+  EXPECT_EQ(cancel_count, 0);
+  cancel2();
+  EXPECT_EQ(cancel_count, 1);
+
+  // A new miss makes a new remote call.
+  client_->Check(request_, empty_quotas, async_transport, [](Status status) {});
+  EXPECT_EQ(transport_count, 2);
+}
+
+TEST_F(MixerClientImplTest, TestCoalescedCheckReferencedMismatch) {
+  std::vector<Requirement> empty_quotas;
+  // The learned Referenced has no attributes, all requests share a
+  // signature.
+  EXPECT_CALL(mock_check_transport_, Check(_, _, _))
+      .WillOnce(Invoke([](const CheckRequest& request, CheckResponse* response,
+                          DoneFunc on_done) {
+        response->mutable_precondition()->set_valid_use_count(0);
+        on_done(Status::OK);
+      }));
+  client_->Check(request_, empty_quotas, empty_transport_, [](Status status) {});
+
+  struct Call {
+    CheckResponse* response;
+    DoneFunc on_done;
+  };
+  std::vector<Call> pending;
+  int cancel_count = 0;
+  TransportCheckFunc async_transport = [&](const CheckRequest& request,
+                                           CheckResponse* response,
+                                           DoneFunc on_done) -> CancelFunc {
+    pending.push_back({response, on_done});
+    return [&cancel_count]() { ++cancel_count; };
+  };
+  // The response references source.user.
+  auto respond = [&pending](int index, Code code) {
+    auto precondition = pending[index].response->mutable_precondition();
+    precondition->mutable_status()->set_code(code);
+    auto referenced = precondition->mutable_referenced_attributes();
+    referenced->add_words("source.user");
+    auto match = referenced->add_attribute_matches();
+    match->set_name(-1);
+    match->set_condition(::istio::mixer::v1::ReferencedAttributes::EXACT);
+    pending[index].on_done(Status::OK);
+  };
+
+  std::vector<std::string> users = {"alice", "bob", "alice", "carol"};
+  std::vector<Status> done_status(users.size(), Status::UNKNOWN);
+  std::vector<CancelFunc> cancels;
+  for (size_t i = 0; i < users.size(); i++) {
+    Attributes attributes = request_;
+    AttributesBuilder(&attributes).AddString("source.user", users[i]);
+    cancels.push_back(client_->Check(
+        attributes, empty_quotas, async_transport,
+        [&done_status, i](Status status) { done_status[i] = status; }));
+  }
+  ASSERT_EQ(pending.size(), 1);
+
+  // Only the waiter with the same source.user gets the response, the
+  // others are checked again.
+  respond(0, Code::OK);
+  EXPECT_TRUE(done_status[0].ok());
+  EXPECT_TRUE(done_status[2].ok());
+  EXPECT_ERROR_CODE(Code::UNKNOWN, done_status[1]);
+  EXPECT_ERROR_CODE(Code::UNKNOWN, done_status[3]);
+  // They still share a signature under the first learned Referenced.
+  ASSERT_EQ(pending.size(), 2);
+
+  respond(1, Code::PERMISSION_DENIED);
+  EXPECT_ERROR_CODE(Code::PERMISSION_DENIED, done_status[1]);
+  EXPECT_ERROR_CODE(Code::UNKNOWN, done_status[3]);
+  ASSERT_EQ(pending.size(), 3);
+
+  // Detaching a waiter being checked again cancels its call.
+  cancels[3]();
+  EXPECT_EQ(cancel_count, 1);
+  respond(2, Code::OK);
+  EXPECT_ERROR_CODE(Code::UNKNOWN, done_status[3]);
+
+  Statistics stat;
+  client_->GetStatistics(&stat);
+  EXPECT_EQ(stat.total_check_calls, 5);
+  EXPECT_EQ(stat.total_remote_check_calls, 4);
+  EXPECT_EQ(stat.total_coalesced_check_calls, 4);
+}
+
+TEST_F(MixerClientImplTest, TestRefreshAheadCheck) {
+  MixerClientOptions options(CheckOptions(1), ReportOptions(1, 1000),
+                             QuotaOptions(1, 600000));
+  options.check_options.refresh_ahead_fraction = 0.5;
+  options.env.check_transport = mock_check_transport_.GetFunc();
+  client_ = CreateMixerClient(options);
+
+  int call_counts = 0;
+  std::vector<DoneFunc> pending;
+  EXPECT_CALL(mock_check_transport_, Check(_, _, _))
+      .WillRepeatedly(Invoke([&](const CheckRequest& request,
+                                 CheckResponse* response, DoneFunc on_done) {
+        response->mutable_precondition()->set_valid_use_count(4);
+        // The first call is blocking, others are left pending.
+        if (call_counts++ == 0) {
+          on_done(Status::OK);
+        } else {
+          pending.push_back(on_done);
+        }
+      }));
+
+  std::vector<Requirement> empty_quotas;
+  for (int i = 0; i < 4; i++) {
+    Status done_status = Status::UNKNOWN;
+    client_->Check(request_, empty_quotas, empty_transport_,
+                   [&done_status](Status status) { done_status = status; });
+    // All calls are completed without waiting for the refresh.
+    EXPECT_TRUE(done_status.ok());
+  }
+  // The 3rd call sent one refresh.
+  EXPECT_EQ(call_counts, 2);
+
+  // The refreshed entry serves more calls, until the next refresh.
+  pending[0](Status::OK);
+  for (int i = 0; i < 2; i++) {
+    Status done_status = Status::UNKNOWN;
+    client_->Check(request_, empty_quotas, empty_transport_,
+                   [&done_status](Status status) { done_status = status; });
+    EXPECT_TRUE(done_status.ok());
+    EXPECT_EQ(call_counts, 2 + i);
+  }
+
+  Statistics stat;
+  client_->GetStatistics(&stat);
+  EXPECT_EQ(stat.total_check_calls, 6);
+  EXPECT_EQ(stat.total_remote_check_calls, 3);
+  EXPECT_EQ(stat.total_blocking_remote_check_calls, 1);
+  EXPECT_EQ(stat.total_refresh_remote_check_calls, 2);
+}
+
+TEST_F(MixerClientImplTest, TestWarmStartFromSnapshot) {
+  EXPECT_CALL(mock_check_transport_, Check(_, _, _))
+      .WillOnce(Invoke([](const CheckRequest& request, CheckResponse* response,
+                          DoneFunc on_done) {
+        response->mutable_precondition()->set_valid_use_count(1000);
+        on_done(Status::OK);
+      }));
+  std::vector<Requirement> empty_quotas;
+  client_->Check(request_, empty_quotas, empty_transport_,
+                 [](Status status) { EXPECT_TRUE(status.ok()); });
+
+  const char* dir = getenv("TEST_TMPDIR");
+  std::string path = std::string(dir ? dir : "/tmp") + "/client_snapshot";
+  EXPECT_OK(client_->SaveSnapshot(path));
+
+  // A new client restored from the snapshot doesn't make remote calls.
+  MixerClientOptions options(CheckOptions(1), ReportOptions(1, 1000),
+                             QuotaOptions(1, 600000));
+  options.env.check_transport = mock_check_transport_.GetFunc();
+  options.snapshot_path = path;
+  client_ = CreateMixerClient(options);
+  for (int i = 0; i < 10; i++) {
+    client_->Check(request_, empty_quotas, empty_transport_,
+                   [](Status status) { EXPECT_TRUE(status.ok()); });
+  }
+  Statistics stat;
+  client_->GetStatistics(&stat);
+  EXPECT_EQ(stat.total_check_calls, 10);
+  EXPECT_EQ(stat.total_remote_check_calls, 0);
+}
+
 }  // namespace
 }  // namespace mixer_client
 }  // namespace istio
@@ -14,52 +14,101 @@
  */
 #include "src/delta_update.h"
 
-#include "google/protobuf/util/message_differencer.h"
-
-#include <set>
+#include <vector>
 
 using ::istio::mixer::v1::Attributes_AttributeValue;
-using ::google::protobuf::util::MessageDifferencer;
 
 namespace istio {
 namespace mixer_client {
 namespace {
 
+// Copies the value, reusing the buffers of a previous value of the same
+// type. CopyFrom() would clear them first.
+void Assign(const Attributes_AttributeValue& from,
+            Attributes_AttributeValue* to) {
+  switch (from.value_case()) {
+    case Attributes_AttributeValue::kStringValue:
+      to->set_string_value(from.string_value());
+      break;
+    case Attributes_AttributeValue::kBytesValue:
+      to->set_bytes_value(from.bytes_value());
+      break;
+    case Attributes_AttributeValue::kInt64Value:
+      to->set_int64_value(from.int64_value());
+      break;
+    case Attributes_AttributeValue::kDoubleValue:
+      to->set_double_value(from.double_value());
+      break;
+    case Attributes_AttributeValue::kBoolValue:
+      to->set_bool_value(from.bool_value());
+      break;
+    default:
+      to->CopyFrom(from);
+      break;
+  }
+}
+
 class DeltaUpdateImpl : public DeltaUpdate {
  public:
+  DeltaUpdateImpl() : generation_(0), num_entries_(0), num_checked_(0) {}
+
   // Start a update for a request.
   void Start() override {
-    prev_set_.clear();
-    for (const auto& it : prev_map_) {
-      prev_set_.insert(it.first);
-    }
+    ++generation_;
+    num_checked_ = 0;
   }
 
   bool Check(int index, const Attributes_AttributeValue& value) override {
+    Entry& entry = GetEntry(index);
     bool same = false;
-    const auto& it = prev_map_.find(index);
-    if (it != prev_map_.end()) {
-      if (MessageDifferencer::Equals(it->second, value)) {
-        same = true;
-      }
+    if (entry.generation == 0) {
+      ++num_entries_;
+    } else {
+      same = AttributeValueEquals(entry.value, value);
     }
     if (!same) {
-      prev_map_[index] = value;
+      Assign(value, &entry.value);
+    }
+    if (entry.generation != generation_) {
+      entry.generation = generation_;
+      ++num_checked_;
     }
-    prev_set_.erase(index);
     return same;
   }
 
   // "deleted" is not supported for now. If some attributes are missing,
   // return false to indicate delta update is not supported.
-  bool Finish() override { return prev_set_.empty(); }
+  bool Finish() override { return num_checked_ == num_entries_; }
 
  private:
-  // The remaining attributes from previous.
-  std::set<int> prev_set_;
+  struct Entry {
+    Entry() : generation(0) {}
+
+    Attributes_AttributeValue value;
+    // The last update checking this attribute, 0 if it is never checked.
+    uint64_t generation;
+  };
 
-  // The attribute map from previous.
-  std::map<int, Attributes_AttributeValue> prev_map_;
+  // Global dictionary indexes are positive, per message ones are negative.
+  Entry& GetEntry(int index) {
+    std::vector<Entry>& entries =
+        index >= 0 ? global_entries_ : message_entries_;
+    size_t offset = index >= 0 ? index : -(index + 1);
+    if (offset >= entries.size()) {
+      entries.resize(offset + 1);
+    }
+    return entries[offset];
+  }
+
+  // The attributes from previous, indexed by their dictionary index.
+  std::vector<Entry> global_entries_;
+  std::vector<Entry> message_entries_;
+
+  // The current update.
+  uint64_t generation_;
+  // The number of attributes ever checked, and checked in this update.
+  size_t num_entries_;
+  size_t num_checked_;
 };
 
 // An optimization for non-delta update case.
@@ -82,5 +131,47 @@ std::unique_ptr<DeltaUpdate> DeltaUpdate::CreateNoOp() {
   return std::unique_ptr<DeltaUpdate>(new DeltaUpdateNoOpImpl);
 }
 
+bool AttributeValueEquals(const Attributes_AttributeValue& a,
+                          const Attributes_AttributeValue& b) {
+  if (a.value_case() != b.value_case()) {
+    return false;
+  }
+  switch (a.value_case()) {
+    case Attributes_AttributeValue::kStringValue:
+      return a.string_value() == b.string_value();
+    case Attributes_AttributeValue::kBytesValue:
+      return a.bytes_value() == b.bytes_value();
+    case Attributes_AttributeValue::kInt64Value:
+      return a.int64_value() == b.int64_value();
+    case Attributes_AttributeValue::kDoubleValue:
+      return a.double_value() == b.double_value();
+    case Attributes_AttributeValue::kBoolValue:
+      return a.bool_value() == b.bool_value();
+    case Attributes_AttributeValue::kTimestampValue:
+      return a.timestamp_value().seconds() == b.timestamp_value().seconds() &&
+             a.timestamp_value().nanos() == b.timestamp_value().nanos();
+    case Attributes_AttributeValue::kDurationValue:
+      return a.duration_value().seconds() == b.duration_value().seconds() &&
+             a.duration_value().nanos() == b.duration_value().nanos();
+    case Attributes_AttributeValue::kStringMapValue: {
+      const auto& a_entries = a.string_map_value().entries();
+      const auto& b_entries = b.string_map_value().entries();
+      if (a_entries.size() != b_entries.size()) {
+        return false;
+      }
+      for (const auto& it : a_entries) {
+        const auto b_it = b_entries.find(it.first);
+        if (b_it == b_entries.end() || b_it->second != it.second) {
+          return false;
+        }
+      }
+      return true;
+    }
+    case Attributes_AttributeValue::VALUE_NOT_SET:
+      return true;
+  }
+  return false;
+}
+
 }  // namespace mixer_client
 }  // namespace istio
@@ -53,6 +53,12 @@ class DeltaUpdate {
   static std::unique_ptr<DeltaUpdate> CreateNoOp();
 };
 
+// Returns true if the attribute values are equal. Faster than
+// MessageDifferencer, it compares the value of the set type only.
+bool AttributeValueEquals(
+    const ::istio::mixer::v1::Attributes_AttributeValue& a,
+    const ::istio::mixer::v1::Attributes_AttributeValue& b);
+
 }  // namespace mixer_client
 }  // namespace istio
 
@@ -0,0 +1,152 @@
+/* Copyright 2018 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the cost of DeltaUpdate per batched report, against the
+// std::map and MessageDifferencer based implementation it replaced.
+// Usage: bazel run -c opt //:delta_update_benchmark
+
+#include "google/protobuf/util/message_differencer.h"
+#include "include/attributes_builder.h"
+#include "src/delta_update.h"
+
+#include <stdio.h>
+#include <chrono>
+#include <map>
+#include <set>
+#include <vector>
+
+using ::istio::mixer::v1::Attributes;
+using ::istio::mixer::v1::Attributes_AttributeValue;
+using ::google::protobuf::util::MessageDifferencer;
+
+namespace istio {
+namespace mixer_client {
+namespace {
+
+const int kNumReports = 200000;
+const int kNumVariants = 16;
+
+// The previous implementation.
+class MapDeltaUpdate : public DeltaUpdate {
+ public:
+  void Start() override {
+    prev_set_.clear();
+    for (const auto& it : prev_map_) {
+      prev_set_.insert(it.first);
+    }
+  }
+
+  bool Check(int index, const Attributes_AttributeValue& value) override {
+    bool same = false;
+    const auto& it = prev_map_.find(index);
+    if (it != prev_map_.end()) {
+      if (MessageDifferencer::Equals(it->second, value)) {
+        same = true;
+      }
+    }
+    if (!same) {
+      prev_map_[index] = value;
+    }
+    prev_set_.erase(index);
+    return same;
+  }
+
+  bool Finish() override { return prev_set_.empty(); }
+
+ private:
+  std::set<int> prev_set_;
+  std::map<int, Attributes_AttributeValue> prev_map_;
+};
+
+// Reports of one service with a few attributes changing per request.
+// Global dictionary indexes are positive, per message ones negative.
+std::vector<std::vector<std::pair<int, Attributes_AttributeValue>>>
+CreateReports() {
+  std::vector<std::vector<std::pair<int, Attributes_AttributeValue>>> reports;
+  for (int i = 0; i < kNumVariants; ++i) {
+    Attributes attributes;
+    AttributesBuilder builder(&attributes);
+    builder.AddString("target.service", "productpage.default.svc.cluster.local");
+    builder.AddString("target.name", "productpage-v1-6f7b9c7d5d-8xk2p");
+    builder.AddString("source.name", "reviews-v1-5b7b7f7d8c-x2lqf");
+    builder.AddString("source.ip", "10.0.0.12");
+    builder.AddString("request.method", "GET");
+    builder.AddString("request.path", "/productpage?id=" + std::to_string(i));
+    builder.AddString("request.scheme", "http");
+    builder.AddInt64("response.code", i % 8 == 0 ? 503 : 200);
+    builder.AddInt64("response.size", 4096 + i);
+    builder.AddInt64("request.size", 0);
+    builder.AddDuration("response.duration", std::chrono::microseconds(i));
+    builder.AddTimestamp("request.time", std::chrono::system_clock::now());
+    builder.AddBool("connection.mtls", true);
+    builder.AddStringMap("request.headers", {{":method", "GET"},
+                                             {":path", "/productpage"},
+                                             {"user-agent", "curl/7.54.0"},
+                                             {"x-request-id", "abc"}});
+    builder.AddStringMap("response.headers", {{":status", "200"},
+                                              {"content-type", "text/html"}});
+
+    std::vector<std::pair<int, Attributes_AttributeValue>> report;
+    int index = 0;
+    for (const auto& it : attributes.attributes()) {
+      // One in three names is not in the global dictionary.
+      int dict_index = index % 3 == 0 ? -(index / 3 + 1) : index * 7;
+      report.emplace_back(dict_index, it.second);
+      ++index;
+    }
+    reports.push_back(report);
+  }
+  return reports;
+}
+
+// Returns nanoseconds per report.
+double Run(DeltaUpdate* update) {
+  auto reports = CreateReports();
+  int same = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kNumReports; ++i) {
+    update->Start();
+    for (const auto& it : reports[i % kNumVariants]) {
+      if (update->Check(it.first, it.second)) {
+        ++same;
+      }
+    }
+    if (!update->Finish()) {
+      fprintf(stderr, "Unexpected missing attribute\n");
+      abort();
+    }
+  }
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+  if (same == 0) {
+    fprintf(stderr, "Unexpected delta\n");
+    abort();
+  }
+  return elapsed.count() / kNumReports;
+}
+
+}  // namespace
+}  // namespace mixer_client
+}  // namespace istio
+
+int main(int argc, char** argv) {
+  using namespace ::istio::mixer_client;
+  MapDeltaUpdate map_update;
+  auto update = DeltaUpdate::Create();
+  printf("%8s %16s\n", "impl", "ns/report");
+  printf("%8s %16.1f\n", "map", Run(&map_update));
+  printf("%8s %16.1f\n", "flat", Run(update.get()));
+  return 0;
+}
@@ -98,5 +98,60 @@ TEST_F(DeltaUpdateTest, TestDifferentType) {
   EXPECT_FALSE(update_->Check(1, StringValue("")));
 }
 
+TEST_F(DeltaUpdateTest, TestMessageDictionaryIndex) {
+  update_->Start();
+  EXPECT_TRUE(update_->Check(1, Int64Value(1)));
+  EXPECT_TRUE(update_->Check(2, Int64Value(2)));
+  EXPECT_TRUE(update_->Check(3, string_map_value_));
+  // Per message dictionary indexes are negative.
+  EXPECT_FALSE(update_->Check(-1, StringValue("foo")));
+  EXPECT_TRUE(update_->Finish());
+
+  update_->Start();
+  EXPECT_TRUE(update_->Check(-1, StringValue("foo")));
+  EXPECT_TRUE(update_->Check(1, Int64Value(1)));
+  // Checked twice, but 3 is missing.
+  EXPECT_TRUE(update_->Check(2, Int64Value(2)));
+  EXPECT_TRUE(update_->Check(2, Int64Value(2)));
+  EXPECT_FALSE(update_->Finish());
+}
+
+TEST_F(DeltaUpdateTest, TestValueTypes) {
+  std::vector<Attributes_AttributeValue> values(7);
+  values[0].set_bytes_value("bytes");
+  values[1].set_double_value(1.5);
+  values[2].set_bool_value(true);
+  values[3].mutable_timestamp_value()->set_seconds(1);
+  values[4].mutable_duration_value()->set_nanos(1);
+  values[5] = StringMapValue({{"foo", "bar"}, {"key", "value"}});
+  values[6] = StringValue("foo");
+
+  auto update = DeltaUpdate::Create();
+  update->Start();
+  for (size_t i = 0; i < values.size(); ++i) {
+    EXPECT_FALSE(update->Check(i, values[i]));
+  }
+  EXPECT_TRUE(update->Finish());
+
+  update->Start();
+  for (size_t i = 0; i < values.size(); ++i) {
+    EXPECT_TRUE(update->Check(i, values[i]));
+  }
+  EXPECT_TRUE(update->Finish());
+
+  values[0].set_bytes_value("other");
+  values[1].set_double_value(2.5);
+  values[2].set_bool_value(false);
+  values[3].mutable_timestamp_value()->set_nanos(1);
+  values[4].mutable_duration_value()->set_seconds(1);
+  values[5] = StringMapValue({{"foo", "bar"}, {"key", "other"}});
+  values[6] = StringValue("bar");
+  update->Start();
+  for (size_t i = 0; i < values.size(); ++i) {
+    EXPECT_FALSE(update->Check(i, values[i]));
+  }
+  EXPECT_TRUE(update->Finish());
+}
+
 }  // namespace mixer_client
 }  // namespace istio
@@ -25,6 +25,10 @@ namespace mixer_client {
 // Get automatically generated global words.
 const std::vector<std::string>& GetGlobalWords();
 
+// Get the index of a global word, or -1 if it is not one. It uses a perfect
+// hash generated with the words.
+int GetGlobalWordIndex(const std::string& word);
+
 }  // namespace mixer_client
 }  // namespace istio
 
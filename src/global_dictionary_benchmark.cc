@@ -0,0 +1,102 @@
+/* Copyright 2018 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures global dictionary lookups with the generated perfect hash,
+// against the std::unordered_map it replaced. GlobalDictionary::GetIndex
+// used to take the word by value, the copy is measured separately.
+// Usage: bazel run -c opt //:global_dictionary_benchmark
+
+#include "src/global_dictionary.h"
+
+#include <stdio.h>
+#include <chrono>
+#include <unordered_map>
+
+namespace istio {
+namespace mixer_client {
+namespace {
+
+const int kNumRounds = 20000;
+
+// Attribute names found in the dictionary, and string values which are
+// mostly not.
+std::vector<std::string> CreateLookups() {
+  std::vector<std::string> lookups = {
+      "productpage.default.svc.cluster.local",
+      "reviews-v1-5b7b7f7d8c-x2lqf",
+      "/productpage?id=12345",
+      "curl/7.54.0",
+      "10.0.0.12",
+      "GET",
+      "http",
+      "x-request-id",
+  };
+  const std::vector<std::string>& words = GetGlobalWords();
+  for (size_t i = 0; i < words.size(); i += 8) {
+    lookups.push_back(words[i]);
+  }
+  return lookups;
+}
+
+template <class Lookup>
+double Run(const std::vector<std::string>& lookups, Lookup lookup) {
+  int found = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kNumRounds; ++i) {
+    for (const std::string& word : lookups) {
+      if (lookup(word) >= 0) {
+        ++found;
+      }
+    }
+  }
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+  if (found == 0) {
+    fprintf(stderr, "No word found\n");
+    abort();
+  }
+  return elapsed.count() / (kNumRounds * lookups.size());
+}
+
+}  // namespace
+}  // namespace mixer_client
+}  // namespace istio
+
+int main(int argc, char** argv) {
+  using namespace ::istio::mixer_client;
+  std::unordered_map<std::string, int> map;
+  const std::vector<std::string>& words = GetGlobalWords();
+  for (size_t i = 0; i < words.size(); ++i) {
+    map[words[i]] = i;
+  }
+  std::vector<std::string> lookups = CreateLookups();
+
+  printf("%14s %16s\n", "lookup", "ns/lookup");
+  printf("%14s %16.1f\n", "unordered_map",
+         Run(lookups, [&map](const std::string& word) {
+           const auto it = map.find(word);
+           return it == map.end() ? -1 : it->second;
+         }));
+  printf("%14s %16.1f\n", "map with copy",
+         Run(lookups, [&map](const std::string word) {
+           const auto it = map.find(word);
+           return it == map.end() ? -1 : it->second;
+         }));
+  printf("%14s %16.1f\n", "perfect hash",
+         Run(lookups, [](const std::string& word) {
+           return GetGlobalWordIndex(word);
+         }));
+  return 0;
+}
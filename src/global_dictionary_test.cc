@@ -0,0 +1,54 @@
+/* Copyright 2018 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/global_dictionary.h"
+
+#include "gtest/gtest.h"
+
+#include <set>
+
+namespace istio {
+namespace mixer_client {
+namespace {
+
+TEST(GlobalDictionaryTest, TestAllWords) {
+  const std::vector<std::string>& words = GetGlobalWords();
+  ASSERT_FALSE(words.empty());
+  for (size_t i = 0; i < words.size(); ++i) {
+    EXPECT_EQ(GetGlobalWordIndex(words[i]), static_cast<int>(i)) << words[i];
+  }
+}
+
+TEST(GlobalDictionaryTest, TestOtherWords) {
+  EXPECT_EQ(GetGlobalWordIndex(""), -1);
+  EXPECT_EQ(GetGlobalWordIndex("productpage.default.svc.cluster.local"), -1);
+  const std::vector<std::string>& words = GetGlobalWords();
+  std::set<std::string> word_set(words.begin(), words.end());
+  for (const std::string& word : words) {
+    // Words differing in one byte or in length.
+    std::string changed = word;
+    changed.back() ^= 1;
+    for (const std::string& other :
+         {changed, word + "x", word.substr(0, word.size() - 1)}) {
+      if (word_set.count(other) == 0) {
+        EXPECT_EQ(GetGlobalWordIndex(other), -1) << other;
+      }
+    }
+  }
+}
+
+}  // namespace
+}  // namespace mixer_client
+}  // namespace istio
@@ -0,0 +1,96 @@
+/* Copyright 2018 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/learned_dictionary.h"
+
+#include <algorithm>
+
+namespace istio {
+namespace mixer_client {
+namespace {
+
+// Message dictionary indexes 0 to 63 are encoded in one byte.
+const size_t kMaxLearnedWords = 64;
+
+// The weight of the latest batch in the moving averages.
+const double kWeight = 0.1;
+
+// A word missing from a batch costs its encoded size, it is only learned
+// if most batches use it.
+const double kMinPresence = 0.8;
+
+// Words with the lowest averages are forgotten beyond this many per
+// learned word.
+const size_t kTrackedWordsPerWord = 16;
+
+}  // namespace
+
+LearnedDictionary::LearnedDictionary(int max_words)
+    : max_words_(std::min(static_cast<size_t>(std::max(max_words, 0)),
+                          kMaxLearnedWords)),
+      bytes_saved_(0) {}
+
+void LearnedDictionary::Update(
+    const ::google::protobuf::RepeatedPtrField<std::string>& words,
+    const std::vector<int>& references, int64_t bytes_saved) {
+  bytes_saved_ += bytes_saved;
+  for (auto& it : stats_) {
+    it.second.presence *= 1 - kWeight;
+    it.second.references *= 1 - kWeight;
+  }
+  for (int i = 0; i < words.size(); ++i) {
+    if (references[i] == 0) {
+      continue;
+    }
+    WordStat& stat = stats_.emplace(words[i], WordStat{0, 0}).first->second;
+    stat.presence += kWeight;
+    stat.references += kWeight * references[i];
+  }
+
+  std::vector<std::pair<double, const std::string*>> ranked;
+  for (const auto& it : stats_) {
+    ranked.emplace_back(it.second.references, &it.first);
+  }
+  std::sort(ranked.begin(), ranked.end(),
+            [](const std::pair<double, const std::string*>& a,
+               const std::pair<double, const std::string*>& b) {
+              return a.first > b.first;
+            });
+
+  words_.clear();
+  for (const auto& it : ranked) {
+    if (words_.size() >= max_words_) {
+      break;
+    }
+    if (stats_[*it.second].presence >= kMinPresence) {
+      words_.push_back(*it.second);
+    }
+  }
+
+  const size_t max_tracked = std::max<size_t>(max_words_, 1) *
+                             kTrackedWordsPerWord;
+  if (ranked.size() > max_tracked) {
+    std::vector<std::string> forgotten;
+    for (size_t i = max_tracked; i < ranked.size(); ++i) {
+      forgotten.push_back(*ranked[i].second);
+    }
+    for (const auto& word : forgotten) {
+      stats_.erase(word);
+    }
+  }
+}
+
+}  // namespace mixer_client
+}  // namespace istio
@@ -0,0 +1,72 @@
+/* Copyright 2018 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIXERCLIENT_LEARNED_DICTIONARY_H
+#define MIXERCLIENT_LEARNED_DICTIONARY_H
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "google/protobuf/repeated_field.h"
+#include "google/protobuf/stubs/common.h"
+
+namespace istio {
+namespace mixer_client {
+
+// Learns the words, not in the global dictionary, which are used by most
+// report batches. A batch compressor puts them first in its per message
+// dictionary, so their references take the shortest indexes.
+// Update() and words() are not thread safe, bytes_saved() is.
+class LearnedDictionary {
+ public:
+  // At most 64 words fit in one byte indexes, max_words is capped to it.
+  explicit LearnedDictionary(int max_words);
+
+  // The learned words, the most referenced first.
+  const std::vector<std::string>& words() const { return words_; }
+
+  // Learns from a finished batch: its per message words, the number of
+  // references to each, and the bytes saved by the learned words.
+  void Update(const ::google::protobuf::RepeatedPtrField<std::string>& words,
+              const std::vector<int>& references, int64_t bytes_saved);
+
+  // The total bytes saved, negative if the learned words cost more than
+  // they saved.
+  int64_t bytes_saved() const { return bytes_saved_; }
+
+ private:
+  // Moving averages over the recent batches.
+  struct WordStat {
+    // The fraction of the batches using the word.
+    double presence;
+    // References per batch.
+    double references;
+  };
+
+  const size_t max_words_;
+  std::unordered_map<std::string, WordStat> stats_;
+  std::vector<std::string> words_;
+  std::atomic<int64_t> bytes_saved_;
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(LearnedDictionary);
+};
+
+}  // namespace mixer_client
+}  // namespace istio
+
+#endif  // MIXERCLIENT_LEARNED_DICTIONARY_H
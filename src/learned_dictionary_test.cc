@@ -0,0 +1,64 @@
+/* Copyright 2018 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/learned_dictionary.h"
+
+#include "gtest/gtest.h"
+
+namespace istio {
+namespace mixer_client {
+namespace {
+
+::google::protobuf::RepeatedPtrField<std::string> Words(
+    const std::vector<std::string>& words) {
+  return ::google::protobuf::RepeatedPtrField<std::string>(words.begin(),
+                                                           words.end());
+}
+
+TEST(LearnedDictionaryTest, TestLearnFrequentWords) {
+  LearnedDictionary dict(2);
+  for (int i = 0; i < 50; ++i) {
+    // "rare" is used by every other batch only.
+    dict.Update(Words({"hot", "warm", "rare", "batch" + std::to_string(i)}),
+                {10, 2, i % 2 == 0 ? 100 : 0, 1}, 1);
+  }
+  EXPECT_EQ(dict.words(), std::vector<std::string>({"hot", "warm"}));
+  EXPECT_EQ(dict.bytes_saved(), 50);
+
+  // Words not used any more are forgotten.
+  for (int i = 0; i < 50; ++i) {
+    dict.Update(Words({"warm", "new"}), {2, 1}, -1);
+  }
+  EXPECT_EQ(dict.words(), std::vector<std::string>({"warm", "new"}));
+  EXPECT_EQ(dict.bytes_saved(), 0);
+}
+
+TEST(LearnedDictionaryTest, TestMaxWords) {
+  LearnedDictionary dict(1000);
+  std::vector<std::string> words;
+  for (int i = 0; i < 100; ++i) {
+    words.push_back("word" + std::to_string(i));
+  }
+  std::vector<int> references(words.size(), 1);
+  for (int i = 0; i < 50; ++i) {
+    dict.Update(Words(words), references, 0);
+  }
+  // Only indexes encoded in one byte are used.
+  EXPECT_EQ(dict.words().size(), 64);
+}
+
+}  // namespace
+}  // namespace mixer_client
+}  // namespace istio
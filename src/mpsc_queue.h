@@ -0,0 +1,83 @@
+/* Copyright 2018 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIXERCLIENT_MPSC_QUEUE_H
+#define MIXERCLIENT_MPSC_QUEUE_H
+
+#include "google/protobuf/stubs/common.h"
+
+#include <atomic>
+#include <utility>
+
+namespace istio {
+namespace mixer_client {
+
+// A multi-producer single-consumer FIFO queue.
+// Push() is lock free and can be called from any thread. Pop() must not be
+// called concurrently, callers serialize it.
+// A pushed item may not be visible to Pop() until its Push() returns.
+template <class T>
+class MpscQueue {
+ public:
+  MpscQueue() : head_(new Node), tail_(head_.load()) {}
+
+  ~MpscQueue() {
+    T value;
+    while (Pop(&value)) {
+    }
+    delete tail_;
+  }
+
+  // Adds a value to the queue.
+  void Push(T&& value) {
+    Node* node = new Node(std::move(value));
+    Node* prev = head_.exchange(node, std::memory_order_acq_rel);
+    prev->next.store(node, std::memory_order_release);
+  }
+
+  // Removes the oldest value from the queue. Returns false if it is empty.
+  bool Pop(T* value) {
+    Node* next = tail_->next.load(std::memory_order_acquire);
+    if (next == nullptr) {
+      return false;
+    }
+    *value = std::move(next->value);
+    delete tail_;
+    // The popped node becomes the new dummy node.
+    tail_ = next;
+    return true;
+  }
+
+ private:
+  struct Node {
+    Node() : next(nullptr) {}
+    explicit Node(T&& value) : value(std::move(value)), next(nullptr) {}
+
+    T value;
+    std::atomic<Node*> next;
+  };
+
+  // The last pushed node, updated by producers.
+  std::atomic<Node*> head_;
+  // The dummy node before the oldest value, only used by the consumer.
+  Node* tail_;
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(MpscQueue);
+};
+
+}  // namespace mixer_client
+}  // namespace istio
+
+#endif  // MIXERCLIENT_MPSC_QUEUE_H
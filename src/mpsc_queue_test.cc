@@ -0,0 +1,82 @@
+/* Copyright 2018 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/mpsc_queue.h"
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace istio {
+namespace mixer_client {
+namespace {
+
+TEST(MpscQueueTest, TestFifo) {
+  MpscQueue<std::unique_ptr<int>> queue;
+  std::unique_ptr<int> value;
+  EXPECT_FALSE(queue.Pop(&value));
+
+  for (int i = 0; i < 3; ++i) {
+    queue.Push(std::unique_ptr<int>(new int(i)));
+  }
+  for (int i = 0; i < 3; ++i) {
+    ASSERT_TRUE(queue.Pop(&value));
+    EXPECT_EQ(*value, i);
+  }
+  EXPECT_FALSE(queue.Pop(&value));
+
+  // Values left in the queue are deleted with it.
+  queue.Push(std::unique_ptr<int>(new int(3)));
+}
+
+TEST(MpscQueueTest, TestMultipleProducers) {
+  const int kNumThreads = 4;
+  const int kNumValues = 10000;
+  MpscQueue<int> queue;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kNumThreads; ++t) {
+    threads.push_back(std::thread([&queue, t]() {
+      for (int i = 0; i < kNumValues; ++i) {
+        queue.Push(t * kNumValues + i);
+      }
+    }));
+  }
+
+  // Values from one producer are popped in order.
+  std::vector<int> next(kNumThreads, 0);
+  int count = 0;
+  while (count < kNumThreads * kNumValues) {
+    int value;
+    if (!queue.Pop(&value)) {
+      std::this_thread::yield();
+      continue;
+    }
+    int t = value / kNumValues;
+    EXPECT_EQ(value % kNumValues, next[t]);
+    next[t] = value % kNumValues + 1;
+    ++count;
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  int value;
+  EXPECT_FALSE(queue.Pop(&value));
+}
+
+}  // namespace
+}  // namespace mixer_client
+}  // namespace istio
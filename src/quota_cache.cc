@@ -14,6 +14,7 @@
  */
 
 #include "src/quota_cache.h"
+#include "utils/fast_hash.h"
 #include "utils/protobuf.h"
 
 using namespace std::chrono;
@@ -73,33 +74,32 @@ bool QuotaCache::CheckResult::IsCacheHit() const {
   return status_.error_code() != Code::UNAVAILABLE;
 }
 
-bool QuotaCache::CheckResult::BuildRequest(CheckRequest* request) {
+bool QuotaCache::CheckResult::SetCacheStatus() {
   int pending_count = 0;
-  std::string rejected_quota_names;
   for (const auto& quota : quotas_) {
-    // TODO: return used quota amount to passed quotas.
-    if (quota.result == Quota::Rejected) {
-      if (!rejected_quota_names.empty()) {
-        rejected_quota_names += ",";
-      }
-      rejected_quota_names += quota.name;
-    } else if (quota.result == Quota::Pending) {
+    if (quota.result == Quota::Pending) {
       ++pending_count;
     }
-    if (quota.response_func) {
-      CheckRequest::QuotaParams param;
-      param.set_amount(quota.amount);
-      param.set_best_effort(quota.best_effort);
-      (*request->mutable_quotas())[quota.name] = param;
-    }
   }
-  if (!rejected_quota_names.empty()) {
+  // TODO: return used quota amount to passed quotas.
+  if (!rejected_quota_names_.empty()) {
     status_ =
         Status(Code::RESOURCE_EXHAUSTED,
-               std::string("Quota is exhausted for: ") + rejected_quota_names);
+               std::string("Quota is exhausted for: ") + rejected_quota_names_);
   } else if (pending_count == 0) {
     status_ = Status::OK;
   }
+  return !quotas_.empty();
+}
+
+bool QuotaCache::CheckResult::BuildRequest(CheckRequest* request) {
+  SetCacheStatus();
+  for (const auto& quota : quotas_) {
+    CheckRequest::QuotaParams param;
+    param.set_amount(quota.amount);
+    param.set_best_effort(quota.best_effort);
+    (*request->mutable_quotas())[quota.name] = param;
+  }
   return request->quotas().size() > 0;
 }
 
@@ -137,7 +137,8 @@ void QuotaCache::CheckResult::SetResponse(const Status& status,
   }
 }
 
-QuotaCache::QuotaCache(const QuotaOptions& options) : options_(options) {
+QuotaCache::QuotaCache(const QuotaOptions& options)
+    : options_(options), hash_seed_(FastHash::RandomSeed()) {
   if (options.num_entries > 0) {
     cache_.reset(new QuotaLRUCache(options.num_entries));
     cache_->SetMaxIdleSeconds(options.expiration_ms / 1000.0);
@@ -149,8 +150,8 @@ QuotaCache::~QuotaCache() {
   FlushAll();
 }
 
-void QuotaCache::CheckCache(const Attributes& request, bool check_use_cache,
-                            CheckResult::Quota* quota) {
+void QuotaCache::CheckCache(const Attributes& request, const std::string& name,
+                            bool check_use_cache, CheckResult::Quota* quota) {
   // If check is not using cache, that check may be rejected.
   // If quota cache is used, quota amount is already substracted from the cache.
   // If the check is rejected, there is not easy way to add them back to cache.
@@ -168,11 +169,12 @@ void QuotaCache::CheckCache(const Attributes& request, bool check_use_cache,
   }
 
   std::lock_guard<std::mutex> lock(cache_mutex_);
-  PerQuotaReferenced& quota_ref = quota_referenced_map_[quota->name];
+  PerQuotaReferenced& quota_ref = quota_referenced_map_[name];
   for (const auto& it : quota_ref.referenced_map) {
     const Referenced& referenced = it.second;
-    std::string signature;
-    if (!referenced.Signature(request, quota->name, &signature)) {
+    SignatureKey signature;
+    if (!referenced.Signature(request, name, options_.cache_key_hash,
+                              hash_seed_, &signature)) {
       continue;
     }
     QuotaLRUCache::ScopedLookup lookup(cache_.get(), signature);
@@ -184,12 +186,12 @@ void QuotaCache::CheckCache(const Attributes& request, bool check_use_cache,
   }
 
   if (!quota_ref.pending_item) {
-    quota_ref.pending_item.reset(new CacheElem(quota->name));
+    quota_ref.pending_item.reset(new CacheElem(name));
   }
   quota_ref.pending_item->Quota(quota->amount, quota);
 
   auto saved_func = quota->response_func;
-  std::string quota_name = quota->name;
+  std::string quota_name = name;
   quota->response_func = [saved_func, quota_name, this](
       const Attributes& attributes,
       const CheckResponse::QuotaResult* result) -> bool {
@@ -213,8 +215,9 @@ void QuotaCache::SetResponse(const Attributes& attributes,
     return;
   }
 
-  std::string signature;
-  if (!referenced.Signature(attributes, quota_name, &signature)) {
+  SignatureKey signature;
+  if (!referenced.Signature(attributes, quota_name, options_.cache_key_hash,
+                            hash_seed_, &signature)) {
     GOOGLE_LOG(ERROR) << "Quota response referenced mismatchs with request";
     GOOGLE_LOG(ERROR) << "Request attributes: " << attributes.DebugString();
     GOOGLE_LOG(ERROR) << "Referenced attributes: " << referenced.DebugString();
@@ -243,9 +246,23 @@ void QuotaCache::Check(const Attributes& request,
                        const std::vector<Requirement>& quotas, bool use_cache,
                        CheckResult* result) {
   for (const auto& requirement : quotas) {
-    CheckResult::Quota quota = {requirement.quota, requirement.charge};
-    CheckCache(request, use_cache, &quota);
-    result->quotas_.push_back(quota);
+    // The name is not copied for a quota passed by the cache, so a cache
+    // hit doesn't allocate memory.
+    CheckResult::Quota quota;
+    quota.amount = requirement.charge;
+    quota.best_effort = false;
+    quota.result = CheckResult::Quota::Pending;
+    CheckCache(request, requirement.quota, use_cache, &quota);
+    if (quota.result == CheckResult::Quota::Rejected) {
+      if (!result->rejected_quota_names_.empty()) {
+        result->rejected_quota_names_ += ",";
+      }
+      result->rejected_quota_names_ += requirement.quota;
+    }
+    if (quota.response_func) {
+      quota.name = requirement.quota;
+      result->quotas_.push_back(std::move(quota));
+    }
   }
 }
 
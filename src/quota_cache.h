@@ -42,17 +42,23 @@ class QuotaCache {
   // A class to batch multiple quota requests.
   // Its usage:
   //     cache->Quota(attributes, &result);
-  //     send = result->BuildRequest(&request);
+  //     send = result->SetCacheStatus();
   //     if (cache->IsCacheHit()) return result->Result();
-  // If send is true, make a remote call, on response.
+  // If send is true, build the request with result->BuildRequest(&request),
+  // make a remote call, on response.
   //     result->SetResponse(status, response);
   //     return result->Result();
   class CheckResult {
    public:
     CheckResult();
 
+    // Sets the status from the quotas checked by the cache, return true if
+    // remote quota call is required. It doesn't allocate memory unless a
+    // quota is rejected, so the request can be built only when needed.
+    bool SetCacheStatus();
+
     // Build CheckRequest::quotas fields, return true if remote quota call
-    // is required.
+    // is required. It also calls SetCacheStatus().
     bool BuildRequest(::istio::mixer::v1::CheckRequest* request);
 
     bool IsCacheHit() const;
@@ -87,7 +93,11 @@ class QuotaCache {
 
     ::google::protobuf::util::Status status_;
 
-    // The list of pending quota needed to talk to server.
+    // The names of the rejected quotas, separated by ",".
+    std::string rejected_quota_names_;
+
+    // The list of pending quota needed to talk to server. The quotas
+    // passed by the cache without a prefetch are not kept.
     std::vector<Quota> quotas_;
   };
 
@@ -97,8 +107,10 @@ class QuotaCache {
              bool use_cache, CheckResult* result);
 
  private:
-  // Check quota cache.
-  void CheckCache(const ::istio::mixer::v1::Attributes& request, bool use_cache,
+  // Check quota cache. The quota name is only set in quota if it needs
+  // a remote call.
+  void CheckCache(const ::istio::mixer::v1::Attributes& request,
+                  const std::string& name, bool use_cache,
                   CheckResult::Quota* quota);
 
   // Invalidates expired check responses.
@@ -154,11 +166,15 @@ class QuotaCache {
 
   // Key is the signature of the Attributes. Value is the CacheElem.
   // It is a LRU cache with MaxIdelTime as response_expiration_time.
-  using QuotaLRUCache = SimpleLRUCache<std::string, CacheElem>;
+  using QuotaLRUCache =
+      SimpleLRUCache<SignatureKey, CacheElem, SignatureKey::Hash>;
 
   // The quota options.
   QuotaOptions options_;
 
+  // The seed for CacheKeyHash::FAST.
+  uint64_t hash_seed_;
+
   // Mutex guarding the access of cache_ and quota_referenced_map_
   std::mutex cache_mutex_;
 
@@ -16,6 +16,7 @@
 #include "referenced.h"
 
 #include "global_dictionary.h"
+#include "utils/fast_hash.h"
 
 #include <algorithm>
 #include <map>
@@ -114,9 +115,10 @@ bool Referenced::Fill(const Attributes &attributes,
   return true;
 }
 
-bool Referenced::Signature(const Attributes &attributes,
-                           const std::string &extra_key,
-                           std::string *signature) const {
+template <class Hasher>
+bool Referenced::UpdateSignature(const Attributes &attributes,
+                                 const std::string &extra_key,
+                                 Hasher *hasher) const {
   const auto &attributes_map = attributes.attributes();
 
   for (std::size_t i = 0; i < absence_keys_.size(); ++i) {
@@ -133,13 +135,14 @@ bool Referenced::Signature(const Attributes &attributes,
       return false;
     }
 
-    std::string map_key = key.map_key;
+    // Point to the key instead of copying it, not to allocate.
+    const std::string *map_key = &key.map_key;
     const auto &smap = value.string_map_value().entries();
     // Since absence_keys_ are sorted by key.name,
     // continue processing stringMaps until a new name is found.
     do {
       // if subkey is found, it is a violation of "absence" constrain.
-      if (smap.find(map_key) != smap.end()) {
+      if (smap.find(*map_key) != smap.end()) {
         return false;
       }
       // break loop if at the end or keyname changes.
@@ -148,13 +151,11 @@ bool Referenced::Signature(const Attributes &attributes,
         break;
       }
 
-      map_key = absence_keys_[++i].map_key;
+      map_key = &absence_keys_[++i].map_key;
 
     } while (true);
   }
 
-  MD5 hasher;
-
   for (std::size_t i = 0; i < exact_keys_.size(); ++i) {
     const auto &key = exact_keys_[i];
     const auto it = attributes_map.find(key.name);
@@ -163,59 +164,59 @@ bool Referenced::Signature(const Attributes &attributes,
       return false;
     }
 
-    hasher.Update(it->first);
-    hasher.Update(kDelimiter, kDelimiterLength);
+    hasher->Update(it->first);
+    hasher->Update(kDelimiter, kDelimiterLength);
 
     const Attributes_AttributeValue &value = it->second;
     switch (value.value_case()) {
       case Attributes_AttributeValue::kStringValue:
-        hasher.Update(value.string_value());
+        hasher->Update(value.string_value());
         break;
       case Attributes_AttributeValue::kBytesValue:
-        hasher.Update(value.bytes_value());
+        hasher->Update(value.bytes_value());
         break;
       case Attributes_AttributeValue::kInt64Value: {
         auto data = value.int64_value();
-        hasher.Update(&data, sizeof(data));
+        hasher->Update(&data, sizeof(data));
       } break;
       case Attributes_AttributeValue::kDoubleValue: {
         auto data = value.double_value();
-        hasher.Update(&data, sizeof(data));
+        hasher->Update(&data, sizeof(data));
       } break;
       case Attributes_AttributeValue::kBoolValue: {
         auto data = value.bool_value();
-        hasher.Update(&data, sizeof(data));
+        hasher->Update(&data, sizeof(data));
       } break;
       case Attributes_AttributeValue::kTimestampValue: {
         auto seconds = value.timestamp_value().seconds();
         auto nanos = value.timestamp_value().nanos();
-        hasher.Update(&seconds, sizeof(seconds));
-        hasher.Update(kDelimiter, kDelimiterLength);
-        hasher.Update(&nanos, sizeof(nanos));
+        hasher->Update(&seconds, sizeof(seconds));
+        hasher->Update(kDelimiter, kDelimiterLength);
+        hasher->Update(&nanos, sizeof(nanos));
       } break;
       case Attributes_AttributeValue::kDurationValue: {
         auto seconds = value.duration_value().seconds();
         auto nanos = value.duration_value().nanos();
-        hasher.Update(&seconds, sizeof(seconds));
-        hasher.Update(kDelimiter, kDelimiterLength);
-        hasher.Update(&nanos, sizeof(nanos));
+        hasher->Update(&seconds, sizeof(seconds));
+        hasher->Update(kDelimiter, kDelimiterLength);
+        hasher->Update(&nanos, sizeof(nanos));
       } break;
       case Attributes_AttributeValue::kStringMapValue: {
-        std::string map_key = key.map_key;
+        const std::string *map_key = &key.map_key;
         const auto &smap = value.string_map_value().entries();
         // Since exact_keys_ are sorted by key.name,
         // continue processing stringMaps until a new name is found.
         do {
-          const auto sub_it = smap.find(map_key);
+          const auto sub_it = smap.find(*map_key);
           // exact match of map_key is missing
           if (sub_it == smap.end()) {
             return false;
           }
 
-          hasher.Update(sub_it->first);
-          hasher.Update(kDelimiter, kDelimiterLength);
-          hasher.Update(sub_it->second);
-          hasher.Update(kDelimiter, kDelimiterLength);
+          hasher->Update(sub_it->first);
+          hasher->Update(kDelimiter, kDelimiterLength);
+          hasher->Update(sub_it->second);
+          hasher->Update(kDelimiter, kDelimiterLength);
 
           // break loop if at the end or keyname changes.
           if (i + 1 == exact_keys_.size() ||
@@ -223,20 +224,59 @@ bool Referenced::Signature(const Attributes &attributes,
             break;
           }
 
-          map_key = exact_keys_[++i].map_key;
+          map_key = &exact_keys_[++i].map_key;
         } while (true);
       } break;
       case Attributes_AttributeValue::VALUE_NOT_SET:
         break;
     }
-    hasher.Update(kDelimiter, kDelimiterLength);
+    hasher->Update(kDelimiter, kDelimiterLength);
   }
-  hasher.Update(extra_key);
+  hasher->Update(extra_key);
+  return true;
+}
 
+bool Referenced::Signature(const Attributes &attributes,
+                           const std::string &extra_key,
+                           std::string *signature) const {
+  MD5 hasher;
+  if (!UpdateSignature(attributes, extra_key, &hasher)) {
+    return false;
+  }
   *signature = hasher.Digest();
   return true;
 }
 
+bool Referenced::Signature(const Attributes &attributes,
+                           const std::string &extra_key, CacheKeyHash hash,
+                           uint64_t seed, std::string *signature) const {
+  SignatureKey key;
+  if (!Signature(attributes, extra_key, hash, seed, &key)) {
+    return false;
+  }
+  *signature = key.ToString();
+  return true;
+}
+
+bool Referenced::Signature(const Attributes &attributes,
+                           const std::string &extra_key, CacheKeyHash hash,
+                           uint64_t seed, SignatureKey *signature) const {
+  if (hash == CacheKeyHash::MD5) {
+    MD5 hasher;
+    if (!UpdateSignature(attributes, extra_key, &hasher)) {
+      return false;
+    }
+    hasher.Digest(signature->bytes);
+    return true;
+  }
+  FastHash hasher(seed);
+  if (!UpdateSignature(attributes, extra_key, &hasher)) {
+    return false;
+  }
+  hasher.Digest(signature->bytes);
+  return true;
+}
+
 std::string Referenced::Hash() const {
   MD5 hasher;
 
@@ -248,6 +288,47 @@ std::string Referenced::Hash() const {
   return hasher.Digest();
 }
 
+void Referenced::SaveKeys(const std::vector<AttributeRef> &keys,
+                          SnapshotWriter *writer) {
+  writer->PutUint32(keys.size());
+  for (const AttributeRef &key : keys) {
+    writer->PutString(key.name);
+    writer->PutString(key.map_key);
+  }
+}
+
+bool Referenced::LoadKeys(SnapshotReader *reader,
+                          std::vector<AttributeRef> *keys) {
+  uint32_t size;
+  if (!reader->GetUint32(&size)) {
+    return false;
+  }
+  keys->clear();
+  for (uint32_t i = 0; i < size; ++i) {
+    ::google::protobuf::StringPiece name;
+    ::google::protobuf::StringPiece map_key;
+    if (!reader->GetString(&name) || !reader->GetString(&map_key)) {
+      return false;
+    }
+    AttributeRef key;
+    key.name = name.ToString();
+    key.map_key = map_key.ToString();
+    keys->push_back(std::move(key));
+  }
+  // Keys are saved sorted, but don't trust the file.
+  std::sort(keys->begin(), keys->end());
+  return true;
+}
+
+void Referenced::Save(SnapshotWriter *writer) const {
+  SaveKeys(absence_keys_, writer);
+  SaveKeys(exact_keys_, writer);
+}
+
+bool Referenced::Load(SnapshotReader *reader) {
+  return LoadKeys(reader, &absence_keys_) && LoadKeys(reader, &exact_keys_);
+}
+
 std::string Referenced::DebugString() const {
   std::stringstream ss;
   ss << "Absence-keys: ";
@@ -16,14 +16,44 @@
 #ifndef MIXER_CLIENT_REFERENCED_H_
 #define MIXER_CLIENT_REFERENCED_H_
 
+#include <string.h>
+#include <string>
 #include <vector>
 
+#include "include/options.h"
 #include "mixer/v1/check.pb.h"
+#include "src/cache_snapshot.h"
+#include "utils/fast_hash.h"
 #include "utils/md5.h"
 
 namespace istio {
 namespace mixer_client {
 
+// A fixed size cache signature. Unlike a string signature, creating one
+// doesn't allocate memory, so cache hits don't allocate.
+struct SignatureKey {
+  static const int kLength = 16;
+  char bytes[kLength];
+
+  bool operator==(const SignatureKey &other) const {
+    return memcmp(bytes, other.bytes, kLength) == 0;
+  }
+
+  std::string ToString() const { return std::string(bytes, kLength); }
+
+  // Signatures are digests, any of their bits are evenly distributed.
+  struct Hash {
+    size_t operator()(const SignatureKey &key) const {
+      size_t hash;
+      memcpy(&hash, key.bytes, sizeof(hash));
+      return hash;
+    }
+  };
+};
+static_assert(SignatureKey::kLength == MD5::kDigestLength &&
+                  SignatureKey::kLength == FastHash::kDigestLength,
+              "SignatureKey holds a digest");
+
 // The object to store referenced attributes used by Mixer server.
 // Mixer client cache should only use referenced attributes
 // in its cache (for both Check cache and quota cache).
@@ -42,13 +72,32 @@ class Referenced {
   bool Signature(const ::istio::mixer::v1::Attributes &attributes,
                  const std::string &extra_key, std::string *signature) const;
 
+  // Same as above, but using the specified hash function.
+  // The seed is only used by CacheKeyHash::FAST.
+  bool Signature(const ::istio::mixer::v1::Attributes &attributes,
+                 const std::string &extra_key, CacheKeyHash hash,
+                 uint64_t seed, std::string *signature) const;
+
+  // Same as above, but into a fixed size signature.
+  bool Signature(const ::istio::mixer::v1::Attributes &attributes,
+                 const std::string &extra_key, CacheKeyHash hash,
+                 uint64_t seed, SignatureKey *signature) const;
+
   // A hash value to identify an instance.
   std::string Hash() const;
 
   // For debug logging only.
   std::string DebugString() const;
 
+  // Writes the keys into a cache snapshot.
+  void Save(SnapshotWriter *writer) const;
+
+  // Reads the keys saved by Save(). Return false if data is invalid.
+  bool Load(SnapshotReader *reader);
+
  private:
+  friend class ReferencedIndex;
+
   // Holds reference to an attribute and potentially a map key
   struct AttributeRef {
     // name of the attribute
@@ -75,6 +124,18 @@ class Referenced {
 
   // Updates hasher with keys
   static void UpdateHash(const std::vector<AttributeRef> &keys, MD5 *hasher);
+
+  // Writes or reads a list of keys for a snapshot.
+  static void SaveKeys(const std::vector<AttributeRef> &keys,
+                       SnapshotWriter *writer);
+  static bool LoadKeys(SnapshotReader *reader,
+                       std::vector<AttributeRef> *keys);
+
+  // Update a hasher having the MD5 interface with the signature data.
+  // Return false if attributes are mismatched.
+  template <class Hasher>
+  bool UpdateSignature(const ::istio::mixer::v1::Attributes &attributes,
+                       const std::string &extra_key, Hasher *hasher) const;
 };
 
 }  // namespace mixer_client
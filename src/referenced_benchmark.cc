@@ -0,0 +1,99 @@
+/* Copyright 2018 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compares the cost of cache key signatures for each CacheKeyHash.
+// Usage: bazel run -c opt //:referenced_benchmark
+
+#include "include/attributes_builder.h"
+#include "src/referenced.h"
+
+#include <stdio.h>
+#include <chrono>
+
+using ::istio::mixer::v1::Attributes;
+using ::istio::mixer::v1::ReferencedAttributes;
+
+namespace istio {
+namespace mixer_client {
+namespace {
+
+const int kIterations = 500000;
+
+// Builds attributes and referenced similar to an HTTP request checked
+// against a few policies.
+void BuildRequest(Attributes* attributes, ReferencedAttributes* reference) {
+  AttributesBuilder builder(attributes);
+  builder.AddString("source.name", "productpage-v1-6d9b7f5d4-xk2pq");
+  builder.AddString("source.user", "spiffe://cluster.local/ns/default/sa/bookinfo-productpage");
+  builder.AddString("target.service", "reviews.default.svc.cluster.local");
+  builder.AddString("request.path", "/reviews/0?user=jason&format=json");
+  builder.AddString("request.method", "GET");
+  builder.AddInt64("target.port", 9080);
+  builder.AddStringMap(
+      "request.headers",
+      {{":authority", "reviews:9080"},
+       {"user-agent", "Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36"},
+       {"x-request-id", "2d6c9a4b-6b53-9a1f-8a7d-02f4bb0e84c2"},
+       {"cookie", "session=eyJ1c2VyIjoiamFzb24ifQ.DfUu5A.Z2Y5NGU5ZWIx"}});
+
+  for (int name : {2, 6, 9, 17, 19, 8}) {
+    auto* match = reference->add_attribute_matches();
+    match->set_name(name);
+    match->set_condition(ReferencedAttributes::EXACT);
+  }
+  reference->add_words("user-agent");
+  reference->add_words("cookie");
+  for (int map_key : {-1, -2}) {
+    auto* match = reference->add_attribute_matches();
+    match->set_name(15);  // request.headers
+    match->set_map_key(map_key);
+    match->set_condition(ReferencedAttributes::EXACT);
+  }
+}
+
+// Returns nanoseconds per signature.
+double Run(const Referenced& referenced, const Attributes& attributes,
+           CacheKeyHash hash) {
+  std::string signature;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kIterations; ++i) {
+    referenced.Signature(attributes, "", hash, i, &signature);
+  }
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count() / kIterations;
+}
+
+}  // namespace
+}  // namespace mixer_client
+}  // namespace istio
+
+int main(int argc, char** argv) {
+  using namespace ::istio::mixer_client;
+  Attributes attributes;
+  ReferencedAttributes reference;
+  BuildRequest(&attributes, &reference);
+  Referenced referenced;
+  if (!referenced.Fill(attributes, reference)) {
+    fprintf(stderr, "Failed to fill referenced\n");
+    return 1;
+  }
+
+  printf("%8s %16s\n", "hash", "ns/signature");
+  printf("%8s %16.1f\n", "MD5", Run(referenced, attributes, CacheKeyHash::MD5));
+  printf("%8s %16.1f\n", "FAST",
+         Run(referenced, attributes, CacheKeyHash::FAST));
+  return 0;
+}
@@ -0,0 +1,69 @@
+/* Copyright 2018 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/referenced_index.h"
+
+using ::istio::mixer::v1::Attributes;
+using ::istio::mixer::v1::Attributes_AttributeValue;
+
+namespace istio {
+namespace mixer_client {
+
+ReferencedIndex::ReferencedIndex(
+    const std::vector<const Referenced *> &referenced)
+    : referenced_(referenced), num_words_((referenced.size() + 63) / 64) {
+  for (size_t i = 0; i < referenced_.size(); ++i) {
+    const uint64_t bit = uint64_t(1) << (i % 64);
+    for (const auto &key : referenced_[i]->exact_keys_) {
+      GetProbe(key)->exact_mask[i / 64] |= bit;
+    }
+    for (const auto &key : referenced_[i]->absence_keys_) {
+      GetProbe(key)->absence_mask[i / 64] |= bit;
+    }
+  }
+}
+
+ReferencedIndex::Probe *ReferencedIndex::GetProbe(
+    const Referenced::AttributeRef &key) {
+  for (auto &probe : probes_) {
+    if (probe.key.name == key.name && probe.key.map_key == key.map_key) {
+      return &probe;
+    }
+  }
+  Probe probe;
+  probe.key = key;
+  probe.exact_mask.resize(num_words_);
+  probe.absence_mask.resize(num_words_);
+  probes_.push_back(std::move(probe));
+  return &probes_.back();
+}
+
+bool ReferencedIndex::IsPresent(const Attributes &attributes,
+                                const Referenced::AttributeRef &key) {
+  const auto &attributes_map = attributes.attributes();
+  const auto it = attributes_map.find(key.name);
+  if (it == attributes_map.end()) {
+    return false;
+  }
+  const Attributes_AttributeValue &value = it->second;
+  if (value.value_case() != Attributes_AttributeValue::kStringMapValue) {
+    return true;
+  }
+  const auto &smap = value.string_map_value().entries();
+  return smap.find(key.map_key) != smap.end();
+}
+
+}  // namespace mixer_client
+}  // namespace istio
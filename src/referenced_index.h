@@ -0,0 +1,111 @@
+/* Copyright 2018 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIXER_CLIENT_REFERENCED_INDEX_H_
+#define MIXER_CLIENT_REFERENCED_INDEX_H_
+
+#include <stdint.h>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "src/referenced.h"
+
+namespace istio {
+namespace mixer_client {
+
+// An immutable index over a list of Referenced objects.
+// Each distinct (name, map_key) used by any Referenced is a probe. A probe
+// is evaluated once per lookup, and a Referenced is only a candidate if all
+// of its "exact" probes are present and all of its "absence" probes are
+// absent, so only the Referenced whose Signature can succeed are evaluated.
+class ReferencedIndex {
+ public:
+  // The referenced objects are not owned, they must outlive the index.
+  ReferencedIndex(const std::vector<const Referenced *> &referenced);
+
+  // Calls fn(referenced) for each candidate Referenced in the index order,
+  // stops when fn returns true. Returns the number of fn calls.
+  template <class Fn>
+  int Lookup(const ::istio::mixer::v1::Attributes &attributes, Fn fn) const;
+
+  // The indexed objects, in index order.
+  const std::vector<const Referenced *> &referenced() const {
+    return referenced_;
+  }
+
+ private:
+  // Number of mask words kept on stack during Lookup.
+  static const size_t kLocalWords = 4;
+
+  struct Probe {
+    Referenced::AttributeRef key;
+    // Referenced requiring the key to be present, one bit each.
+    std::vector<uint64_t> exact_mask;
+    // Referenced requiring the key to be absent, one bit each.
+    std::vector<uint64_t> absence_mask;
+  };
+
+  // Get or add the probe for a key.
+  Probe *GetProbe(const Referenced::AttributeRef &key);
+
+  // Return true if the key is present in attributes, using the same rule
+  // as Referenced::Signature.
+  static bool IsPresent(const ::istio::mixer::v1::Attributes &attributes,
+                        const Referenced::AttributeRef &key);
+
+  std::vector<const Referenced *> referenced_;
+  std::vector<Probe> probes_;
+  size_t num_words_;
+};
+
+template <class Fn>
+int ReferencedIndex::Lookup(const ::istio::mixer::v1::Attributes &attributes,
+                            Fn fn) const {
+  uint64_t local_words[kLocalWords];
+  std::unique_ptr<uint64_t[]> heap_words;
+  uint64_t *candidates = local_words;
+  if (num_words_ > kLocalWords) {
+    heap_words.reset(new uint64_t[num_words_]);
+    candidates = heap_words.get();
+  }
+  std::fill(candidates, candidates + num_words_, ~uint64_t(0));
+
+  for (const Probe &probe : probes_) {
+    const std::vector<uint64_t> &mask =
+        IsPresent(attributes, probe.key) ? probe.absence_mask
+                                         : probe.exact_mask;
+    for (size_t w = 0; w < num_words_; ++w) {
+      candidates[w] &= ~mask[w];
+    }
+  }
+
+  int evaluated = 0;
+  for (size_t i = 0; i < referenced_.size(); ++i) {
+    if (candidates[i / 64] & (uint64_t(1) << (i % 64))) {
+      ++evaluated;
+      if (fn(*referenced_[i])) {
+        break;
+      }
+    }
+  }
+  return evaluated;
+}
+
+}  // namespace mixer_client
+}  // namespace istio
+
+#endif  // MIXER_CLIENT_REFERENCED_INDEX_H_
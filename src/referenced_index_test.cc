@@ -0,0 +1,138 @@
+/* Copyright 2018 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/referenced_index.h"
+
+#include "include/attributes_builder.h"
+
+#include "gtest/gtest.h"
+
+using ::istio::mixer::v1::Attributes;
+using ::istio::mixer::v1::ReferencedAttributes;
+
+namespace istio {
+namespace mixer_client {
+namespace {
+
+// Creates a Referenced with one word per attribute match.
+std::unique_ptr<Referenced> CreateReferenced(
+    const Attributes& attributes,
+    const std::vector<std::pair<std::string, ReferencedAttributes::Condition>>&
+        matches) {
+  ReferencedAttributes pb;
+  for (const auto& match : matches) {
+    pb.add_words(match.first);
+    auto* match_pb = pb.add_attribute_matches();
+    match_pb->set_name(-pb.words_size());
+    match_pb->set_condition(match.second);
+  }
+  std::unique_ptr<Referenced> referenced(new Referenced);
+  EXPECT_TRUE(referenced->Fill(attributes, pb));
+  return referenced;
+}
+
+// Returns the DebugString of all candidates for attributes.
+std::vector<std::string> Candidates(const ReferencedIndex& index,
+                                    const Attributes& attributes) {
+  std::vector<std::string> candidates;
+  int evaluated = index.Lookup(attributes, [&](const Referenced& referenced) {
+    candidates.push_back(referenced.DebugString());
+    return false;
+  });
+  EXPECT_EQ(evaluated, candidates.size());
+  return candidates;
+}
+
+TEST(ReferencedIndexTest, ExactAndAbsenceTest) {
+  Attributes empty;
+  auto a = CreateReferenced(empty, {{"key-a", ReferencedAttributes::EXACT}});
+  auto b = CreateReferenced(empty, {{"key-b", ReferencedAttributes::EXACT}});
+  auto c = CreateReferenced(empty, {{"key-a", ReferencedAttributes::ABSENCE},
+                                    {"key-c", ReferencedAttributes::EXACT}});
+  auto d = CreateReferenced(empty, {});
+  ReferencedIndex index({a.get(), b.get(), c.get(), d.get()});
+
+  Attributes attributes;
+  AttributesBuilder(&attributes).AddString("key-a", "a");
+  EXPECT_EQ(Candidates(index, attributes),
+            std::vector<std::string>({a->DebugString(), d->DebugString()}));
+
+  AttributesBuilder(&attributes).AddString("key-b", "b");
+  EXPECT_EQ(Candidates(index, attributes),
+            std::vector<std::string>(
+                {a->DebugString(), b->DebugString(), d->DebugString()}));
+
+  Attributes attributes1;
+  AttributesBuilder(&attributes1).AddString("key-c", "c");
+  EXPECT_EQ(Candidates(index, attributes1),
+            std::vector<std::string>({c->DebugString(), d->DebugString()}));
+}
+
+TEST(ReferencedIndexTest, StringMapKeyTest) {
+  Attributes attributes;
+  AttributesBuilder(&attributes)
+      .AddStringMap("request.headers", {{"user-agent", "curl"}});
+
+  ReferencedAttributes pb;
+  pb.add_words("user-agent");
+  auto* match = pb.add_attribute_matches();
+  match->set_name(15);  // request.headers
+  match->set_map_key(-1);
+  match->set_condition(ReferencedAttributes::EXACT);
+  Referenced referenced;
+  ASSERT_TRUE(referenced.Fill(attributes, pb));
+  ReferencedIndex index({&referenced});
+
+  EXPECT_EQ(Candidates(index, attributes).size(), 1);
+
+  Attributes attributes1;
+  AttributesBuilder(&attributes1)
+      .AddStringMap("request.headers", {{"cookie", "foo"}});
+  EXPECT_EQ(Candidates(index, attributes1).size(), 0);
+}
+
+TEST(ReferencedIndexTest, StopAtFirstHitTest) {
+  Attributes empty;
+  auto a = CreateReferenced(empty, {});
+  auto b = CreateReferenced(empty, {});
+  ReferencedIndex index({a.get(), b.get()});
+
+  int evaluated =
+      index.Lookup(empty, [](const Referenced& referenced) { return true; });
+  EXPECT_EQ(evaluated, 1);
+}
+
+TEST(ReferencedIndexTest, ManyReferencedTest) {
+  // More Referenced than the index keeps on stack.
+  Attributes empty;
+  std::vector<std::unique_ptr<Referenced>> owned;
+  std::vector<const Referenced*> referenced;
+  for (int i = 0; i < 300; ++i) {
+    owned.push_back(CreateReferenced(
+        empty,
+        {{"key-" + std::to_string(i), ReferencedAttributes::EXACT}}));
+    referenced.push_back(owned.back().get());
+  }
+  ReferencedIndex index(referenced);
+
+  Attributes attributes;
+  AttributesBuilder(&attributes).AddString("key-250", "value");
+  EXPECT_EQ(Candidates(index, attributes),
+            std::vector<std::string>({owned[250]->DebugString()}));
+}
+
+}  // namespace
+}  // namespace mixer_client
+}  // namespace istio
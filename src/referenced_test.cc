@@ -212,6 +212,53 @@ TEST(ReferencedTest, OKSignature1Test) {
   EXPECT_TRUE(referenced.Signature(attributes, "extra", &signature));
 
   EXPECT_EQ(MD5::DebugString(signature), "751b028b2e2c230ef9c4e59ac556ca04");
+
+  std::string md5_signature;
+  EXPECT_TRUE(referenced.Signature(attributes, "extra", CacheKeyHash::MD5, 0,
+                                   &md5_signature));
+  EXPECT_EQ(md5_signature, signature);
+}
+
+TEST(ReferencedTest, FastSignatureTest) {
+  ::istio::mixer::v1::ReferencedAttributes pb;
+  ASSERT_TRUE(TextFormat::ParseFromString(kReferencedText, &pb));
+  ::istio::mixer::v1::Attributes attrs;
+  ASSERT_TRUE(TextFormat::ParseFromString(kAttributesText, &attrs));
+  Referenced referenced;
+  EXPECT_TRUE(referenced.Fill(attrs, pb));
+
+  Attributes attributes;
+  AttributesBuilder builder(&attributes);
+  builder.AddString("string-key", "this is a string value");
+  builder.AddBytes("bytes-key", "this is a bytes value");
+  builder.AddDouble("double-key", 99.9);
+  builder.AddInt64("int-key", 35);
+  builder.AddBool("bool-key", true);
+  builder.AddTimestamp("time-key",
+                       std::chrono::time_point<std::chrono::system_clock>());
+  builder.AddDuration("duration-key", std::chrono::nanoseconds(5));
+  builder.AddStringMap("string-map-key", {{"If-Match", "value1"}});
+
+  std::string signature1;
+  std::string signature2;
+  EXPECT_TRUE(referenced.Signature(attributes, "extra", CacheKeyHash::FAST, 1,
+                                   &signature1));
+  EXPECT_TRUE(referenced.Signature(attributes, "extra", CacheKeyHash::FAST, 1,
+                                   &signature2));
+  EXPECT_EQ(signature1.size(), 16);
+  EXPECT_EQ(signature1, signature2);
+
+  // A different value.
+  builder.AddInt64("int-key", 36);
+  EXPECT_TRUE(referenced.Signature(attributes, "extra", CacheKeyHash::FAST, 1,
+                                   &signature2));
+  EXPECT_NE(signature1, signature2);
+
+  // A different seed.
+  builder.AddInt64("int-key", 35);
+  EXPECT_TRUE(referenced.Signature(attributes, "extra", CacheKeyHash::FAST, 2,
+                                   &signature2));
+  EXPECT_NE(signature1, signature2);
 }
 
 }  // namespace
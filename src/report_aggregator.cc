@@ -0,0 +1,198 @@
+/* Copyright 2018 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/report_aggregator.h"
+
+#include <algorithm>
+
+using ::istio::mixer::v1::Attributes;
+using ::istio::mixer::v1::Attributes_AttributeValue;
+
+namespace istio {
+namespace mixer_client {
+namespace {
+
+const int64_t kNanosPerSecond = 1000000000;
+
+// Appends a length prefixed string, so different strings never form the
+// same key.
+void AppendString(const std::string& str, std::string* key) {
+  uint32_t size = str.size();
+  key->append(reinterpret_cast<const char*>(&size), sizeof(size));
+  key->append(str);
+}
+
+template <class T>
+void AppendData(T data, std::string* key) {
+  key->append(reinterpret_cast<const char*>(&data), sizeof(data));
+}
+
+void AppendValue(const Attributes_AttributeValue& value, std::string* key) {
+  key->push_back(static_cast<char>(value.value_case()));
+  switch (value.value_case()) {
+    case Attributes_AttributeValue::kStringValue:
+      AppendString(value.string_value(), key);
+      break;
+    case Attributes_AttributeValue::kBytesValue:
+      AppendString(value.bytes_value(), key);
+      break;
+    case Attributes_AttributeValue::kInt64Value:
+      AppendData(value.int64_value(), key);
+      break;
+    case Attributes_AttributeValue::kDoubleValue:
+      AppendData(value.double_value(), key);
+      break;
+    case Attributes_AttributeValue::kBoolValue:
+      AppendData(value.bool_value(), key);
+      break;
+    case Attributes_AttributeValue::kTimestampValue:
+      AppendData(value.timestamp_value().seconds(), key);
+      AppendData(value.timestamp_value().nanos(), key);
+      break;
+    case Attributes_AttributeValue::kDurationValue:
+      AppendData(value.duration_value().seconds(), key);
+      AppendData(value.duration_value().nanos(), key);
+      break;
+    case Attributes_AttributeValue::kStringMapValue: {
+      const auto& entries = value.string_map_value().entries();
+      std::vector<const std::string*> map_keys;
+      for (const auto& it : entries) {
+        map_keys.push_back(&it.first);
+      }
+      std::sort(map_keys.begin(), map_keys.end(),
+                [](const std::string* a, const std::string* b) {
+                  return *a < *b;
+                });
+      AppendData(static_cast<uint32_t>(map_keys.size()), key);
+      for (const std::string* map_key : map_keys) {
+        AppendString(*map_key, key);
+        AppendString(entries.at(*map_key), key);
+      }
+    } break;
+    case Attributes_AttributeValue::VALUE_NOT_SET:
+      break;
+  }
+}
+
+// Adds the value to sum if they have the same numeric type.
+void SumValue(const Attributes_AttributeValue& value,
+              Attributes_AttributeValue* sum) {
+  if (value.value_case() != sum->value_case()) {
+    return;
+  }
+  switch (value.value_case()) {
+    case Attributes_AttributeValue::kInt64Value:
+      sum->set_int64_value(sum->int64_value() + value.int64_value());
+      break;
+    case Attributes_AttributeValue::kDoubleValue:
+      sum->set_double_value(sum->double_value() + value.double_value());
+      break;
+    case Attributes_AttributeValue::kDurationValue: {
+      auto* duration = sum->mutable_duration_value();
+      int64_t nanos =
+          (duration->seconds() + value.duration_value().seconds()) *
+              kNanosPerSecond +
+          duration->nanos() + value.duration_value().nanos();
+      duration->set_seconds(nanos / kNanosPerSecond);
+      duration->set_nanos(nanos % kNanosPerSecond);
+    } break;
+    default:
+      break;
+  }
+}
+
+}  // namespace
+
+ReportAggregator::ReportAggregator(const ReportOptions& options)
+    : keys_(options.aggregate_keys),
+      sum_attributes_(options.aggregate_sum_attributes.begin(),
+                      options.aggregate_sum_attributes.end()),
+      count_attribute_(options.aggregate_count_attribute) {
+  std::sort(keys_.begin(), keys_.end());
+  if (!count_attribute_.empty()) {
+    sum_attributes_.insert(count_attribute_);
+  }
+}
+
+std::string ReportAggregator::GroupKey(const Attributes& attributes) const {
+  std::string key;
+  const auto& map = attributes.attributes();
+  if (!keys_.empty()) {
+    for (const auto& name : keys_) {
+      const auto it = map.find(name);
+      if (it == map.end()) {
+        // Different from any value.
+        key.push_back(static_cast<char>(-1));
+      } else {
+        AppendValue(it->second, &key);
+      }
+    }
+    return key;
+  }
+
+  std::vector<const std::string*> names;
+  for (const auto& it : map) {
+    if (sum_attributes_.find(it.first) == sum_attributes_.end()) {
+      names.push_back(&it.first);
+    }
+  }
+  std::sort(names.begin(), names.end(),
+            [](const std::string* a, const std::string* b) { return *a < *b; });
+  for (const std::string* name : names) {
+    AppendString(*name, &key);
+    AppendValue(map.at(*name), &key);
+  }
+  return key;
+}
+
+void ReportAggregator::Add(const Attributes& attributes) {
+  auto result = groups_.emplace(GroupKey(attributes), reports_.size());
+  if (result.second) {
+    reports_.emplace_back(attributes);
+    counts_.push_back(1);
+    return;
+  }
+
+  const size_t index = result.first->second;
+  ++counts_[index];
+  auto* group = reports_[index].mutable_attributes();
+  for (const auto& it : attributes.attributes()) {
+    if (sum_attributes_.find(it.first) == sum_attributes_.end()) {
+      continue;
+    }
+    auto group_it = group->find(it.first);
+    if (group_it == group->end()) {
+      (*group)[it.first] = it.second;
+    } else {
+      SumValue(it.second, &group_it->second);
+    }
+  }
+}
+
+void ReportAggregator::Flush(std::vector<Attributes>* reports) {
+  if (!count_attribute_.empty()) {
+    for (size_t i = 0; i < reports_.size(); ++i) {
+      (*reports_[i].mutable_attributes())[count_attribute_].set_int64_value(
+          counts_[i]);
+    }
+  }
+  reports->swap(reports_);
+  reports_.clear();
+  counts_.clear();
+  groups_.clear();
+}
+
+}  // namespace mixer_client
+}  // namespace istio
@@ -0,0 +1,68 @@
+/* Copyright 2018 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIXERCLIENT_REPORT_AGGREGATOR_H
+#define MIXERCLIENT_REPORT_AGGREGATOR_H
+
+#include <stdint.h>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "google/protobuf/stubs/common.h"
+#include "include/options.h"
+#include "mixer/v1/attributes.pb.h"
+
+namespace istio {
+namespace mixer_client {
+
+// Merges reports by group, as configured by the aggregate_* fields of
+// ReportOptions. This class is not thread safe.
+class ReportAggregator {
+ public:
+  explicit ReportAggregator(const ReportOptions& options);
+
+  // Merges a report into its group, creating the group if needed.
+  void Add(const ::istio::mixer::v1::Attributes& attributes);
+
+  // The number of groups.
+  size_t size() const { return reports_.size(); }
+
+  // Moves out one report per group, in the order the groups were created,
+  // and removes all groups.
+  void Flush(std::vector<::istio::mixer::v1::Attributes>* reports);
+
+ private:
+  // Returns the key identifying the group of the attributes.
+  std::string GroupKey(const ::istio::mixer::v1::Attributes& attributes) const;
+
+  // Sorted, so the key doesn't depend on the map order.
+  std::vector<std::string> keys_;
+  std::set<std::string> sum_attributes_;
+  std::string count_attribute_;
+
+  // Maps group keys to their index in reports_ and counts_.
+  std::unordered_map<std::string, size_t> groups_;
+  std::vector<::istio::mixer::v1::Attributes> reports_;
+  std::vector<int64_t> counts_;
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(ReportAggregator);
+};
+
+}  // namespace mixer_client
+}  // namespace istio
+
+#endif  // MIXERCLIENT_REPORT_AGGREGATOR_H
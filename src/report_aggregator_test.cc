@@ -0,0 +1,134 @@
+/* Copyright 2018 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/report_aggregator.h"
+
+#include "gtest/gtest.h"
+#include "include/attributes_builder.h"
+
+using ::istio::mixer::v1::Attributes;
+
+namespace istio {
+namespace mixer_client {
+namespace {
+
+Attributes CreateReport(const std::string& path, int64_t response_code,
+                        int64_t response_size, int duration_ms) {
+  Attributes attributes;
+  AttributesBuilder builder(&attributes);
+  builder.AddString("target.service", "productpage");
+  builder.AddStringMap("request.headers",
+                       {{":method", "GET"}, {"user-agent", "curl"}});
+  builder.AddString("request.path", path);
+  builder.AddInt64("response.code", response_code);
+  builder.AddInt64("response.size", response_size);
+  builder.AddDuration("response.duration",
+                      std::chrono::milliseconds(duration_ms));
+  return attributes;
+}
+
+ReportOptions CreateOptions() {
+  ReportOptions options;
+  options.aggregate_reports = true;
+  options.aggregate_sum_attributes = {"response.size", "response.duration"};
+  options.aggregate_count_attribute = "report.count";
+  return options;
+}
+
+const Attributes::AttributeValue& Get(const Attributes& attributes,
+                                      const std::string& name) {
+  return attributes.attributes().at(name);
+}
+
+TEST(ReportAggregatorTest, TestSumAttributes) {
+  ReportAggregator aggregator(CreateOptions());
+  aggregator.Add(CreateReport("/a", 200, 100, 600));
+  aggregator.Add(CreateReport("/a", 200, 50, 700));
+  aggregator.Add(CreateReport("/a", 200, 1, 1));
+  EXPECT_EQ(aggregator.size(), 1);
+
+  std::vector<Attributes> reports;
+  aggregator.Flush(&reports);
+  EXPECT_EQ(aggregator.size(), 0);
+  ASSERT_EQ(reports.size(), 1);
+  const Attributes& report = reports[0];
+  EXPECT_EQ(Get(report, "response.size").int64_value(), 151);
+  EXPECT_EQ(Get(report, "response.duration").duration_value().seconds(), 1);
+  EXPECT_EQ(Get(report, "response.duration").duration_value().nanos(),
+            301000000);
+  EXPECT_EQ(Get(report, "report.count").int64_value(), 3);
+  // Not summed.
+  EXPECT_EQ(Get(report, "response.code").int64_value(), 200);
+}
+
+TEST(ReportAggregatorTest, TestGroupByOtherAttributes) {
+  ReportAggregator aggregator(CreateOptions());
+  aggregator.Add(CreateReport("/a", 200, 1, 1));
+  aggregator.Add(CreateReport("/b", 200, 1, 1));
+  aggregator.Add(CreateReport("/a", 404, 1, 1));
+  aggregator.Add(CreateReport("/a", 200, 1, 1));
+  Attributes other_headers = CreateReport("/a", 200, 1, 1);
+  AttributesBuilder(&other_headers)
+      .AddStringMap("request.headers", {{":method", "POST"}});
+  aggregator.Add(other_headers);
+  EXPECT_EQ(aggregator.size(), 4);
+
+  std::vector<Attributes> reports;
+  aggregator.Flush(&reports);
+  ASSERT_EQ(reports.size(), 4);
+  // In the order the groups were created.
+  EXPECT_EQ(Get(reports[0], "report.count").int64_value(), 2);
+  EXPECT_EQ(Get(reports[1], "request.path").string_value(), "/b");
+  EXPECT_EQ(Get(reports[2], "response.code").int64_value(), 404);
+  EXPECT_EQ(Get(reports[3], "report.count").int64_value(), 1);
+}
+
+TEST(ReportAggregatorTest, TestGroupByKeys) {
+  ReportOptions options = CreateOptions();
+  options.aggregate_keys = {"response.code", "target.service"};
+  ReportAggregator aggregator(options);
+  aggregator.Add(CreateReport("/a", 200, 1, 1));
+  aggregator.Add(CreateReport("/b", 200, 2, 1));
+  aggregator.Add(CreateReport("/a", 404, 4, 1));
+  EXPECT_EQ(aggregator.size(), 2);
+
+  std::vector<Attributes> reports;
+  aggregator.Flush(&reports);
+  ASSERT_EQ(reports.size(), 2);
+  // Other attributes are from the first report.
+  EXPECT_EQ(Get(reports[0], "request.path").string_value(), "/a");
+  EXPECT_EQ(Get(reports[0], "response.size").int64_value(), 3);
+  EXPECT_EQ(Get(reports[1], "response.size").int64_value(), 4);
+}
+
+TEST(ReportAggregatorTest, TestIdenticalReports) {
+  ReportOptions options;
+  options.aggregate_reports = true;
+  ReportAggregator aggregator(options);
+  for (int i = 0; i < 100; ++i) {
+    aggregator.Add(CreateReport("/healthz", 200, 0, 0));
+  }
+  aggregator.Add(CreateReport("/healthz", 200, 0, 1));
+  EXPECT_EQ(aggregator.size(), 2);
+
+  std::vector<Attributes> reports;
+  aggregator.Flush(&reports);
+  ASSERT_EQ(reports.size(), 2);
+  EXPECT_EQ(reports[0].attributes().count("report.count"), 0);
+}
+
+}  // namespace
+}  // namespace mixer_client
+}  // namespace istio
@@ -16,6 +16,8 @@
 #include "src/report_batch.h"
 #include "utils/protobuf.h"
 
+#include <algorithm>
+
 using ::istio::mixer::v1::Attributes;
 using ::istio::mixer::v1::ReportRequest;
 using ::istio::mixer::v1::ReportResponse;
@@ -24,73 +26,785 @@ using ::google::protobuf::util::error::Code;
 
 namespace istio {
 namespace mixer_client {
+namespace {
+
+// At most this many queued reports are added to the batch under one lock,
+// so a timer flush is not blocked by a long drain.
+const int kMaxDrainCount = 100;
+
+}  // namespace
 
 ReportBatch::ReportBatch(const ReportOptions& options,
                          TransportReportFunc transport,
                          TimerCreateFunc timer_create,
-                         AttributeCompressor& compressor)
+                         AttributeCompressor& compressor,
+                         ExecutorFunc executor,
+                         TransportRawReportFunc raw_transport)
     : options_(options),
       transport_(transport),
+      raw_transport_(raw_transport),
       timer_create_(timer_create),
       compressor_(compressor),
+      batch_entries_(0),
+      batch_bytes_(0),
+      flush_controller_(options),
+      executor_(executor),
+      shared_state_(std::make_shared<SharedState>()),
+      queued_reports_(0),
+      drain_requested_(false),
+      replay_requested_(false),
+      stopped_(false),
+      inflight_bytes_(0),
+      next_inflight_id_(0),
+      overflow_batches_(0),
+      replaying_(false),
+      replay_backoff_ms_(options.spool_retry_min_ms),
+      replay_scheduled_(false),
       total_report_calls_(0),
-      total_remote_report_calls_(0) {}
+      total_remote_report_calls_(0),
+      total_remote_report_entries_(0),
+      total_remote_report_bytes_(0),
+      total_dropped_report_batches_(0),
+      total_dropped_report_entries_(0),
+      total_spooled_report_batches_(0),
+      total_replayed_report_batches_(0),
+      total_aggregated_reports_(0),
+      total_reencoded_report_batches_(0) {
+  shared_state_->batch = this;
+  shared_state_->running = 0;
+  for (auto& count : total_flushes_) {
+    count = 0;
+  }
+  if (options_.learned_dictionary_size > 0) {
+    learned_dictionary_.reset(
+        new LearnedDictionary(options_.learned_dictionary_size));
+  }
+  if (options_.aggregate_reports) {
+    aggregator_.reset(new ReportAggregator(options_));
+  }
+  if (options_.report_order_window > 0) {
+    orderer_.reset(new ReportOrderer(options_));
+  }
+  if (!options_.spool_path.empty()) {
+    Status status = ReportSpool::Open(options_.spool_path,
+                                      options_.spool_bytes, &spool_);
+    if (!status.ok()) {
+      GOOGLE_LOG(WARNING) << "Failed to open report spool: "
+                          << status.ToString();
+    }
+  }
+  if (spool_ && timer_create_) {
+    std::shared_ptr<SharedState> state = shared_state_;
+    replay_timer_ = timer_create_([state]() {
+      RunIfAlive(state,
+                 [](ReportBatch* batch) { batch->RunScheduledReplay(); });
+    });
+  }
+  if (options_.async_report && !executor_) {
+    worker_ = std::thread([this]() { RunWorker(); });
+  }
+  if (spool_ && spool_->size() > 0) {
+    // Sends the requests spooled before a restart.
+    std::lock_guard<std::mutex> lock(replay_mutex_);
+    ScheduleReplayWithLock(0);
+  }
+}
 
-ReportBatch::~ReportBatch() { Flush(); }
+ReportBatch::~ReportBatch() {
+  {
+    // Stops new executor tasks and transport callbacks, and waits for the
+    // running ones.
+    std::unique_lock<std::mutex> lock(shared_state_->mutex);
+    shared_state_->batch = nullptr;
+    shared_state_->cv.wait(lock,
+                           [this]() { return shared_state_->running == 0; });
+  }
+  if (worker_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(worker_mutex_);
+      stopped_ = true;
+    }
+    worker_cv_.notify_one();
+    worker_.join();
+  }
+  // The in-flight batches are not cancelled, the reports are sent already.
+  // Their responses are ignored by RunIfAlive().
+  {
+    std::lock_guard<std::mutex> lock(inflight_mutex_);
+    inflight_batches_.clear();
+    inflight_bytes_ = 0;
+  }
+  Flush();
+}
 
 void ReportBatch::Report(const Attributes& request) {
-  std::lock_guard<std::mutex> lock(mutex_);
   ++total_report_calls_;
-  if (!batch_compressor_) {
-    batch_compressor_ = compressor_.CreateBatchCompressor();
+  if (options_.async_report) {
+    Enqueue(std::unique_ptr<Attributes>(new Attributes(request)));
+    return;
+  }
+
+  RequestList requests;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    AddWithLock(request, &requests);
+  }
+  Send(&requests);
+}
+
+void ReportBatch::Report(Attributes&& request) {
+  if (!options_.async_report) {
+    // The attributes are compressed right away, no copy to save.
+    Report(static_cast<const Attributes&>(request));
+    return;
+  }
+  ++total_report_calls_;
+  std::unique_ptr<Attributes> owned_request(new Attributes);
+  owned_request->Swap(&request);
+  Enqueue(std::move(owned_request));
+}
+
+void ReportBatch::AddWithLock(const Attributes& request,
+                              RequestList* requests) {
+  if (!aggregator_ && orderer_) {
+    const bool has_batch = HasBatchWithLock();
+    const size_t sent = requests->size();
+    orderer_->Add(request);
+    if (static_cast<int>(orderer_->size()) >= options_.report_order_window) {
+      CompressOrderedWithLock(requests);
+    }
+    // Timed from the first buffered report, or again from the reports left
+    // over by a sent batch.
+    if (HasBatchWithLock() && (!has_batch || requests->size() > sent)) {
+      StartTimerWithLock();
+    }
+    return;
+  }
+  if (!aggregator_) {
+    CompressWithLock(request, requests);
+    return;
   }
 
-  if (!batch_compressor_->Add(request)) {
-    FlushWithLock();
+  const size_t groups = aggregator_->size();
+  aggregator_->Add(request);
+  if (aggregator_->size() == groups) {
+    ++total_aggregated_reports_;
+  }
+  if (static_cast<int>(aggregator_->size()) >=
+      flush_controller_.batch_entries()) {
+    FinishWithLock(FLUSH_BY_ENTRIES, requests);
+  } else if (groups == 0) {
+    StartTimerWithLock();
+  }
+}
 
-    batch_compressor_ = compressor_.CreateBatchCompressor();
-    batch_compressor_->Add(request);
+void ReportBatch::CompressWithLock(const Attributes& request,
+                                   RequestList* requests) {
+  bool added = false;
+  for (const auto& batch_compressor : batch_compressors_) {
+    size_t byte_size = batch_compressor->byte_size();
+    if (batch_compressor->Add(request)) {
+      batch_bytes_ += batch_compressor->byte_size() - byte_size;
+      added = true;
+      break;
+    }
   }
 
-  if (batch_compressor_->size() >= options_.max_batch_entries) {
-    FlushWithLock();
-  } else {
-    if (batch_compressor_->size() == 1 && timer_create_) {
-      if (!timer_) {
-        timer_ = timer_create_([this]() { Flush(); });
-      }
-      timer_->Start(options_.max_batch_time_ms);
+  if (!added) {
+    if (static_cast<int>(batch_compressors_.size()) >=
+        std::max(options_.max_delta_chains, 1)) {
+      FinishWithLock(FLUSH_BY_DELTA_UPDATE, requests);
     }
+    // A new chain accepts any report.
+    batch_compressors_.push_back(compressor_.CreateBatchCompressor(
+        learned_dictionary_.get(), raw_transport_ != nullptr));
+    batch_compressors_.back()->Add(request);
+    batch_bytes_ += batch_compressors_.back()->byte_size();
+  }
+  ++batch_entries_;
+
+  if (batch_entries_ >= flush_controller_.batch_entries()) {
+    FinishWithLock(FLUSH_BY_ENTRIES, requests);
+  } else if (options_.max_batch_bytes > 0 &&
+             batch_bytes_ >= options_.max_batch_bytes) {
+    FinishWithLock(FLUSH_BY_BYTES, requests);
+  } else if (batch_entries_ == 1 && !aggregator_ && !orderer_) {
+    StartTimerWithLock();
   }
 }
 
-void ReportBatch::FlushWithLock() {
-  if (!batch_compressor_) {
+void ReportBatch::FinishWithLock(FlushReason reason, RequestList* requests) {
+  if (aggregator_ && aggregator_->size() > 0) {
+    // The merged reports may fill more than one batch.
+    std::vector<Attributes> reports;
+    aggregator_->Flush(&reports);
+    for (const auto& report : reports) {
+      if (orderer_) {
+        orderer_->Add(report);
+      } else {
+        CompressWithLock(report, requests);
+      }
+    }
+  }
+  if (orderer_ && orderer_->size() > 0) {
+    CompressOrderedWithLock(requests);
+  }
+  if (batch_compressors_.empty()) {
     return;
   }
 
-  ++total_remote_report_calls_;
-  std::unique_ptr<ReportRequest> request = batch_compressor_->Finish();
-  batch_compressor_.reset();
+  ++total_flushes_[reason];
+  flush_controller_.OnBatch(batch_entries_, batch_bytes_,
+                            std::chrono::steady_clock::now());
+  for (const auto& batch_compressor : batch_compressors_) {
+    Batch batch;
+    batch.byte_size = batch_compressor->byte_size();
+    batch.entries = batch_compressor->size();
+    if (raw_transport_) {
+      batch.serialized.reset(new std::string);
+      batch_compressor->FinishSerialized(batch.serialized.get());
+    } else {
+      batch.request = batch_compressor->Finish();
+    }
+    requests->push_back(std::move(batch));
+  }
+  batch_compressors_.clear();
+  batch_entries_ = 0;
+  batch_bytes_ = 0;
   if (timer_) {
     timer_->Stop();
   }
+}
+
+void ReportBatch::CompressOrderedWithLock(RequestList* requests) {
+  std::vector<Attributes> reports;
+  orderer_->Flush(&reports);
+  for (const auto& report : reports) {
+    CompressWithLock(report, requests);
+  }
+}
+
+bool ReportBatch::HasBatchWithLock() const {
+  return !batch_compressors_.empty() ||
+         (aggregator_ && aggregator_->size() > 0) ||
+         (orderer_ && orderer_->size() > 0);
+}
+
+void ReportBatch::StartTimerWithLock() {
+  if (worker_.joinable()) {
+    // The timer may not be created on the worker thread, it times the
+    // batch itself.
+    batch_deadline_ =
+        std::chrono::steady_clock::now() +
+        std::chrono::milliseconds(flush_controller_.batch_time_ms());
+    return;
+  }
+  if (timer_create_) {
+    if (!timer_) {
+      timer_ = timer_create_([this]() { FlushWithReason(FLUSH_BY_TIME); });
+    }
+    timer_->Start(flush_controller_.batch_time_ms());
+  }
+}
+
+void ReportBatch::Send(RequestList* requests) {
+  for (auto& batch : *requests) {
+    if (batch.request || batch.serialized) {
+      SendBatch(&batch);
+    }
+  }
+}
+
+bool ReportBatch::OverInflightLimit(size_t num_batches, size_t bytes,
+                                    size_t byte_size) const {
+  if (num_batches == 0) {
+    // A batch is always sent if nothing else is in flight.
+    return false;
+  }
+  return (options_.max_inflight_requests > 0 &&
+          static_cast<int>(num_batches) >= options_.max_inflight_requests) ||
+         (options_.max_inflight_bytes > 0 &&
+          bytes + byte_size > options_.max_inflight_bytes);
+}
 
+void ReportBatch::SendBatch(Batch* batch) {
+  const int entries = batch->entries;
+  std::vector<CancelFunc> cancels;
+  uint64_t id;
+  {
+    std::lock_guard<std::mutex> lock(inflight_mutex_);
+    if (OverInflightLimit(inflight_batches_.size(), inflight_bytes_,
+                          batch->byte_size)) {
+      bool drop_newest = true;
+      switch (options_.drop_policy) {
+        case ReportDropPolicy::DROP_NEWEST:
+          break;
+        case ReportDropPolicy::DROP_OLDEST:
+          drop_newest = false;
+          break;
+        case ReportDropPolicy::SAMPLE:
+          drop_newest = options_.drop_sample_interval <= 0 ||
+                        ++overflow_batches_ % options_.drop_sample_interval;
+          break;
+      }
+      if (!drop_newest) {
+        // Cancels the oldest batches to make room for this one. A batch
+        // without a cancel is still delivered, so it is kept; this one is
+        // dropped if they leave no room for it.
+        size_t num_batches = inflight_batches_.size();
+        size_t bytes = inflight_bytes_;
+        std::vector<size_t> oldest;
+        for (size_t i = 0; i < inflight_batches_.size() &&
+                           OverInflightLimit(num_batches, bytes,
+                                             batch->byte_size);
+             ++i) {
+          if (inflight_batches_[i].cancel) {
+            oldest.push_back(i);
+            --num_batches;
+            bytes -= inflight_batches_[i].byte_size;
+          }
+        }
+        drop_newest = OverInflightLimit(num_batches, bytes, batch->byte_size);
+        if (!drop_newest) {
+          for (size_t i = 0; i < oldest.size(); ++i) {
+            // Each erased batch shifts the following ones.
+            auto it = inflight_batches_.begin() + (oldest[i] - i);
+            ++total_dropped_report_batches_;
+            total_dropped_report_entries_ += it->entries;
+            inflight_bytes_ -= it->byte_size;
+            cancels.push_back(it->cancel);
+            inflight_batches_.erase(it);
+          }
+        }
+      }
+      if (drop_newest) {
+        ++total_dropped_report_batches_;
+        total_dropped_report_entries_ += entries;
+        return;
+      }
+    }
+    id = next_inflight_id_++;
+    inflight_batches_.push_back({id, batch->byte_size, entries, nullptr});
+    inflight_bytes_ += batch->byte_size;
+  }
+  for (const auto& cancel : cancels) {
+    cancel();
+  }
+
+  ++total_remote_report_calls_;
+  total_remote_report_entries_ += entries;
+  total_remote_report_bytes_ += batch->byte_size;
   ReportResponse* response = new ReportResponse;
-  transport_(*request, response, [this, response](const Status& status) {
+  auto start = std::chrono::steady_clock::now();
+  // Kept until the response, to be spooled or encoded again.
+  std::shared_ptr<ReportRequest> request(std::move(batch->request));
+  std::shared_ptr<std::string> serialized(std::move(batch->serialized));
+  const bool reencoded = batch->reencoded;
+  std::shared_ptr<SharedState> state = shared_state_;
+  DoneFunc on_done = [state, response, id, start, entries, request, serialized,
+                      reencoded](const Status& status) {
     delete response;
+    RunIfAlive(state, [&](ReportBatch* batch) {
+      batch->OnReportDone(id, start, request.get(), serialized.get(), entries,
+                          reencoded, status);
+    });
+  };
+  CancelFunc cancel = serialized
+                          ? raw_transport_(*serialized, response, on_done)
+                          : transport_(*request, response, on_done);
+  if (!cancel) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(inflight_mutex_);
+  // The response may have arrived already.
+  for (auto& inflight : inflight_batches_) {
+    if (inflight.id == id) {
+      inflight.cancel = cancel;
+      break;
+    }
+  }
+}
+
+void ReportBatch::OnReportDone(uint64_t id,
+                               std::chrono::steady_clock::time_point start,
+                               const ReportRequest* request,
+                               const std::string* serialized, int entries,
+                               bool reencoded, const Status& status) {
+  CompleteInflight(id);
+  flush_controller_.OnResponse(
+      std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::steady_clock::now() - start));
+  if (status.ok()) {
+    // The transport works, it is time to send the spooled requests.
+    ReplaySpool();
+    return;
+  }
+  GOOGLE_LOG(ERROR) << "Mixer Report failed with: " << status.ToString();
+  if (InvalidDictionaryStatus(status)) {
+    compressor_.ShrinkGlobalDictionary();
+    if (!reencoded) {
+      ResendReencoded(request, serialized, entries);
+    }
+  } else if (spool_ && status.error_code() != Code::CANCELLED) {
+    // Cancelled requests are dropped by the in-flight limits.
+    if (spool_->Append(serialized ? *serialized
+                                  : request->SerializeAsString())) {
+      ++total_spooled_report_batches_;
+      // Retried after the backoff, even if no other report is sent.
+      std::lock_guard<std::mutex> lock(replay_mutex_);
+      ScheduleReplayWithLock(replay_backoff_ms_);
+    }
+  }
+}
+
+void ReportBatch::ResendReencoded(const ReportRequest* request,
+                                  const std::string* serialized,
+                                  int entries) {
+  std::unique_ptr<ReportRequest> reencoded(new ReportRequest);
+  if (serialized) {
+    if (!reencoded->ParseFromString(*serialized)) {
+      return;
+    }
+  } else {
+    reencoded->CopyFrom(*request);
+  }
+  // Not encoded with a larger dictionary than the current one, it would
+  // fail again.
+  if (!compressor_.Reencode(reencoded.get())) {
+    return;
+  }
+
+  Batch batch;
+  batch.entries = entries;
+  batch.reencoded = true;
+  if (serialized) {
+    batch.serialized.reset(new std::string);
+    reencoded->SerializeToString(batch.serialized.get());
+    batch.byte_size = batch.serialized->size();
+  } else {
+    batch.byte_size = reencoded->ByteSizeLong();
+    batch.request = std::move(reencoded);
+  }
+  ++total_reencoded_report_batches_;
+  SendBatch(&batch);
+}
+
+void ReportBatch::ReplaySpool() {
+  while (spool_) {
+    std::string data;
+    uint64_t sequence;
+    {
+      std::lock_guard<std::mutex> lock(replay_mutex_);
+      if (replaying_ || spool_->size() == 0) {
+        return;
+      }
+      auto now = std::chrono::steady_clock::now();
+      if (now < next_replay_time_) {
+        // Rounded up, so the replay doesn't run before the backoff ends.
+        ScheduleReplayWithLock(static_cast<int>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(
+                next_replay_time_ - now)
+                .count() +
+            1));
+        return;
+      }
+      if (!spool_->Peek(&data, &sequence)) {
+        return;
+      }
+      replaying_ = true;
+    }
+
+    // A raw transport sends the spooled bytes as they are.
+    std::shared_ptr<std::string> serialized;
+    std::shared_ptr<ReportRequest> request;
+    if (raw_transport_) {
+      serialized = std::make_shared<std::string>();
+      serialized->swap(data);
+    } else {
+      request = std::make_shared<ReportRequest>();
+    }
+    if (request && !request->ParseFromString(data)) {
+      GOOGLE_LOG(ERROR) << "Dropped an invalid spooled report request";
+      spool_->Pop(sequence);
+      std::lock_guard<std::mutex> lock(replay_mutex_);
+      replaying_ = false;
+      continue;
+    }
+
+    // A synchronous response continues this loop, an asynchronous one
+    // calls ReplaySpool() again, so the stack doesn't grow per record.
+    enum { CALLING, RETURNED, DONE };
+    auto state = std::make_shared<std::atomic<int>>(CALLING);
+    auto succeeded = std::make_shared<bool>(false);
+    ReportResponse* response = new ReportResponse;
+    std::shared_ptr<SharedState> shared_state = shared_state_;
+    DoneFunc on_done = [shared_state, request, serialized, response, sequence,
+                        state, succeeded](const Status& status) {
+      delete response;
+      RunIfAlive(shared_state, [&](ReportBatch* batch) {
+        *succeeded = batch->OnReplayDone(sequence, status);
+        if (state->exchange(DONE) == RETURNED && *succeeded) {
+          batch->ReplaySpool();
+        }
+      });
+    };
+    if (serialized) {
+      raw_transport_(*serialized, response, on_done);
+    } else {
+      transport_(*request, response, on_done);
+    }
+    if (state->exchange(RETURNED) != DONE || !*succeeded) {
+      return;
+    }
+  }
+}
+
+bool ReportBatch::OnReplayDone(uint64_t sequence, const Status& status) {
+  std::lock_guard<std::mutex> lock(replay_mutex_);
+  replaying_ = false;
+  // A request with an old dictionary would never succeed.
+  if (status.ok() || InvalidDictionaryStatus(status)) {
+    spool_->Pop(sequence);
+    ++total_replayed_report_batches_;
+    replay_backoff_ms_ = options_.spool_retry_min_ms;
     if (!status.ok()) {
-      GOOGLE_LOG(ERROR) << "Mixer Report failed with: " << status.ToString();
-      if (InvalidDictionaryStatus(status)) {
-        compressor_.ShrinkGlobalDictionary();
+      // The caller stops, the next records are sent by another replay.
+      ScheduleReplayWithLock(0);
+    }
+    return status.ok();
+  }
+  next_replay_time_ = std::chrono::steady_clock::now() +
+                      std::chrono::milliseconds(replay_backoff_ms_);
+  ScheduleReplayWithLock(replay_backoff_ms_);
+  replay_backoff_ms_ =
+      std::min(2 * replay_backoff_ms_, options_.spool_retry_max_ms);
+  return false;
+}
+
+void ReportBatch::ScheduleReplayWithLock(int delay_ms) {
+  if (replay_scheduled_) {
+    return;
+  }
+  if (replay_timer_) {
+    replay_scheduled_ = true;
+    replay_timer_->Start(delay_ms);
+  } else if (worker_.joinable()) {
+    replay_scheduled_ = true;
+    {
+      std::lock_guard<std::mutex> lock(worker_mutex_);
+      replay_requested_ = true;
+      replay_time_ = std::chrono::steady_clock::now() +
+                     std::chrono::milliseconds(delay_ms);
+    }
+    worker_cv_.notify_one();
+  }
+}
+
+void ReportBatch::RunScheduledReplay() {
+  {
+    std::lock_guard<std::mutex> lock(replay_mutex_);
+    replay_scheduled_ = false;
+  }
+  ReplaySpool();
+}
+
+void ReportBatch::CompleteInflight(uint64_t id) {
+  std::lock_guard<std::mutex> lock(inflight_mutex_);
+  // Not found if the batch was dropped by DROP_OLDEST.
+  for (auto it = inflight_batches_.begin(); it != inflight_batches_.end();
+       ++it) {
+    if (it->id == id) {
+      inflight_bytes_ -= it->byte_size;
+      inflight_batches_.erase(it);
+      return;
+    }
+  }
+}
+
+void ReportBatch::Enqueue(std::unique_ptr<Attributes> request) {
+  queue_.Push(std::move(request));
+  // Only the report making the queue non-empty schedules a drain, the
+  // drain doesn't stop until the queue is empty.
+  if (queued_reports_.fetch_add(1) == 0) {
+    ScheduleDrain();
+  }
+}
+
+void ReportBatch::ScheduleDrain() {
+  if (executor_) {
+    std::shared_ptr<SharedState> state = shared_state_;
+    executor_([state]() {
+      RunIfAlive(state, [](ReportBatch* batch) { batch->DrainQueue(); });
+    });
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(worker_mutex_);
+    drain_requested_ = true;
+  }
+  worker_cv_.notify_one();
+}
+
+void ReportBatch::RunIfAlive(const std::shared_ptr<SharedState>& state,
+                             const std::function<void(ReportBatch*)>& fn) {
+  ReportBatch* batch;
+  {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    batch = state->batch;
+    if (batch == nullptr) {
+      return;
+    }
+    ++state->running;
+  }
+  fn(batch);
+  {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    --state->running;
+  }
+  state->cv.notify_all();
+}
+
+void ReportBatch::DrainQueue() {
+  // Only drains the reports queued so far, so the executor is not blocked
+  // by a steady stream of reports.
+  int64_t budget = queued_reports_;
+  while (queued_reports_ > 0 && budget > 0) {
+    RequestList requests;
+    int count;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      count = DrainQueueWithLock(kMaxDrainCount, &requests);
+    }
+    Send(&requests);
+    budget -= count;
+    if (count == 0) {
+      // A report is being pushed.
+      std::this_thread::yield();
+    }
+  }
+  // Nobody else drains the remaining reports.
+  if (queued_reports_ > 0) {
+    ScheduleDrain();
+  }
+}
+
+int ReportBatch::DrainQueueWithLock(int max_count, RequestList* requests) {
+  std::unique_ptr<Attributes> request;
+  int count = 0;
+  while (count < max_count && queue_.Pop(&request)) {
+    AddWithLock(*request, requests);
+    ++count;
+  }
+  // Decreased after the reports are added, so a new report doesn't
+  // schedule a drain while this one is still running.
+  queued_reports_ -= count;
+  return count;
+}
+
+void ReportBatch::RunWorker() {
+  std::chrono::steady_clock::time_point deadline;
+  bool has_deadline = false;
+  std::chrono::steady_clock::time_point replay_deadline;
+  bool has_replay = false;
+  while (true) {
+    bool replay = false;
+    {
+      std::unique_lock<std::mutex> lock(worker_mutex_);
+      auto wakeup = [this]() {
+        return stopped_ || drain_requested_ || replay_requested_;
+      };
+      if (has_deadline || has_replay) {
+        // The earliest of the batch deadline and the scheduled replay.
+        auto wakeup_time = has_deadline ? deadline : replay_deadline;
+        if (has_replay && replay_deadline < wakeup_time) {
+          wakeup_time = replay_deadline;
+        }
+        worker_cv_.wait_until(lock, wakeup_time, wakeup);
+      } else {
+        worker_cv_.wait(lock, wakeup);
+      }
+      if (stopped_) {
+        return;
+      }
+      drain_requested_ = false;
+      if (replay_requested_) {
+        replay_requested_ = false;
+        replay_deadline = replay_time_;
+        has_replay = true;
+      }
+      if (has_replay &&
+          std::chrono::steady_clock::now() >= replay_deadline) {
+        has_replay = false;
+        replay = true;
+      }
+    }
+    DrainQueue();
+    has_deadline = FlushExpired(&deadline);
+    if (replay) {
+      RunScheduledReplay();
+    }
+  }
+}
+
+bool ReportBatch::FlushExpired(std::chrono::steady_clock::time_point* deadline) {
+  RequestList requests;
+  bool has_batch;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (HasBatchWithLock() &&
+        std::chrono::steady_clock::now() >= batch_deadline_) {
+      FinishWithLock(FLUSH_BY_TIME, &requests);
+    }
+    has_batch = HasBatchWithLock();
+    *deadline = batch_deadline_;
+  }
+  Send(&requests);
+  return has_batch;
+}
+
+void ReportBatch::Flush() { FlushWithReason(FLUSH_BY_REQUEST); }
+
+void ReportBatch::FlushWithReason(FlushReason reason) {
+  RequestList requests;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Includes the reports queued so far, waits for those being pushed.
+    int64_t budget = queued_reports_;
+    while (queued_reports_ > 0 && budget > 0) {
+      int count = DrainQueueWithLock(static_cast<int>(budget), &requests);
+      budget -= count;
+      if (count == 0) {
+        std::this_thread::yield();
       }
     }
-  });
+    FinishWithLock(reason, &requests);
+  }
+  Send(&requests);
 }
 
-void ReportBatch::Flush() {
-  std::lock_guard<std::mutex> lock(mutex_);
-  FlushWithLock();
+void ReportBatch::GetStatistics(Statistics* stat) const {
+  stat->total_report_calls = total_report_calls_;
+  stat->total_remote_report_calls = total_remote_report_calls_;
+  stat->total_remote_report_entries = total_remote_report_entries_;
+  stat->total_remote_report_bytes = total_remote_report_bytes_;
+  stat->total_report_flushes_by_entries = total_flushes_[FLUSH_BY_ENTRIES];
+  stat->total_report_flushes_by_bytes = total_flushes_[FLUSH_BY_BYTES];
+  stat->total_report_flushes_by_time = total_flushes_[FLUSH_BY_TIME];
+  stat->total_report_flushes_by_delta_update =
+      total_flushes_[FLUSH_BY_DELTA_UPDATE];
+  stat->total_report_flushes_by_request = total_flushes_[FLUSH_BY_REQUEST];
+  stat->total_dropped_report_batches = total_dropped_report_batches_;
+  stat->total_dropped_report_entries = total_dropped_report_entries_;
+  stat->total_spooled_report_batches = total_spooled_report_batches_;
+  stat->total_replayed_report_batches = total_replayed_report_batches_;
+  stat->total_spool_dropped_report_batches =
+      spool_ ? spool_->total_dropped() : 0;
+  stat->total_aggregated_reports = total_aggregated_reports_;
+  stat->total_reencoded_report_batches = total_reencoded_report_batches_;
+  stat->learned_dictionary_bytes_saved =
+      learned_dictionary_ ? learned_dictionary_->bytes_saved() : 0;
+  stat->report_batch_time_ms = flush_controller_.batch_time_ms();
+  stat->report_batch_entries = flush_controller_.batch_entries();
 }
 
 }  // namespace mixer_client
@@ -18,9 +18,20 @@
 
 #include "include/client.h"
 #include "src/attribute_compressor.h"
+#include "src/mpsc_queue.h"
+#include "src/report_aggregator.h"
+#include "src/report_flush_controller.h"
+#include "src/report_orderer.h"
+#include "src/report_spool.h"
 
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
 #include <mutex>
+#include <thread>
+#include <vector>
 
 namespace istio {
 namespace mixer_client {
@@ -28,14 +39,23 @@ namespace mixer_client {
 // Report batch, this interface is thread safe.
 class ReportBatch {
  public:
+  // With options.async_report, reports are compressed and sent by tasks
+  // passed to executor, or by a dedicated thread if executor is not set.
+  // If raw_transport is set, the batches are serialized as they are built
+  // and sent with it instead of transport.
   ReportBatch(const ReportOptions& options, TransportReportFunc transport,
-              TimerCreateFunc timer_create, AttributeCompressor& compressor);
+              TimerCreateFunc timer_create, AttributeCompressor& compressor,
+              ExecutorFunc executor = nullptr,
+              TransportRawReportFunc raw_transport = nullptr);
 
   virtual ~ReportBatch();
 
   // Make batched report call.
   void Report(const ::istio::mixer::v1::Attributes& request);
 
+  // Make batched report call, taking the ownership of the attributes.
+  void Report(::istio::mixer::v1::Attributes&& request);
+
   // Flush out batched reports.
   void Flush();
 
@@ -44,14 +64,132 @@ class ReportBatch {
     return total_remote_report_calls_;
   }
 
+  // Fills the report fields of the statistics.
+  void GetStatistics(Statistics* stat) const;
+
  private:
-  void FlushWithLock();
+  // The reasons to send a batch.
+  enum FlushReason {
+    FLUSH_BY_ENTRIES,
+    FLUSH_BY_BYTES,
+    FLUSH_BY_TIME,
+    FLUSH_BY_DELTA_UPDATE,
+    FLUSH_BY_REQUEST,
+    NUM_FLUSH_REASONS,
+  };
+
+  // A finished batch.
+  struct Batch {
+    // Either the request, or the serialized one for raw_transport_.
+    std::unique_ptr<::istio::mixer::v1::ReportRequest> request;
+    std::unique_ptr<std::string> serialized;
+    // The encoded size of request.
+    size_t byte_size;
+    int entries;
+    // True if it is encoded again after a dictionary error, so it is not
+    // resent again.
+    bool reencoded = false;
+  };
+  using RequestList = std::vector<Batch>;
+
+  // A sent batch waiting for its response.
+  struct InflightBatch {
+    uint64_t id;
+    size_t byte_size;
+    int entries;
+    CancelFunc cancel;
+  };
+
+  // Adds a report to the batch, and the batches to send to requests.
+  void AddWithLock(const ::istio::mixer::v1::Attributes& request,
+                   RequestList* requests);
+  // Compresses the reports buffered by orderer_.
+  void CompressOrderedWithLock(RequestList* requests);
+  // Adds a report to the batch compressor.
+  void CompressWithLock(const ::istio::mixer::v1::Attributes& request,
+                        RequestList* requests);
+  // Finishes the batch and adds its requests, one per delta chain, to
+  // requests.
+  void FinishWithLock(FlushReason reason, RequestList* requests);
+  // Returns true if a report is waiting in the batch.
+  bool HasBatchWithLock() const;
+  // Drains the queue and sends the batch.
+  void FlushWithReason(FlushReason reason);
+  // Starts to time the batch, its first report is just added.
+  void StartTimerWithLock();
+  // Sends the requests, mutex_ should not be held.
+  void Send(RequestList* requests);
+  // Sends one batch unless it is dropped by the in-flight limits.
+  void SendBatch(Batch* batch);
+  // Encodes a batch rejected for its global dictionary again with the
+  // shrunk one, and sends it. Either request or serialized is set.
+  void ResendReencoded(const ::istio::mixer::v1::ReportRequest* request,
+                       const std::string* serialized, int entries);
+  // Returns true if sending a batch of byte_size exceeds the in-flight
+  // limits, with num_batches of bytes in flight.
+  bool OverInflightLimit(size_t num_batches, size_t bytes,
+                         size_t byte_size) const;
+  // Handles the response of a sent batch. Either request or serialized
+  // is set.
+  void OnReportDone(uint64_t id, std::chrono::steady_clock::time_point start,
+                    const ::istio::mixer::v1::ReportRequest* request,
+                    const std::string* serialized, int entries,
+                    bool reencoded,
+                    const ::google::protobuf::util::Status& status);
+  // Removes a batch from the in-flight list when its response arrives.
+  void CompleteInflight(uint64_t id);
+
+  // Sends the spooled requests one at a time, unless a replay is running
+  // or backing off. While backing off, a replay is scheduled for its end.
+  void ReplaySpool();
+  // Lets the replay timer or the worker thread call ReplaySpool() after
+  // delay_ms, unless it is scheduled already. Nothing is scheduled without
+  // either of them, the spool is then only replayed after a report
+  // succeeds. replay_mutex_ must be held.
+  void ScheduleReplayWithLock(int delay_ms);
+  // Runs a replay scheduled by ScheduleReplayWithLock().
+  void RunScheduledReplay();
+  // Removes a replayed request from the spool, or backs off if it failed.
+  // Returns true if it succeeded.
+  bool OnReplayDone(uint64_t sequence,
+                    const ::google::protobuf::util::Status& status);
+
+  // Shared by the executor tasks and the transport callbacks, so one run
+  // after this object is deleted does nothing, and the destructor waits
+  // for the running ones.
+  struct SharedState {
+    std::mutex mutex;
+    std::condition_variable cv;
+    // Null once the destructor started.
+    ReportBatch* batch;
+    // The number of tasks and callbacks using batch.
+    int running;
+  };
+  // Calls fn with the batch if it is still alive.
+  static void RunIfAlive(const std::shared_ptr<SharedState>& state,
+                         const std::function<void(ReportBatch*)>& fn);
+
+  // Queues a report for async_report.
+  void Enqueue(std::unique_ptr<::istio::mixer::v1::Attributes> request);
+  // Lets the executor or the worker thread drain the queue.
+  void ScheduleDrain();
+  // Adds queued reports to the batch until the queue is empty.
+  void DrainQueue();
+  // Adds at most max_count queued reports to the batch. Returns the number
+  // of reports added.
+  int DrainQueueWithLock(int max_count, RequestList* requests);
+  // The loop of the worker thread.
+  void RunWorker();
+  // Sends the batch if it is older than max_batch_time_ms. Returns false if
+  // the batch is empty, otherwise sets its flush deadline.
+  bool FlushExpired(std::chrono::steady_clock::time_point* deadline);
 
   // The quota options.
   ReportOptions options_;
 
   // The quota transport
   TransportReportFunc transport_;
+  TransportRawReportFunc raw_transport_;
 
   // timer create func
   TimerCreateFunc timer_create_;
@@ -65,11 +203,82 @@ class ReportBatch {
   // timer to flush out batched data.
   std::unique_ptr<Timer> timer_;
 
-  // batched report compressor
-  std::unique_ptr<BatchCompressor> batch_compressor_;
+  // batched report compressors, one per delta chain.
+  std::vector<std::unique_ptr<BatchCompressor>> batch_compressors_;
+  // The total reports and encoded bytes of the compressors.
+  int batch_entries_;
+  size_t batch_bytes_;
+
+  // Merges the reports before they are compressed, null if not used.
+  std::unique_ptr<ReportAggregator> aggregator_;
+
+  // Orders the reports before they are compressed, null if not used.
+  std::unique_ptr<ReportOrderer> orderer_;
+
+  // The words learned from the batches, null if not used.
+  std::unique_ptr<LearnedDictionary> learned_dictionary_;
+
+  // The time to flush the batch, only used by the worker thread.
+  std::chrono::steady_clock::time_point batch_deadline_;
+
+  // Tunes the batch time and size.
+  ReportFlushController flush_controller_;
+
+  // The executor to drain the queue.
+  ExecutorFunc executor_;
+  // The state shared with the executor tasks and the transport callbacks.
+  std::shared_ptr<SharedState> shared_state_;
+
+  // Reports queued with async_report. Popped with mutex_ held.
+  MpscQueue<std::unique_ptr<::istio::mixer::v1::Attributes>> queue_;
+  // The number of reports in queue_, including those being pushed.
+  // A drain is scheduled when it changes from 0.
+  std::atomic_int_fast64_t queued_reports_;
+
+  // The worker thread if async_report is used without executor.
+  std::thread worker_;
+  // Mutex guarding drain_requested_, replay_requested_, replay_time_ and
+  // stopped_.
+  std::mutex worker_mutex_;
+  std::condition_variable worker_cv_;
+  bool drain_requested_;
+  // Set with replay_time_ when a replay is scheduled on the worker thread.
+  bool replay_requested_;
+  std::chrono::steady_clock::time_point replay_time_;
+  bool stopped_;
+
+  // Mutex guarding the in-flight batches.
+  std::mutex inflight_mutex_;
+  // The sent batches waiting for responses, the oldest first.
+  std::deque<InflightBatch> inflight_batches_;
+  size_t inflight_bytes_;
+  uint64_t next_inflight_id_;
+  // The number of batches over the in-flight limits, for sampling.
+  uint64_t overflow_batches_;
+
+  // Failed requests to be sent again, null if not used.
+  std::unique_ptr<ReportSpool> spool_;
+  // Mutex guarding the replay state.
+  std::mutex replay_mutex_;
+  bool replaying_;
+  int replay_backoff_ms_;
+  std::chrono::steady_clock::time_point next_replay_time_;
+  // True if a replay is scheduled on replay_timer_ or the worker thread.
+  bool replay_scheduled_;
+  // The timer to replay the spool once the backoff ends, null if not used.
+  std::unique_ptr<Timer> replay_timer_;
 
   std::atomic_int_fast64_t total_report_calls_;
   std::atomic_int_fast64_t total_remote_report_calls_;
+  std::atomic_int_fast64_t total_remote_report_entries_;
+  std::atomic_int_fast64_t total_remote_report_bytes_;
+  std::atomic_int_fast64_t total_flushes_[NUM_FLUSH_REASONS];
+  std::atomic_int_fast64_t total_dropped_report_batches_;
+  std::atomic_int_fast64_t total_dropped_report_entries_;
+  std::atomic_int_fast64_t total_spooled_report_batches_;
+  std::atomic_int_fast64_t total_replayed_report_batches_;
+  std::atomic_int_fast64_t total_aggregated_reports_;
+  std::atomic_int_fast64_t total_reencoded_report_batches_;
 
   GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(ReportBatch);
 };
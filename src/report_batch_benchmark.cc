@@ -0,0 +1,98 @@
+/* Copyright 2018 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the cost of ReportBatch::Report on the calling threads, with
+// synchronous compression and with async_report.
+// Usage: bazel run -c opt //:report_batch_benchmark
+
+#include "include/attributes_builder.h"
+#include "src/report_batch.h"
+
+#include <stdio.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using ::istio::mixer::v1::Attributes;
+using ::istio::mixer::v1::ReportRequest;
+using ::istio::mixer::v1::ReportResponse;
+using ::google::protobuf::util::Status;
+
+namespace istio {
+namespace mixer_client {
+namespace {
+
+const int kReportsPerThread = 50000;
+
+// A transport which completes reports right away.
+CancelFunc FakeTransport(const ReportRequest& request,
+                         ReportResponse* response, DoneFunc on_done) {
+  on_done(Status::OK);
+  return nullptr;
+}
+
+Attributes CreateReport() {
+  Attributes attributes;
+  AttributesBuilder builder(&attributes);
+  builder.AddString("target.service", "productpage.default.svc.cluster.local");
+  builder.AddString("source.name", "reviews-v1-5b7b7f7d8c-x2lqf");
+  builder.AddString("request.path", "/productpage?id=12345");
+  builder.AddInt64("response.code", 200);
+  builder.AddInt64("response.size", 4096);
+  builder.AddStringMap("request.headers", {{":method", "GET"},
+                                           {":path", "/productpage"},
+                                           {"user-agent", "curl/7.54.0"}});
+  return attributes;
+}
+
+// Returns the nanoseconds per Report call on the reporting threads.
+double RunReports(bool async_report, int num_threads) {
+  ReportOptions options(1000, 1000);
+  options.async_report = async_report;
+  AttributeCompressor compressor;
+  ReportBatch batch(options, FakeTransport, nullptr, compressor);
+  const Attributes report = CreateReport();
+
+  std::vector<std::thread> threads;
+  auto start = std::chrono::steady_clock::now();
+  for (int t = 0; t < num_threads; ++t) {
+    threads.push_back(std::thread([&batch, &report]() {
+      for (int i = 0; i < kReportsPerThread; ++i) {
+        batch.Report(report);
+      }
+    }));
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+  // Each thread makes kReportsPerThread calls in parallel.
+  return elapsed.count() / kReportsPerThread;
+}
+
+}  // namespace
+}  // namespace mixer_client
+}  // namespace istio
+
+int main(int argc, char** argv) {
+  using namespace ::istio::mixer_client;
+  printf("%8s %20s %20s\n", "threads", "sync ns/report", "async ns/report");
+  for (int num_threads : {1, 2, 4, 8}) {
+    printf("%8d %20.1f %20.1f\n", num_threads, RunReports(false, num_threads),
+           RunReports(true, num_threads));
+  }
+  return 0;
+}
@@ -18,6 +18,13 @@
 #include "gtest/gtest.h"
 #include "include/attributes_builder.h"
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <thread>
+
 using ::istio::mixer::v1::Attributes;
 using ::istio::mixer::v1::ReportRequest;
 using ::istio::mixer::v1::ReportResponse;
@@ -44,14 +51,19 @@ class MockReportTransport {
 
 class MockTimer : public Timer {
  public:
-  void Stop() override {}
-  void Start(int interval_ms) override {}
+  void Stop() override { started_ = false; }
+  void Start(int interval_ms) override {
+    started_ = true;
+    interval_ms_ = interval_ms;
+  }
   std::function<void()> cb_;
+  bool started_ = false;
+  int interval_ms_ = -1;
 };
 
 class ReportBatchTest : public ::testing::Test {
  public:
-  ReportBatchTest() : mock_timer_(nullptr), compressor_({}) {
+  ReportBatchTest() : mock_timer_(nullptr) {
     batch_.reset(new ReportBatch(ReportOptions(3, 1000),
                                  mock_report_transport_.GetFunc(),
                                  GetTimerFunc(), compressor_));
@@ -107,6 +119,10 @@ TEST_F(ReportBatchTest, TestBatchReport) {
 }
 
 TEST_F(ReportBatchTest, TestNoDeltaUpdate) {
+  ReportOptions options(3, 1000);
+  options.max_delta_chains = 1;
+  batch_.reset(new ReportBatch(options, mock_report_transport_.GetFunc(),
+                               GetTimerFunc(), compressor_));
   int report_call_count = 0;
   EXPECT_CALL(mock_report_transport_, Report(_, _, _))
       .WillRepeatedly(Invoke([&](const ReportRequest& request,
@@ -127,6 +143,132 @@ TEST_F(ReportBatchTest, TestNoDeltaUpdate) {
 
   batch_->Flush();
   EXPECT_EQ(report_call_count, 2);
+
+  Statistics stat;
+  batch_->GetStatistics(&stat);
+  EXPECT_EQ(stat.total_report_flushes_by_delta_update, 1);
+  EXPECT_EQ(stat.total_report_flushes_by_request, 1);
+}
+
+TEST_F(ReportBatchTest, TestDeltaChains) {
+  ReportOptions options(10, 1000);
+  options.max_delta_chains = 2;
+  batch_.reset(new ReportBatch(options, mock_report_transport_.GetFunc(),
+                               GetTimerFunc(), compressor_));
+  std::vector<int> batch_sizes;
+  EXPECT_CALL(mock_report_transport_, Report(_, _, _))
+      .WillRepeatedly(Invoke([&](const ReportRequest& request,
+                                 ReportResponse* response, DoneFunc on_done) {
+        batch_sizes.push_back(request.attributes_size());
+        on_done(Status::OK);
+      }));
+
+  Attributes with_key;
+  AttributesBuilder(&with_key).AddString("key", "value");
+  Attributes with_other_key;
+  AttributesBuilder(&with_other_key).AddString("other", "value");
+  Attributes empty;
+  // Interleaved reports with different keys go to different chains.
+  for (int i = 0; i < 3; ++i) {
+    batch_->Report(with_key);
+    batch_->Report(with_other_key);
+  }
+  EXPECT_TRUE(batch_sizes.empty());
+
+  // Fits neither chain.
+  batch_->Report(empty);
+  EXPECT_EQ(batch_sizes, std::vector<int>({3, 3}));
+
+  batch_->Flush();
+  EXPECT_EQ(batch_sizes, std::vector<int>({3, 3, 1}));
+
+  Statistics stat;
+  batch_->GetStatistics(&stat);
+  EXPECT_EQ(stat.total_report_flushes_by_delta_update, 1);
+  EXPECT_EQ(stat.total_remote_report_calls, 3);
+}
+
+TEST_F(ReportBatchTest, TestRawTransport) {
+  // The batches are serialized as they are built, for the raw transport.
+  EXPECT_CALL(mock_report_transport_, Report(_, _, _)).Times(0);
+  std::vector<ReportRequest> requests;
+  TransportRawReportFunc raw_transport =
+      [&requests](const std::string& serialized, ReportResponse* response,
+                  DoneFunc on_done) -> CancelFunc {
+    ReportRequest request;
+    EXPECT_TRUE(request.ParseFromString(serialized));
+    requests.push_back(request);
+    on_done(Status::OK);
+    return nullptr;
+  };
+  batch_.reset(new ReportBatch(ReportOptions(3, 1000),
+                               mock_report_transport_.GetFunc(),
+                               GetTimerFunc(), compressor_, nullptr,
+                               raw_transport));
+
+  for (int i = 0; i < 4; ++i) {
+    Attributes report;
+    AttributesBuilder builder(&report);
+    builder.AddString("key", "value" + std::to_string(i));
+    builder.AddInt64("count", i);
+    batch_->Report(report);
+  }
+  batch_->Flush();
+  ASSERT_EQ(requests.size(), 2);
+  EXPECT_EQ(requests[0].attributes_size(), 3);
+  EXPECT_EQ(requests[0].default_words_size(), 5);
+  EXPECT_EQ(requests[1].attributes_size(), 1);
+
+  Statistics stat;
+  batch_->GetStatistics(&stat);
+  EXPECT_EQ(stat.total_remote_report_bytes,
+            requests[0].ByteSizeLong() + requests[1].ByteSizeLong());
+}
+
+TEST_F(ReportBatchTest, TestReencodeOnDictionaryError) {
+  const Status dictionary_error(
+      Code::INVALID_ARGUMENT,
+      "Request could not be processed due to invalid attributes");
+  const int full_size = compressor_.global_word_count();
+  std::vector<ReportRequest> requests;
+  TransportRawReportFunc raw_transport =
+      [&](const std::string& serialized, ReportResponse* response,
+          DoneFunc on_done) -> CancelFunc {
+    ReportRequest request;
+    EXPECT_TRUE(request.ParseFromString(serialized));
+    requests.push_back(request);
+    // The server only knows the base dictionary.
+    on_done(requests.size() == 1 ? dictionary_error : Status::OK);
+    return nullptr;
+  };
+  batch_.reset(new ReportBatch(ReportOptions(1, 1000),
+                               mock_report_transport_.GetFunc(),
+                               GetTimerFunc(), compressor_, nullptr,
+                               raw_transport));
+
+  Attributes report;
+  AttributesBuilder(&report).AddString("key", "value");
+  batch_->Report(report);
+  EXPECT_EQ(requests[0].global_word_count(), full_size);
+
+  Statistics stat;
+  batch_->GetStatistics(&stat);
+  if (compressor_.global_word_count() == full_size) {
+    // Nothing to shrink, the batch is not sent again.
+    EXPECT_EQ(requests.size(), 1);
+    EXPECT_EQ(stat.total_reencoded_report_batches, 0);
+    return;
+  }
+  // Sent once more with the shrunk dictionary.
+  ASSERT_EQ(requests.size(), 2);
+  EXPECT_EQ(requests[1].global_word_count(), compressor_.global_word_count());
+  EXPECT_EQ(stat.total_reencoded_report_batches, 1);
+  EXPECT_EQ(stat.total_remote_report_calls, 2);
+
+  // Not sent again if the re-encoded batch fails too.
+  requests.clear();
+  batch_->Report(report);
+  EXPECT_EQ(requests.size(), 1);
 }
 
 TEST_F(ReportBatchTest, TestBatchReportWithTimeout) {
@@ -149,6 +291,529 @@ TEST_F(ReportBatchTest, TestBatchReportWithTimeout) {
 
   batch_->Flush();
   EXPECT_EQ(report_call_count, 1);
+
+  Statistics stat;
+  batch_->GetStatistics(&stat);
+  EXPECT_EQ(stat.total_report_flushes_by_time, 1);
+  EXPECT_EQ(stat.total_report_flushes_by_request, 0);
+}
+
+TEST_F(ReportBatchTest, TestBatchByteBudget) {
+  ReportOptions options(100, 1000);
+  options.max_batch_bytes = 1000;
+  batch_.reset(new ReportBatch(options, mock_report_transport_.GetFunc(),
+                               GetTimerFunc(), compressor_));
+
+  std::vector<size_t> request_sizes;
+  EXPECT_CALL(mock_report_transport_, Report(_, _, _))
+      .WillRepeatedly(Invoke([&](const ReportRequest& request,
+                                 ReportResponse* response, DoneFunc on_done) {
+        request_sizes.push_back(request.ByteSizeLong());
+        on_done(Status::OK);
+      }));
+
+  // Each report has a new 300 bytes word.
+  for (int i = 0; i < 10; ++i) {
+    Attributes report;
+    AttributesBuilder(&report).AddString("key",
+                                         std::string(300, 'a' + i));
+    batch_->Report(report);
+  }
+  batch_->Flush();
+
+  // Batches are sent once they reach 1000 bytes.
+  ASSERT_EQ(request_sizes.size(), 3);
+  EXPECT_GE(request_sizes[0], 1000);
+  EXPECT_LT(request_sizes[0], 1400);
+
+  Statistics stat;
+  batch_->GetStatistics(&stat);
+  EXPECT_EQ(stat.total_remote_report_calls, 3);
+  EXPECT_EQ(stat.total_remote_report_entries, 10);
+  EXPECT_EQ(stat.total_remote_report_bytes,
+            request_sizes[0] + request_sizes[1] + request_sizes[2]);
+  EXPECT_EQ(stat.total_report_flushes_by_bytes, 2);
+  EXPECT_EQ(stat.total_report_flushes_by_request, 1);
+  EXPECT_EQ(stat.total_report_flushes_by_entries, 0);
+}
+
+// Sends 5 reports, one per batch, with at most 2 in-flight batches.
+// Returns the dropped batches, and the cancelled ones in cancelled.
+// If not cancellable, the transport returns no CancelFunc.
+uint64_t RunInflightLimit(ReportDropPolicy policy, std::vector<int>* sent,
+                          std::vector<int>* cancelled,
+                          bool cancellable = true) {
+  ReportOptions options(1, 1000);
+  options.max_inflight_requests = 2;
+  options.drop_policy = policy;
+  options.drop_sample_interval = 2;
+  std::vector<DoneFunc> pending;
+  AttributeCompressor compressor;
+  ReportBatch batch(
+      options,
+      [&](const ReportRequest& request, ReportResponse* response,
+          DoneFunc on_done) -> CancelFunc {
+        int id = request.attributes(0).int64s().begin()->second;
+        sent->push_back(id);
+        pending.push_back(on_done);
+        if (!cancellable) {
+          return nullptr;
+        }
+        return [cancelled, id]() { cancelled->push_back(id); };
+      },
+      nullptr, compressor);
+
+  for (int i = 0; i < 5; ++i) {
+    Attributes report;
+    AttributesBuilder(&report).AddInt64("id", i);
+    batch.Report(report);
+  }
+
+  // Completed batches make room for new ones.
+  for (const auto& on_done : pending) {
+    on_done(Status::OK);
+  }
+  Attributes report;
+  AttributesBuilder(&report).AddInt64("id", 5);
+  batch.Report(report);
+
+  Statistics stat;
+  batch.GetStatistics(&stat);
+  EXPECT_EQ(stat.total_dropped_report_batches,
+            stat.total_dropped_report_entries);
+  EXPECT_EQ(stat.total_remote_report_calls, sent->size());
+  return stat.total_dropped_report_batches;
+}
+
+TEST(ReportBatchInflightTest, TestDropNewest) {
+  std::vector<int> sent;
+  std::vector<int> cancelled;
+  EXPECT_EQ(RunInflightLimit(ReportDropPolicy::DROP_NEWEST, &sent, &cancelled),
+            3);
+  EXPECT_EQ(sent, std::vector<int>({0, 1, 5}));
+  EXPECT_TRUE(cancelled.empty());
+}
+
+TEST(ReportBatchInflightTest, TestDropOldest) {
+  std::vector<int> sent;
+  std::vector<int> cancelled;
+  EXPECT_EQ(RunInflightLimit(ReportDropPolicy::DROP_OLDEST, &sent, &cancelled),
+            3);
+  EXPECT_EQ(sent, std::vector<int>({0, 1, 2, 3, 4, 5}));
+  EXPECT_EQ(cancelled, std::vector<int>({0, 1, 2}));
+}
+
+TEST(ReportBatchInflightTest, TestDropOldestWithoutCancel) {
+  std::vector<int> sent;
+  std::vector<int> cancelled;
+  // The in-flight batches can't be cancelled, the new ones are dropped.
+  EXPECT_EQ(RunInflightLimit(ReportDropPolicy::DROP_OLDEST, &sent, &cancelled,
+                             false),
+            3);
+  EXPECT_EQ(sent, std::vector<int>({0, 1, 5}));
+  EXPECT_TRUE(cancelled.empty());
+}
+
+TEST(ReportBatchInflightTest, TestSample) {
+  std::vector<int> sent;
+  std::vector<int> cancelled;
+  // Every second batch over the limit is sent.
+  EXPECT_EQ(RunInflightLimit(ReportDropPolicy::SAMPLE, &sent, &cancelled), 3);
+  EXPECT_EQ(sent, std::vector<int>({0, 1, 3, 5}));
+  EXPECT_EQ(cancelled, std::vector<int>({0}));
+}
+
+TEST_F(ReportBatchTest, TestAggregateReports) {
+  ReportOptions options(3, 1000);
+  options.aggregate_reports = true;
+  options.aggregate_sum_attributes = {"response.size"};
+  batch_.reset(new ReportBatch(options, mock_report_transport_.GetFunc(),
+                               GetTimerFunc(), compressor_));
+
+  std::vector<int> batch_sizes;
+  EXPECT_CALL(mock_report_transport_, Report(_, _, _))
+      .WillRepeatedly(Invoke([&](const ReportRequest& request,
+                                 ReportResponse* response, DoneFunc on_done) {
+        batch_sizes.push_back(request.attributes_size());
+        on_done(Status::OK);
+      }));
+
+  // 3 groups fill a batch.
+  for (int i = 0; i < 100; ++i) {
+    Attributes report;
+    AttributesBuilder builder(&report);
+    builder.AddInt64("response.code", i < 98 ? 200 : 404 + i);
+    builder.AddInt64("response.size", 10);
+    batch_->Report(report);
+  }
+  EXPECT_EQ(batch_sizes, std::vector<int>({3}));
+
+  Attributes report;
+  AttributesBuilder(&report).AddInt64("response.code", 200);
+  batch_->Report(report);
+  batch_->Report(report);
+  // The timer sends the aggregated reports.
+  mock_timer_->cb_();
+  EXPECT_EQ(batch_sizes, std::vector<int>({3, 1}));
+
+  Statistics stat;
+  batch_->GetStatistics(&stat);
+  EXPECT_EQ(stat.total_report_calls, 102);
+  EXPECT_EQ(stat.total_aggregated_reports, 98);
+  EXPECT_EQ(stat.total_remote_report_entries, 4);
+  EXPECT_EQ(stat.total_report_flushes_by_entries, 1);
+  EXPECT_EQ(stat.total_report_flushes_by_time, 1);
+}
+
+TEST_F(ReportBatchTest, TestOrderReports) {
+  ReportOptions options(10, 1000);
+  options.report_order_window = 4;
+  batch_.reset(new ReportBatch(options, mock_report_transport_.GetFunc(),
+                               GetTimerFunc(), compressor_));
+
+  std::vector<ReportRequest> requests;
+  EXPECT_CALL(mock_report_transport_, Report(_, _, _))
+      .WillRepeatedly(Invoke([&](const ReportRequest& request,
+                                 ReportResponse* response, DoneFunc on_done) {
+        requests.push_back(request);
+        on_done(Status::OK);
+      }));
+
+  // Interleaved reports of two services.
+  for (int i = 0; i < 5; ++i) {
+    Attributes report;
+    AttributesBuilder builder(&report);
+    builder.AddString("destination.service", i % 2 ? "ratings" : "reviews");
+    builder.AddInt64("id", i);
+    batch_->Report(report);
+  }
+  EXPECT_TRUE(requests.empty());
+  // The timer sends the ordered and the buffered reports.
+  mock_timer_->cb_();
+  ASSERT_EQ(requests.size(), 1);
+  const ReportRequest& request = requests[0];
+  ASSERT_EQ(request.attributes_size(), 5);
+  // Ordered as 0, 2, 1, 3, then 4, only the first of a service has it.
+  EXPECT_EQ(request.attributes(0).strings_size(), 1);
+  EXPECT_EQ(request.attributes(1).strings_size(), 0);
+  EXPECT_EQ(request.attributes(2).strings_size(), 1);
+  EXPECT_EQ(request.attributes(3).strings_size(), 0);
+  EXPECT_EQ(request.attributes(4).strings_size(), 1);
+}
+
+TEST(ReportBatchSpoolTest, TestSpoolFailedBatches) {
+  const char* dir = getenv("TEST_TMPDIR");
+  ReportOptions options(1, 1000);
+  options.spool_path = std::string(dir ? dir : "/tmp") + "/report_batch_spool";
+  options.spool_bytes = 64 * 1024;
+  options.spool_retry_min_ms = 0;
+  remove(options.spool_path.c_str());
+
+  // Fails the calls while unavailable, records the delivered ids.
+  bool available = true;
+  std::vector<int> delivered;
+  AttributeCompressor compressor;
+  ReportBatch batch(options,
+                    [&](const ReportRequest& request, ReportResponse* response,
+                        DoneFunc on_done) -> CancelFunc {
+                      if (!available) {
+                        on_done(Status(Code::UNAVAILABLE, "unavailable"));
+                        return nullptr;
+                      }
+                      for (const auto& attributes : request.attributes()) {
+                        for (const auto& it : attributes.int64s()) {
+                          delivered.push_back(it.second);
+                        }
+                      }
+                      on_done(Status::OK);
+                      return nullptr;
+                    },
+                    nullptr, compressor);
+
+  auto report = [&batch](int id) {
+    Attributes attributes;
+    AttributesBuilder(&attributes).AddInt64("id", id);
+    batch.Report(attributes);
+  };
+  report(0);
+  available = false;
+  report(1);
+  report(2);
+  report(3);
+  EXPECT_EQ(delivered, std::vector<int>({0}));
+
+  // The first succeeded call replays the spooled batches.
+  available = true;
+  report(4);
+  EXPECT_EQ(delivered, std::vector<int>({0, 4, 1, 2, 3}));
+
+  Statistics stat;
+  batch.GetStatistics(&stat);
+  EXPECT_EQ(stat.total_spooled_report_batches, 3);
+  EXPECT_EQ(stat.total_replayed_report_batches, 3);
+  EXPECT_EQ(stat.total_spool_dropped_report_batches, 0);
+  remove(options.spool_path.c_str());
+}
+
+TEST(ReportBatchSpoolTest, TestReplayAfterBackoff) {
+  const char* dir = getenv("TEST_TMPDIR");
+  ReportOptions options(1, 1000);
+  options.spool_path = std::string(dir ? dir : "/tmp") + "/report_batch_replay";
+  options.spool_bytes = 64 * 1024;
+  options.spool_retry_min_ms = 100;
+  options.spool_retry_max_ms = 1000;
+  remove(options.spool_path.c_str());
+
+  bool available = false;
+  std::vector<int> delivered;
+  auto transport = [&](const ReportRequest& request, ReportResponse* response,
+                       DoneFunc on_done) -> CancelFunc {
+    if (!available) {
+      on_done(Status(Code::UNAVAILABLE, "unavailable"));
+      return nullptr;
+    }
+    for (const auto& attributes : request.attributes()) {
+      for (const auto& it : attributes.int64s()) {
+        delivered.push_back(it.second);
+      }
+    }
+    on_done(Status::OK);
+    return nullptr;
+  };
+  // Only the replay timer is created, batches of 1 report are not timed.
+  MockTimer* timer = nullptr;
+  auto timer_create = [&timer](std::function<void()> cb) {
+    timer = new MockTimer;
+    timer->cb_ = cb;
+    return std::unique_ptr<Timer>(timer);
+  };
+  AttributeCompressor compressor;
+  std::unique_ptr<ReportBatch> batch(
+      new ReportBatch(options, transport, timer_create, compressor));
+  auto report = [&batch](int id) {
+    Attributes attributes;
+    AttributesBuilder(&attributes).AddInt64("id", id);
+    batch->Report(attributes);
+  };
+
+  // A spooled request schedules a replay after the backoff, it doesn't
+  // wait for new reports.
+  report(0);
+  ASSERT_TRUE(timer != nullptr);
+  EXPECT_TRUE(timer->started_);
+  EXPECT_EQ(timer->interval_ms_, 100);
+
+  // The requests spooled before a restart are replayed right away.
+  batch.reset();
+  batch.reset(new ReportBatch(options, transport, timer_create, compressor));
+  EXPECT_TRUE(timer->started_);
+  EXPECT_EQ(timer->interval_ms_, 0);
+  available = true;
+  timer->started_ = false;
+  timer->cb_();
+  EXPECT_EQ(delivered, std::vector<int>({0}));
+  EXPECT_FALSE(timer->started_);
+
+  // A failed replay backs off.
+  available = false;
+  report(1);
+  report(2);
+  timer->cb_();
+  EXPECT_TRUE(timer->started_);
+  EXPECT_EQ(timer->interval_ms_, 100);
+
+  // Nothing is replayed before the backoff ends, even after a report
+  // succeeds or the timer fires early.
+  available = true;
+  report(3);
+  EXPECT_EQ(delivered, std::vector<int>({0, 3}));
+  timer->started_ = false;
+  timer->cb_();
+  EXPECT_EQ(delivered, std::vector<int>({0, 3}));
+  EXPECT_TRUE(timer->started_);
+  EXPECT_GT(timer->interval_ms_, 0);
+
+  // All spooled requests are replayed once it ends.
+  std::this_thread::sleep_for(std::chrono::milliseconds(110));
+  timer->cb_();
+  EXPECT_EQ(delivered, std::vector<int>({0, 3, 1, 2}));
+
+  Statistics stat;
+  batch->GetStatistics(&stat);
+  EXPECT_EQ(stat.total_spooled_report_batches, 2);
+  EXPECT_EQ(stat.total_replayed_report_batches, 3);
+  batch.reset();
+  remove(options.spool_path.c_str());
+}
+
+TEST_F(ReportBatchTest, TestAsyncReportWithExecutor) {
+  ReportOptions options(3, 1000);
+  options.async_report = true;
+  std::vector<std::function<void()>> tasks;
+  batch_.reset(new ReportBatch(
+      options, mock_report_transport_.GetFunc(), GetTimerFunc(), compressor_,
+      [&tasks](std::function<void()> task) { tasks.push_back(task); }));
+
+  int report_call_count = 0;
+  EXPECT_CALL(mock_report_transport_, Report(_, _, _))
+      .WillRepeatedly(Invoke([&](const ReportRequest& request,
+                                 ReportResponse* response, DoneFunc on_done) {
+        report_call_count++;
+        on_done(Status::OK);
+      }));
+
+  Attributes report;
+  for (int i = 0; i < 10; ++i) {
+    batch_->Report(report);
+  }
+  // Reports are only queued, one task is scheduled to drain them.
+  EXPECT_EQ(report_call_count, 0);
+  ASSERT_EQ(tasks.size(), 1);
+  tasks[0]();
+  EXPECT_EQ(report_call_count, 3);
+
+  // The last report is flushed by the timer.
+  EXPECT_TRUE(mock_timer_ != nullptr);
+  mock_timer_->cb_();
+  EXPECT_EQ(report_call_count, 4);
+
+  // Flush sends the queued reports.
+  batch_->Report(report);
+  ASSERT_EQ(tasks.size(), 2);
+  batch_->Flush();
+  EXPECT_EQ(report_call_count, 5);
+
+  // A task run after the batch is deleted does nothing.
+  batch_->Report(report);
+  batch_.reset();
+  EXPECT_EQ(report_call_count, 6);
+  ASSERT_EQ(tasks.size(), 3);
+  tasks[2]();
+}
+
+TEST_F(ReportBatchTest, TestDeleteWhileDraining) {
+  ReportOptions options(1, 1000);
+  options.async_report = true;
+  std::thread task_thread;
+  batch_.reset(new ReportBatch(
+      options, mock_report_transport_.GetFunc(), GetTimerFunc(), compressor_,
+      [&task_thread](std::function<void()> task) {
+        task_thread = std::thread(task);
+      }));
+
+  std::promise<void> sending;
+  std::promise<void> release;
+  EXPECT_CALL(mock_report_transport_, Report(_, _, _))
+      .WillOnce(Invoke([&](const ReportRequest& request,
+                           ReportResponse* response, DoneFunc on_done) {
+        sending.set_value();
+        release.get_future().wait();
+        on_done(Status::OK);
+      }));
+
+  Attributes report;
+  batch_->Report(report);
+  sending.get_future().wait();
+
+  // The batch is not deleted while the executor task is still running.
+  std::atomic<bool> deleted(false);
+  std::thread deleter([&]() {
+    batch_.reset();
+    deleted = true;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_FALSE(deleted);
+
+  release.set_value();
+  task_thread.join();
+  deleter.join();
+  EXPECT_TRUE(deleted);
+}
+
+TEST(ReportBatchInflightTest, TestResponseAfterDelete) {
+  ReportOptions options(1, 1000);
+  std::vector<DoneFunc> pending;
+  int cancelled = 0;
+  AttributeCompressor compressor;
+  std::unique_ptr<ReportBatch> batch(new ReportBatch(
+      options,
+      [&](const ReportRequest& request, ReportResponse* response,
+          DoneFunc on_done) -> CancelFunc {
+        pending.push_back(on_done);
+        return [&cancelled]() { ++cancelled; };
+      },
+      nullptr, compressor));
+
+  Attributes report;
+  batch->Report(report);
+  batch->Report(report);
+  ASSERT_EQ(pending.size(), 2);
+
+  // The in-flight batches are not cancelled, their responses are ignored.
+  batch.reset();
+  EXPECT_EQ(cancelled, 0);
+  for (const auto& on_done : pending) {
+    on_done(Status::OK);
+  }
+}
+
+TEST_F(ReportBatchTest, TestAsyncReportWithWorker) {
+  ReportOptions options(3, 100000);
+  options.async_report = true;
+  batch_.reset(new ReportBatch(options, mock_report_transport_.GetFunc(),
+                               nullptr, compressor_));
+
+  std::atomic<int> report_call_count(0);
+  std::atomic<int> report_count(0);
+  EXPECT_CALL(mock_report_transport_, Report(_, _, _))
+      .WillRepeatedly(Invoke([&](const ReportRequest& request,
+                                 ReportResponse* response, DoneFunc on_done) {
+        report_call_count++;
+        report_count += request.attributes_size();
+        on_done(Status::OK);
+      }));
+
+  Attributes report;
+  AttributesBuilder(&report).AddString("key", "value");
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.push_back(std::thread([this, &report]() {
+      for (int i = 0; i < 100; ++i) {
+        batch_->Report(report);
+      }
+    }));
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  // Deleting the batch sends all queued reports.
+  batch_.reset();
+  EXPECT_EQ(report_count, 400);
+  EXPECT_EQ(report_call_count, 134);
+}
+
+TEST_F(ReportBatchTest, TestAsyncReportWorkerTimeout) {
+  ReportOptions options(3, 10);
+  options.async_report = true;
+  batch_.reset(new ReportBatch(options, mock_report_transport_.GetFunc(),
+                               nullptr, compressor_));
+
+  std::atomic<int> report_call_count(0);
+  EXPECT_CALL(mock_report_transport_, Report(_, _, _))
+      .WillRepeatedly(Invoke([&](const ReportRequest& request,
+                                 ReportResponse* response, DoneFunc on_done) {
+        report_call_count++;
+        on_done(Status::OK);
+      }));
+
+  Attributes report;
+  batch_->Report(report);
+  // The worker sends the batch after max_batch_time_ms.
+  for (int i = 0; i < 1000 && report_call_count == 0; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_EQ(report_call_count, 1);
 }
 
 }  // namespace mixer_client
@@ -0,0 +1,105 @@
+/* Copyright 2018 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/report_flush_controller.h"
+
+#include <algorithm>
+
+namespace istio {
+namespace mixer_client {
+namespace {
+
+// The weight of a new sample in the moving averages.
+const double kSampleWeight = 0.2;
+// The shortest batch time, used when reports are too rare to be batched.
+const int kMinBatchTimeMs = 10;
+// The largest batch size for small reports.
+const int kMaxBatchEntries = 100000;
+// Reports are only batched if at least this many are expected to arrive
+// within the batch time.
+const double kMinBatchedReports = 2;
+
+double MovingAverage(double average, double sample) {
+  return average + kSampleWeight * (sample - average);
+}
+
+}  // namespace
+
+ReportFlushController::ReportFlushController(const ReportOptions& options)
+    : options_(options),
+      report_rate_(0),
+      byte_rate_(0),
+      entry_bytes_(0),
+      rtt_ms_(0),
+      has_batch_(false),
+      has_rtt_(false),
+      batch_time_ms_(options.max_batch_time_ms),
+      batch_entries_(options.max_batch_entries) {}
+
+void ReportFlushController::OnBatch(int entries, size_t bytes,
+                                    TimePoint now) {
+  if (!options_.adaptive_flush || entries <= 0) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (has_batch_) {
+    // The reports of this batch arrived since the last one was sent.
+    double interval_ms = std::max(
+        1.0, std::chrono::duration<double, std::milli>(now - last_batch_time_)
+                 .count());
+    report_rate_ = MovingAverage(report_rate_, entries / interval_ms);
+    byte_rate_ = MovingAverage(byte_rate_, bytes / interval_ms);
+    entry_bytes_ = MovingAverage(entry_bytes_,
+                                 static_cast<double>(bytes) / entries);
+    UpdateWithLock();
+  } else {
+    entry_bytes_ = static_cast<double>(bytes) / entries;
+  }
+  has_batch_ = true;
+  last_batch_time_ = now;
+}
+
+void ReportFlushController::OnResponse(std::chrono::milliseconds rtt) {
+  if (!options_.adaptive_flush) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  rtt_ms_ = has_rtt_ ? MovingAverage(rtt_ms_, rtt.count()) : rtt.count();
+  has_rtt_ = true;
+  UpdateWithLock();
+}
+
+void ReportFlushController::UpdateWithLock() {
+  if (report_rate_ <= 0) {
+    return;
+  }
+  // The report latency is the batch time plus the round trip time.
+  double budget_ms = std::max<double>(
+      kMinBatchTimeMs, options_.max_batch_time_ms - (has_rtt_ ? rtt_ms_ : 0));
+
+  double time_ms = kMinBatchTimeMs;
+  if (report_rate_ * budget_ms >= kMinBatchedReports) {
+    // The time to collect target_batch_bytes.
+    time_ms = std::min(budget_ms, options_.target_batch_bytes / byte_rate_);
+  }
+  batch_time_ms_ = std::max(kMinBatchTimeMs, static_cast<int>(time_ms));
+
+  double entries = options_.target_batch_bytes / std::max(1.0, entry_bytes_);
+  batch_entries_ = static_cast<int>(
+      std::max(1.0, std::min<double>(kMaxBatchEntries, entries)));
+}
+
+}  // namespace mixer_client
+}  // namespace istio
@@ -0,0 +1,79 @@
+/* Copyright 2018 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIXERCLIENT_REPORT_FLUSH_CONTROLLER_H
+#define MIXERCLIENT_REPORT_FLUSH_CONTROLLER_H
+
+#include "google/protobuf/stubs/common.h"
+#include "include/options.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+namespace istio {
+namespace mixer_client {
+
+// Decides when a report batch is sent. With ReportOptions::adaptive_flush,
+// the batch time and size are tuned from the observed report rate and
+// transport round trip time; otherwise they are the configured ones.
+// This class is thread safe.
+class ReportFlushController {
+ public:
+  using TimePoint = std::chrono::steady_clock::time_point;
+
+  explicit ReportFlushController(const ReportOptions& options);
+
+  // Records a batch being sent with its number of reports and encoded
+  // bytes.
+  void OnBatch(int entries, size_t bytes, TimePoint now);
+
+  // Records the round trip time of a report request.
+  void OnResponse(std::chrono::milliseconds rtt);
+
+  // The maximum milliseconds the first report of a batch waits.
+  int batch_time_ms() const { return batch_time_ms_; }
+
+  // The maximum number of reports in a batch.
+  int batch_entries() const { return batch_entries_; }
+
+ private:
+  // Recalculates the batch time and size. mutex_ must be held.
+  void UpdateWithLock();
+
+  const ReportOptions options_;
+
+  // Mutex guarding the observed values.
+  std::mutex mutex_;
+  // The moving averages of reports and bytes per millisecond, bytes per
+  // report, and the round trip time.
+  double report_rate_;
+  double byte_rate_;
+  double entry_bytes_;
+  double rtt_ms_;
+  bool has_batch_;
+  bool has_rtt_;
+  TimePoint last_batch_time_;
+
+  std::atomic<int> batch_time_ms_;
+  std::atomic<int> batch_entries_;
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(ReportFlushController);
+};
+
+}  // namespace mixer_client
+}  // namespace istio
+
+#endif  // MIXERCLIENT_REPORT_FLUSH_CONTROLLER_H
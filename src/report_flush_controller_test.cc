@@ -0,0 +1,81 @@
+/* Copyright 2018 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/report_flush_controller.h"
+
+#include "gtest/gtest.h"
+
+using std::chrono::milliseconds;
+
+namespace istio {
+namespace mixer_client {
+namespace {
+
+ReportOptions AdaptiveOptions() {
+  ReportOptions options(1000, 1000);
+  options.adaptive_flush = true;
+  options.target_batch_bytes = 10000;
+  return options;
+}
+
+// Sends batches of entries reports of 100 bytes every interval_ms.
+void SendBatches(ReportFlushController* controller, int entries,
+                 int interval_ms) {
+  ReportFlushController::TimePoint now;
+  for (int i = 0; i < 50; ++i) {
+    now += milliseconds(interval_ms);
+    controller->OnBatch(entries, entries * 100, now);
+  }
+}
+
+TEST(ReportFlushControllerTest, TestNotAdaptive) {
+  ReportOptions options(1000, 1000);
+  ReportFlushController controller(options);
+  SendBatches(&controller, 1, 5000);
+  controller.OnResponse(milliseconds(100));
+  EXPECT_EQ(controller.batch_time_ms(), 1000);
+  EXPECT_EQ(controller.batch_entries(), 1000);
+}
+
+TEST(ReportFlushControllerTest, TestLowTraffic) {
+  ReportFlushController controller(AdaptiveOptions());
+  EXPECT_EQ(controller.batch_time_ms(), 1000);
+  // One report every 5 seconds is not batched.
+  SendBatches(&controller, 1, 5000);
+  EXPECT_EQ(controller.batch_time_ms(), 10);
+  // Batches hold target_batch_bytes.
+  EXPECT_EQ(controller.batch_entries(), 100);
+}
+
+TEST(ReportFlushControllerTest, TestHighTraffic) {
+  ReportFlushController controller(AdaptiveOptions());
+  // 10 reports, 1000 bytes per millisecond fill 10000 bytes in 10ms.
+  SendBatches(&controller, 100, 10);
+  EXPECT_NEAR(controller.batch_time_ms(), 10, 1);
+
+  // 10 reports per second take the full second.
+  SendBatches(&controller, 10, 1000);
+  EXPECT_NEAR(controller.batch_time_ms(), 1000, 1);
+
+  // The round trip time is part of the latency.
+  for (int i = 0; i < 50; ++i) {
+    controller.OnResponse(milliseconds(200));
+  }
+  EXPECT_NEAR(controller.batch_time_ms(), 800, 1);
+}
+
+}  // namespace
+}  // namespace mixer_client
+}  // namespace istio
@@ -0,0 +1,126 @@
+/* Copyright 2018 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the encoded bytes per report of batches of mixed traffic, with
+// and without ReportOptions::report_order_window.
+// Usage: bazel run -c opt //:report_order_benchmark
+
+#include "include/attributes_builder.h"
+#include "src/report_batch.h"
+
+#include <stdio.h>
+#include <chrono>
+#include <vector>
+
+using ::istio::mixer::v1::Attributes;
+using ::istio::mixer::v1::ReportRequest;
+using ::istio::mixer::v1::ReportResponse;
+using ::google::protobuf::util::Status;
+
+namespace istio {
+namespace mixer_client {
+namespace {
+
+const int kNumReports = 100000;
+const int kNumServices = 6;
+const int kNumRoutes = 4;
+
+// Reports of a few services and routes, interleaved in a fixed random
+// order. Most attributes only depend on the service and the route.
+std::vector<Attributes> CreateReports() {
+  std::vector<Attributes> reports;
+  uint32_t random = 12345;
+  for (int i = 0; i < kNumReports; ++i) {
+    random = random * 1103515245 + 12345;
+    const int service = (random >> 16) % kNumServices;
+    const int route = (random >> 8) % kNumRoutes;
+    const std::string name = "service" + std::to_string(service);
+    Attributes attributes;
+    AttributesBuilder builder(&attributes);
+    builder.AddString("destination.service",
+                      name + ".default.svc.cluster.local");
+    builder.AddString("destination.name", name + "-v1-6f7b9c7d5d-8xk2p");
+    builder.AddString("destination.ip", "10.0.1." + std::to_string(service));
+    builder.AddString("source.name", "client-v1-5b7b7f7d8c-x2lqf");
+    builder.AddString("request.path", "/" + name + "/route" +
+                                          std::to_string(route));
+    builder.AddString("request.method", route % 2 ? "POST" : "GET");
+    builder.AddString("request.scheme", "http");
+    builder.AddInt64("response.code", random % 50 == 0 ? 503 : 200);
+    builder.AddInt64("response.size", 1024 * (route + 1));
+    builder.AddInt64("request.size", route % 2 ? 512 : 0);
+    builder.AddDuration("response.duration",
+                        std::chrono::microseconds(100 * (random % 8)));
+    builder.AddBool("connection.mtls", true);
+    builder.AddStringMap(
+        "request.headers",
+        {{":authority", name}, {":path", "/route" + std::to_string(route)},
+         {"user-agent", "client/1.0"}});
+    builder.AddStringMap("response.headers",
+                         {{":status", "200"}, {"content-type", "text/html"}});
+    reports.push_back(attributes);
+  }
+  return reports;
+}
+
+// Reports the corpus, prints the bytes and the nanoseconds per report.
+void Run(const char* name, const std::vector<Attributes>& reports,
+         int order_window, int max_delta_chains) {
+  ReportOptions options(1000, 1000);
+  options.report_order_window = order_window;
+  options.max_delta_chains = max_delta_chains;
+  options.max_batch_bytes = 0;
+  AttributeCompressor compressor;
+  size_t bytes = 0;
+  int requests = 0;
+  auto start = std::chrono::steady_clock::now();
+  {
+    ReportBatch batch(
+        options,
+        [&bytes, &requests](const ReportRequest& request,
+                            ReportResponse* response,
+                            DoneFunc on_done) -> CancelFunc {
+          bytes += request.ByteSizeLong();
+          ++requests;
+          on_done(Status::OK);
+          return nullptr;
+        },
+        nullptr, compressor);
+    for (const auto& report : reports) {
+      batch.Report(report);
+    }
+  }
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+  printf("%-24s %10d %16.1f %16.1f\n", name, requests,
+         static_cast<double>(bytes) / reports.size(),
+         elapsed.count() / reports.size());
+}
+
+}  // namespace
+}  // namespace mixer_client
+}  // namespace istio
+
+int main(int argc, char** argv) {
+  using namespace ::istio::mixer_client;
+  const auto reports = CreateReports();
+  printf("%-24s %10s %16s %16s\n", "mode", "requests", "bytes/report",
+         "ns/report");
+  Run("arrival, 1 chain", reports, 0, 1);
+  Run("arrival, 4 chains", reports, 0, 4);
+  Run("ordered, 1 chain", reports, 1000, 1);
+  Run("ordered, 4 chains", reports, 1000, 4);
+  return 0;
+}
@@ -0,0 +1,74 @@
+/* Copyright 2018 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/report_orderer.h"
+
+using ::istio::mixer::v1::Attributes;
+
+namespace istio {
+namespace mixer_client {
+
+ReportOrderer::ReportOrderer(const ReportOptions& options)
+    : keys_(options.report_order_keys) {}
+
+std::string ReportOrderer::OrderKey(const Attributes& attributes) const {
+  std::string key;
+  const auto& map = attributes.attributes();
+  for (const auto& name : keys_) {
+    const auto it = map.find(name);
+    // Each field starts with a tag so a missing value never collides with
+    // the size prefix of a present one.
+    if (it == map.end()) {
+      key.push_back(0);
+      continue;
+    }
+    key.push_back(1);
+    // Only the string map values may serialize differently when they are
+    // equal, they are rarely used as keys.
+    std::string value = it->second.SerializeAsString();
+    uint32_t size = value.size();
+    key.append(reinterpret_cast<const char*>(&size), sizeof(size));
+    key.append(value);
+  }
+  return key;
+}
+
+void ReportOrderer::Add(const Attributes& attributes) {
+  auto result = groups_.emplace(OrderKey(attributes), groups_.size());
+  report_groups_.push_back(result.first->second);
+  reports_.push_back(attributes);
+}
+
+void ReportOrderer::Flush(std::vector<Attributes>* reports) {
+  // Counting sort by group, stable within a group.
+  std::vector<size_t> starts(groups_.size() + 1, 0);
+  for (size_t group : report_groups_) {
+    ++starts[group + 1];
+  }
+  for (size_t i = 1; i < starts.size(); ++i) {
+    starts[i] += starts[i - 1];
+  }
+  reports->clear();
+  reports->resize(reports_.size());
+  for (size_t i = 0; i < reports_.size(); ++i) {
+    (*reports)[starts[report_groups_[i]]++].Swap(&reports_[i]);
+  }
+  reports_.clear();
+  report_groups_.clear();
+  groups_.clear();
+}
+
+}  // namespace mixer_client
+}  // namespace istio
@@ -0,0 +1,66 @@
+/* Copyright 2018 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIXERCLIENT_REPORT_ORDERER_H
+#define MIXERCLIENT_REPORT_ORDERER_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "google/protobuf/stubs/common.h"
+#include "include/options.h"
+#include "mixer/v1/attributes.pb.h"
+
+namespace istio {
+namespace mixer_client {
+
+// Buffers reports and orders them by their report_order_keys attributes,
+// so similar reports are delta encoded one after another. This class is
+// not thread safe.
+class ReportOrderer {
+ public:
+  explicit ReportOrderer(const ReportOptions& options);
+
+  // Buffers a report.
+  void Add(const ::istio::mixer::v1::Attributes& attributes);
+
+  // The number of buffered reports.
+  size_t size() const { return reports_.size(); }
+
+  // Moves out the buffered reports, those with the same keys together.
+  // The groups are in the order their first reports were added, and the
+  // reports of a group in the order they were added.
+  void Flush(std::vector<::istio::mixer::v1::Attributes>* reports);
+
+ private:
+  // Returns the key identifying the group of the attributes.
+  std::string OrderKey(const ::istio::mixer::v1::Attributes& attributes) const;
+
+  std::vector<std::string> keys_;
+
+  // Maps order keys to their group index.
+  std::unordered_map<std::string, size_t> groups_;
+  // The group index of each report.
+  std::vector<size_t> report_groups_;
+  std::vector<::istio::mixer::v1::Attributes> reports_;
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(ReportOrderer);
+};
+
+}  // namespace mixer_client
+}  // namespace istio
+
+#endif  // MIXERCLIENT_REPORT_ORDERER_H
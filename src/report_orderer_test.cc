@@ -0,0 +1,101 @@
+/* Copyright 2018 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/report_orderer.h"
+
+#include "gtest/gtest.h"
+#include "include/attributes_builder.h"
+
+using ::istio::mixer::v1::Attributes;
+
+namespace istio {
+namespace mixer_client {
+namespace {
+
+Attributes CreateReport(const std::string& service, const std::string& path,
+                        int64_t id) {
+  Attributes attributes;
+  AttributesBuilder builder(&attributes);
+  if (!service.empty()) {
+    builder.AddString("destination.service", service);
+  }
+  if (!path.empty()) {
+    builder.AddString("request.path", path);
+  }
+  builder.AddInt64("id", id);
+  return attributes;
+}
+
+std::vector<int64_t> Ids(const std::vector<Attributes>& reports) {
+  std::vector<int64_t> ids;
+  for (const auto& report : reports) {
+    ids.push_back(report.attributes().at("id").int64_value());
+  }
+  return ids;
+}
+
+TEST(ReportOrdererTest, TestOrderByKeys) {
+  ReportOrderer orderer{ReportOptions()};
+  orderer.Add(CreateReport("reviews", "/a", 0));
+  orderer.Add(CreateReport("ratings", "/a", 1));
+  orderer.Add(CreateReport("reviews", "/b", 2));
+  orderer.Add(CreateReport("reviews", "/a", 3));
+  orderer.Add(CreateReport("", "/a", 4));
+  orderer.Add(CreateReport("ratings", "/a", 5));
+  orderer.Add(CreateReport("", "/a", 6));
+  EXPECT_EQ(orderer.size(), 7);
+
+  std::vector<Attributes> reports;
+  orderer.Flush(&reports);
+  EXPECT_EQ(orderer.size(), 0);
+  // Groups in the order they first came, reports in the order they came.
+  EXPECT_EQ(Ids(reports), std::vector<int64_t>({0, 3, 1, 5, 2, 4, 6}));
+}
+
+TEST(ReportOrdererTest, TestOtherKeys) {
+  ReportOptions options;
+  options.report_order_keys = {"id"};
+  ReportOrderer orderer(options);
+  orderer.Add(CreateReport("reviews", "/a", 1));
+  orderer.Add(CreateReport("reviews", "/b", 2));
+  orderer.Add(CreateReport("ratings", "/b", 1));
+
+  std::vector<Attributes> reports;
+  orderer.Flush(&reports);
+  EXPECT_EQ(Ids(reports), std::vector<int64_t>({1, 1, 2}));
+
+  // Empty after a flush.
+  orderer.Add(CreateReport("reviews", "/a", 3));
+  orderer.Flush(&reports);
+  EXPECT_EQ(Ids(reports), std::vector<int64_t>({3}));
+}
+
+TEST(ReportOrdererTest, TestMissingKeys) {
+  ReportOrderer orderer{ReportOptions()};
+  orderer.Add(CreateReport("", "/a", 0));
+  orderer.Add(CreateReport("/a", "", 1));
+  orderer.Add(CreateReport("", "", 2));
+  orderer.Add(CreateReport("/a", "", 3));
+  orderer.Add(CreateReport("", "/a", 4));
+  orderer.Add(CreateReport("", "", 5));
+
+  std::vector<Attributes> reports;
+  orderer.Flush(&reports);
+  EXPECT_EQ(Ids(reports), std::vector<int64_t>({0, 4, 1, 3, 2, 5}));
+}
+
+}  // namespace
+}  // namespace mixer_client
+}  // namespace istio
@@ -0,0 +1,224 @@
+/* Copyright 2018 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/report_spool.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using ::google::protobuf::StringPiece;
+using ::google::protobuf::util::Status;
+using ::google::protobuf::util::error::Code;
+
+namespace istio {
+namespace mixer_client {
+namespace {
+
+const char kMagic[8] = "MXSPOOL";
+// Increase it if the layout is changed.
+const uint32_t kVersion = 1;
+// Marks the skipped bytes at the end of the ring.
+const uint32_t kWrapMarker = 0xFFFFFFFF;
+const size_t kLengthSize = sizeof(uint32_t);
+
+}  // namespace
+
+struct ReportSpool::Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t capacity;
+  // The offsets of the oldest record and of the next record in the ring.
+  uint64_t head;
+  uint64_t tail;
+  // The bytes from head to tail, including skipped ones.
+  uint64_t used;
+  uint64_t count;
+  // The sequence number of the oldest record.
+  uint64_t head_sequence;
+};
+
+ReportSpool::ReportSpool(char* data, size_t mapped_size)
+    : header_(reinterpret_cast<Header*>(data)),
+      ring_(data + sizeof(Header)),
+      mapped_size_(mapped_size),
+      total_dropped_(0) {}
+
+ReportSpool::~ReportSpool() { munmap(header_, mapped_size_); }
+
+Status ReportSpool::Open(const std::string& path, size_t capacity,
+                         std::unique_ptr<ReportSpool>* spool) {
+  int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd < 0) {
+    return Status(Code::UNAVAILABLE, "Failed to open " + path);
+  }
+  size_t mapped_size = sizeof(Header) + capacity;
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      (static_cast<size_t>(st.st_size) != mapped_size &&
+       ftruncate(fd, mapped_size) != 0)) {
+    close(fd);
+    return Status(Code::UNAVAILABLE, "Failed to resize " + path);
+  }
+  void* data =
+      mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  // The mapping stays valid after the file is closed.
+  close(fd);
+  if (data == MAP_FAILED) {
+    return Status(Code::UNAVAILABLE, "Failed to map " + path);
+  }
+
+  spool->reset(new ReportSpool(static_cast<char*>(data), mapped_size));
+  const Header* header = (*spool)->header_;
+  if (memcmp(header->magic, kMagic, sizeof(kMagic)) != 0 ||
+      header->version != kVersion || header->capacity != capacity ||
+      header->head > capacity || header->tail > capacity ||
+      header->used > capacity) {
+    (*spool)->Reset(capacity);
+  }
+  return Status::OK;
+}
+
+void ReportSpool::Reset(size_t capacity) {
+  memset(header_, 0, sizeof(Header));
+  memcpy(header_->magic, kMagic, sizeof(kMagic));
+  header_->version = kVersion;
+  header_->capacity = capacity;
+}
+
+bool ReportSpool::Append(const StringPiece& data) {
+  const uint64_t capacity = header_->capacity;
+  const uint64_t need = kLengthSize + data.size();
+  if (need > capacity) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  bool wrap;
+  uint64_t skipped;
+  while (true) {
+    if (header_->count == 0) {
+      header_->head = header_->tail = header_->used = 0;
+    }
+    wrap = header_->tail + need > capacity;
+    skipped = wrap ? capacity - header_->tail : 0;
+    if (header_->used + skipped + need <= capacity) {
+      break;
+    }
+    if (DropOldestWithLock()) {
+      ++total_dropped_;
+    } else {
+      Reset(capacity);
+    }
+  }
+
+  if (wrap) {
+    if (skipped >= kLengthSize) {
+      memcpy(ring_ + header_->tail, &kWrapMarker, kLengthSize);
+    }
+    header_->tail = 0;
+    header_->used += skipped;
+  }
+  uint32_t length = data.size();
+  memcpy(ring_ + header_->tail, &length, kLengthSize);
+  memcpy(ring_ + header_->tail + kLengthSize, data.data(), data.size());
+  // The header is updated after the record is written.
+  header_->tail += need;
+  header_->used += need;
+  ++header_->count;
+  return true;
+}
+
+bool ReportSpool::NormalizeHeadWithLock() {
+  const uint64_t remaining = header_->capacity - header_->head;
+  uint32_t length = 0;
+  if (remaining >= kLengthSize) {
+    memcpy(&length, ring_ + header_->head, kLengthSize);
+  }
+  if (remaining < kLengthSize || length == kWrapMarker) {
+    if (header_->used < remaining) {
+      return false;
+    }
+    header_->used -= remaining;
+    header_->head = 0;
+  }
+  return true;
+}
+
+bool ReportSpool::DropOldestWithLock() {
+  if (header_->count == 0 || !NormalizeHeadWithLock()) {
+    return false;
+  }
+  uint32_t length;
+  memcpy(&length, ring_ + header_->head, kLengthSize);
+  uint64_t size = kLengthSize + length;
+  if (size > header_->used || header_->head + size > header_->capacity) {
+    return false;
+  }
+  header_->head += size;
+  header_->used -= size;
+  --header_->count;
+  ++header_->head_sequence;
+  if (header_->count == 0) {
+    header_->head = header_->tail = header_->used = 0;
+  }
+  return true;
+}
+
+bool ReportSpool::Peek(std::string* data, uint64_t* sequence) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (header_->count == 0) {
+    return false;
+  }
+  uint32_t length = 0;
+  bool valid = NormalizeHeadWithLock();
+  if (valid) {
+    memcpy(&length, ring_ + header_->head, kLengthSize);
+  }
+  uint64_t size = kLengthSize + length;
+  if (!valid || size > header_->used ||
+      header_->head + size > header_->capacity) {
+    // Corrupted, e.g. by a crash while writing the header.
+    Reset(header_->capacity);
+    return false;
+  }
+  data->assign(ring_ + header_->head + kLengthSize, length);
+  *sequence = header_->head_sequence;
+  return true;
+}
+
+void ReportSpool::Pop(uint64_t sequence) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (header_->count > 0 && header_->head_sequence == sequence &&
+      !DropOldestWithLock()) {
+    Reset(header_->capacity);
+  }
+}
+
+uint64_t ReportSpool::size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return header_->count;
+}
+
+uint64_t ReportSpool::total_dropped() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return total_dropped_;
+}
+
+}  // namespace mixer_client
+}  // namespace istio
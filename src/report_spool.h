@@ -0,0 +1,95 @@
+/* Copyright 2018 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIXERCLIENT_REPORT_SPOOL_H
+#define MIXERCLIENT_REPORT_SPOOL_H
+
+#include <stdint.h>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "google/protobuf/stubs/common.h"
+#include "google/protobuf/stubs/status.h"
+#include "google/protobuf/stubs/stringpiece.h"
+
+namespace istio {
+namespace mixer_client {
+
+// A FIFO of records in a memory mapped ring file of a fixed size, to keep
+// failed report requests across restarts. When the ring is full, the
+// oldest records are dropped to make room. The file is in host byte order,
+// to be reopened on the same host. Its layout:
+//   header:  magic "MXSPOOL", uint32 version, uint64 capacity, and
+//            uint64 head, tail, used bytes, record count, head sequence
+//   ring:    capacity bytes of records, each a uint32 length and data.
+//            A record doesn't wrap around; the bytes left at the end of
+//            the ring are skipped, marked with a uint32 0xFFFFFFFF if
+//            there is room for it.
+// This class is thread safe.
+class ReportSpool {
+ public:
+  ~ReportSpool();
+
+  // Maps the spool file, creating it if it doesn't exist. A file with a
+  // different capacity or an invalid header is reset.
+  static ::google::protobuf::util::Status Open(
+      const std::string& path, size_t capacity,
+      std::unique_ptr<ReportSpool>* spool);
+
+  // Appends a record. Returns false if it is larger than the ring.
+  bool Append(const ::google::protobuf::StringPiece& data);
+
+  // Gets the oldest record and its sequence number. Returns false if the
+  // spool is empty.
+  bool Peek(std::string* data, uint64_t* sequence);
+
+  // Removes the oldest record if it is still the one with the sequence
+  // number; it may have been dropped to make room since Peek().
+  void Pop(uint64_t sequence);
+
+  // The number of records.
+  uint64_t size() const;
+
+  // The number of records dropped to make room for new ones.
+  uint64_t total_dropped() const;
+
+ private:
+  struct Header;
+
+  ReportSpool(char* data, size_t mapped_size);
+
+  // Initializes an empty spool.
+  void Reset(size_t capacity);
+  // Skips the unused bytes at the end of the ring at head.
+  // Returns false if the ring is corrupted.
+  bool NormalizeHeadWithLock();
+  // Drops the oldest record. Returns false if the ring is corrupted.
+  bool DropOldestWithLock();
+
+  Header* header_;
+  char* ring_;
+  size_t mapped_size_;
+
+  mutable std::mutex mutex_;
+  uint64_t total_dropped_;
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(ReportSpool);
+};
+
+}  // namespace mixer_client
+}  // namespace istio
+
+#endif  // MIXERCLIENT_REPORT_SPOOL_H
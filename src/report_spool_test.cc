@@ -0,0 +1,143 @@
+/* Copyright 2018 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/report_spool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "gtest/gtest.h"
+
+namespace istio {
+namespace mixer_client {
+namespace {
+
+class ReportSpoolTest : public ::testing::Test {
+ public:
+  void SetUp() override {
+    const char* dir = getenv("TEST_TMPDIR");
+    path_ = std::string(dir ? dir : "/tmp") + "/report_spool_test." +
+            ::testing::UnitTest::GetInstance()->current_test_info()->name();
+    remove(path_.c_str());
+  }
+
+  void TearDown() override { remove(path_.c_str()); }
+
+  std::unique_ptr<ReportSpool> Open(size_t capacity) {
+    std::unique_ptr<ReportSpool> spool;
+    EXPECT_TRUE(ReportSpool::Open(path_, capacity, &spool).ok());
+    return spool;
+  }
+
+  // Peeks and pops the oldest record.
+  std::string Pop(ReportSpool* spool) {
+    std::string data;
+    uint64_t sequence;
+    if (!spool->Peek(&data, &sequence)) {
+      return "";
+    }
+    spool->Pop(sequence);
+    return data;
+  }
+
+  std::string path_;
+};
+
+TEST_F(ReportSpoolTest, TestAppendAndPop) {
+  auto spool = Open(1024);
+  std::string data;
+  uint64_t sequence;
+  EXPECT_FALSE(spool->Peek(&data, &sequence));
+
+  EXPECT_TRUE(spool->Append("first"));
+  EXPECT_TRUE(spool->Append("second"));
+  EXPECT_EQ(spool->size(), 2);
+
+  EXPECT_TRUE(spool->Peek(&data, &sequence));
+  EXPECT_EQ(data, "first");
+  // Peek doesn't remove it.
+  EXPECT_TRUE(spool->Peek(&data, &sequence));
+  EXPECT_EQ(data, "first");
+  spool->Pop(sequence);
+  // A stale sequence number doesn't remove the next record.
+  spool->Pop(sequence);
+  EXPECT_EQ(spool->size(), 1);
+
+  EXPECT_EQ(Pop(spool.get()), "second");
+  EXPECT_EQ(spool->size(), 0);
+  EXPECT_FALSE(spool->Peek(&data, &sequence));
+}
+
+TEST_F(ReportSpoolTest, TestWrapAround) {
+  // Each record takes 4 + 10 bytes, 3 of them fit.
+  auto spool = Open(45);
+  const std::string records[] = {"0000000000", "1111111111", "2222222222",
+                                 "3333333333", "4444444444"};
+  EXPECT_TRUE(spool->Append(records[0]));
+  EXPECT_TRUE(spool->Append(records[1]));
+  EXPECT_TRUE(spool->Append(records[2]));
+  EXPECT_EQ(Pop(spool.get()), records[0]);
+  EXPECT_EQ(Pop(spool.get()), records[1]);
+
+  // Written at the start of the ring, skipping the 3 bytes at the end.
+  EXPECT_TRUE(spool->Append(records[3]));
+  EXPECT_TRUE(spool->Append(records[4]));
+  EXPECT_EQ(spool->total_dropped(), 0);
+  EXPECT_EQ(Pop(spool.get()), records[2]);
+  EXPECT_EQ(Pop(spool.get()), records[3]);
+  EXPECT_EQ(Pop(spool.get()), records[4]);
+  EXPECT_EQ(spool->size(), 0);
+}
+
+TEST_F(ReportSpoolTest, TestDropOldestWhenFull) {
+  auto spool = Open(45);
+  for (int i = 0; i < 5; ++i) {
+    EXPECT_TRUE(spool->Append(std::string(10, '0' + i)));
+  }
+  EXPECT_EQ(spool->size(), 3);
+  EXPECT_EQ(spool->total_dropped(), 2);
+  EXPECT_EQ(Pop(spool.get()), std::string(10, '2'));
+  EXPECT_EQ(Pop(spool.get()), std::string(10, '3'));
+  EXPECT_EQ(Pop(spool.get()), std::string(10, '4'));
+
+  // Larger than the ring.
+  EXPECT_FALSE(spool->Append(std::string(42, 'x')));
+}
+
+TEST_F(ReportSpoolTest, TestReopen) {
+  auto spool = Open(1024);
+  EXPECT_TRUE(spool->Append("first"));
+  EXPECT_TRUE(spool->Append("second"));
+  EXPECT_EQ(Pop(spool.get()), "first");
+  spool.reset();
+
+  spool = Open(1024);
+  EXPECT_EQ(spool->size(), 1);
+  EXPECT_EQ(Pop(spool.get()), "second");
+}
+
+TEST_F(ReportSpoolTest, TestReopenWithOtherCapacity) {
+  auto spool = Open(1024);
+  EXPECT_TRUE(spool->Append("first"));
+  spool.reset();
+
+  spool = Open(2048);
+  EXPECT_EQ(spool->size(), 0);
+  EXPECT_TRUE(spool->Append("second"));
+  EXPECT_EQ(Pop(spool.get()), "second");
+}
+
+}  // namespace
+}  // namespace mixer_client
+}  // namespace istio
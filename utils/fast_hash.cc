@@ -0,0 +1,173 @@
+/* Copyright 2018 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "fast_hash.h"
+
+#include <random>
+
+namespace istio {
+namespace mixer_client {
+namespace {
+
+const uint64_t kPrime1 = 0x9E3779B185EBCA87ULL;
+const uint64_t kPrime2 = 0xC2B2AE3D27D4EB4FULL;
+const uint64_t kPrime3 = 0x165667B19E3779F9ULL;
+const uint64_t kPrime4 = 0x85EBCA77C2B2AE63ULL;
+const uint64_t kPrime5 = 0x27D4EB2F165667C5ULL;
+
+inline uint64_t Rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+inline uint64_t Read64(const unsigned char* p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline uint32_t Read32(const unsigned char* p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline uint64_t Round(uint64_t acc, uint64_t input) {
+  acc += input * kPrime2;
+  acc = Rotl(acc, 31);
+  return acc * kPrime1;
+}
+
+inline uint64_t MergeRound(uint64_t acc, uint64_t lane) {
+  acc ^= Round(0, lane);
+  return acc * kPrime1 + kPrime4;
+}
+
+inline uint64_t Avalanche(uint64_t h) {
+  h ^= h >> 33;
+  h *= kPrime2;
+  h ^= h >> 29;
+  h *= kPrime3;
+  h ^= h >> 32;
+  return h;
+}
+
+}  // namespace
+
+FastHash::FastHash(uint64_t seed)
+    : buffer_size_(0), total_length_(0), seed_(seed) {
+  lanes_[0] = seed + kPrime1 + kPrime2;
+  lanes_[1] = seed + kPrime2;
+  lanes_[2] = seed;
+  lanes_[3] = seed - kPrime1;
+}
+
+void FastHash::ConsumeStripe(const unsigned char* p) {
+  // The 4 lanes are independent; compilers vectorize this loop.
+  for (int i = 0; i < 4; ++i) {
+    lanes_[i] = Round(lanes_[i], Read64(p + i * 8));
+  }
+}
+
+FastHash& FastHash::Update(const void* data, size_t size) {
+  const unsigned char* p = static_cast<const unsigned char*>(data);
+  total_length_ += size;
+
+  if (buffer_size_ + size < kStripeLength) {
+    memcpy(buffer_ + buffer_size_, p, size);
+    buffer_size_ += size;
+    return *this;
+  }
+
+  if (buffer_size_ > 0) {
+    size_t fill = kStripeLength - buffer_size_;
+    memcpy(buffer_ + buffer_size_, p, fill);
+    ConsumeStripe(buffer_);
+    p += fill;
+    size -= fill;
+    buffer_size_ = 0;
+  }
+  while (size >= kStripeLength) {
+    ConsumeStripe(p);
+    p += kStripeLength;
+    size -= kStripeLength;
+  }
+  memcpy(buffer_, p, size);
+  buffer_size_ = size;
+  return *this;
+}
+
+std::string FastHash::Digest() {
+  char digest[kDigestLength];
+  Digest(digest);
+  return std::string(digest, kDigestLength);
+}
+
+void FastHash::Digest(char* digest) {
+  uint64_t h1;
+  uint64_t h2;
+  if (total_length_ >= kStripeLength) {
+    h1 = Rotl(lanes_[0], 1) + Rotl(lanes_[1], 7) + Rotl(lanes_[2], 12) +
+         Rotl(lanes_[3], 18);
+    h2 = Rotl(lanes_[3], 3) + Rotl(lanes_[2], 11) + Rotl(lanes_[1], 19) +
+         Rotl(lanes_[0], 27);
+    for (int i = 0; i < 4; ++i) {
+      h1 = MergeRound(h1, lanes_[i]);
+      h2 = MergeRound(h2, lanes_[3 - i]);
+    }
+  } else {
+    h1 = seed_ + kPrime5;
+    h2 = seed_ ^ kPrime4;
+  }
+  h1 += total_length_;
+  h2 += total_length_ * kPrime3;
+
+  // Mix the tail into both halves with different rotations.
+  const unsigned char* p = buffer_;
+  const unsigned char* end = buffer_ + buffer_size_;
+  for (; p + 8 <= end; p += 8) {
+    uint64_t k = Round(0, Read64(p));
+    h1 = Rotl(h1 ^ k, 27) * kPrime1 + kPrime4;
+    h2 = Rotl(h2 ^ k, 29) * kPrime2 + kPrime3;
+  }
+  if (p + 4 <= end) {
+    uint64_t k = static_cast<uint64_t>(Read32(p)) * kPrime1;
+    h1 = Rotl(h1 ^ k, 23) * kPrime2 + kPrime3;
+    h2 = Rotl(h2 ^ k, 21) * kPrime1 + kPrime4;
+    p += 4;
+  }
+  for (; p < end; ++p) {
+    uint64_t k = (*p) * kPrime5;
+    h1 = Rotl(h1 ^ k, 11) * kPrime1;
+    h2 = Rotl(h2 ^ k, 13) * kPrime2;
+  }
+
+  h1 = Avalanche(h1);
+  h2 = Avalanche(h2);
+  h1 += h2;
+  h2 += h1;
+
+  memcpy(digest, &h1, sizeof(h1));
+  memcpy(digest + sizeof(h1), &h2, sizeof(h2));
+}
+
+std::string FastHash::operator()(const void* data, size_t size) {
+  return Update(data, size).Digest();
+}
+
+uint64_t FastHash::RandomSeed() {
+  std::random_device random;
+  return (static_cast<uint64_t>(random()) << 32) | random();
+}
+
+}  // namespace mixer_client
+}  // namespace istio
@@ -0,0 +1,83 @@
+/* Copyright 2018 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIXER_CLIENT_UTILS_FAST_HASH_H_
+#define MIXER_CLIENT_UTILS_FAST_HASH_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+
+namespace istio {
+namespace mixer_client {
+
+// A fast, seeded, non-cryptographic 128 bit hash with the same interface
+// as MD5. It uses 4 independent 64 bit lanes in xxHash64 style over
+// 32 byte stripes, the tail is mixed into two separate 64 bit halves.
+// It is intended for cache keys, not for security.
+class FastHash {
+ public:
+  FastHash(uint64_t seed = 0);
+
+  // Updates the context with data.
+  FastHash& Update(const void* data, size_t size);
+
+  // A helper function for const char*
+  FastHash& Update(const char* str) { return Update(str, strlen(str)); }
+
+  // A helper function for const string
+  FastHash& Update(const std::string& str) {
+    return Update(str.data(), str.size());
+  }
+
+  // A helper function for int
+  FastHash& Update(int d) { return Update(&d, sizeof(d)); }
+
+  // The digest is always 128 bits = 16 bytes
+  static const int kDigestLength = 16;
+
+  // Returns the digest as string.
+  std::string Digest();
+
+  // Writes the kDigestLength bytes digest, without allocating a string.
+  void Digest(char* digest);
+
+  // A short form of generating the hash for a string
+  std::string operator()(const void* data, size_t size);
+
+  // Returns a random seed, so hash values can't be predicted by
+  // the ones providing the data.
+  static uint64_t RandomSeed();
+
+ private:
+  static const int kStripeLength = 32;
+
+  // Consume one stripe of kStripeLength bytes.
+  void ConsumeStripe(const unsigned char* p);
+
+  // Accumulator lanes.
+  uint64_t lanes_[4];
+  // Pending bytes not yet forming a full stripe.
+  unsigned char buffer_[kStripeLength];
+  size_t buffer_size_;
+  // Total bytes received.
+  uint64_t total_length_;
+  uint64_t seed_;
+};
+
+}  // namespace mixer_client
+}  // namespace istio
+
+#endif  // MIXER_CLIENT_UTILS_FAST_HASH_H_
@@ -0,0 +1,71 @@
+/* Copyright 2018 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "fast_hash.h"
+#include "gtest/gtest.h"
+
+#include <unordered_set>
+
+namespace istio {
+namespace mixer_client {
+namespace {
+
+TEST(FastHashTest, TestDigestEqual) {
+  static const char data1[] = "Test Data1";
+  static const char data2[] = "Test Data2";
+  auto d1 = FastHash()(data1, sizeof(data1));
+  auto d11 = FastHash()(data1, sizeof(data1));
+  auto d2 = FastHash()(data2, sizeof(data2));
+  ASSERT_EQ(d1.size(), 16);
+  ASSERT_EQ(d11, d1);
+  ASSERT_NE(d1, d2);
+}
+
+TEST(FastHashTest, TestSeed) {
+  static const char data[] = "Test Data";
+  ASSERT_EQ(FastHash(1)(data, sizeof(data)), FastHash(1)(data, sizeof(data)));
+  ASSERT_NE(FastHash(1)(data, sizeof(data)), FastHash(2)(data, sizeof(data)));
+}
+
+TEST(FastHashTest, TestIncrementalUpdate) {
+  std::string data;
+  for (int i = 0; i < 200; ++i) {
+    data.push_back(static_cast<char>(i * 7));
+  }
+  for (size_t len = 0; len <= data.size(); len += 13) {
+    std::string expected = FastHash(5)(data.data(), len);
+    for (size_t split = 0; split <= len; split += 3) {
+      FastHash hasher(5);
+      hasher.Update(data.data(), split);
+      hasher.Update(data.data() + split, len - split);
+      EXPECT_EQ(hasher.Digest(), expected) << len << " " << split;
+    }
+  }
+}
+
+TEST(FastHashTest, TestNoCollision) {
+  std::unordered_set<std::string> digests;
+  for (int i = 0; i < 100000; ++i) {
+    std::string key = "target.service" + std::to_string(i);
+    digests.insert(FastHash()(key.data(), key.size()));
+    // Differ in one bit from the previous key.
+    digests.insert(FastHash()(&i, sizeof(i)));
+  }
+  EXPECT_EQ(digests.size(), 200000);
+}
+
+}  // namespace
+}  // namespace mixer_client
+}  // namespace istio
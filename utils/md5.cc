@@ -29,11 +29,17 @@ MD5& MD5::Update(const void* data, size_t size) {
 }
 
 std::string MD5::Digest() {
+  char digest[kDigestLength];
+  Digest(digest);
+  return std::string(digest, kDigestLength);
+}
+
+void MD5::Digest(char* digest) {
   if (!finalized_) {
     MD5_Final(digest_, &ctx_);
     finalized_ = true;
   }
-  return std::string(reinterpret_cast<char*>(digest_), kDigestLength);
+  memcpy(digest, digest_, kDigestLength);
 }
 
 std::string MD5::DebugString(const std::string& digest) {
@@ -46,6 +46,9 @@ class MD5 {
   // Returns the digest as string.
   std::string Digest();
 
+  // Writes the kDigestLength bytes digest, without allocating a string.
+  void Digest(char* digest);
+
   // A short form of generating MD5 for a string
   std::string operator()(const void* data, size_t size);
 